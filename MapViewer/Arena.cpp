@@ -0,0 +1,30 @@
+#include "Arena.h"
+#include <stdint.h>
+#include <algorithm>
+
+
+Arena::Arena(size_t _ChunkSize)
+    : m_ChunkSize(_ChunkSize)
+{
+}
+
+
+void* Arena::Allocate(size_t _Size, size_t _Alignment)
+{
+    size_t padding = (_Alignment - ((uintptr_t)m_pCur & (_Alignment - 1))) & (_Alignment - 1);
+    if (!m_pCur || padding + _Size > m_Left)
+    {
+        // big requests get a chunk of their own
+        size_t chunkSize = std::max(m_ChunkSize, _Size + _Alignment);
+        m_Chunks.emplace_back(new char[chunkSize]);
+        m_pCur = m_Chunks.back().get();
+        m_Left = chunkSize;
+        padding = (_Alignment - ((uintptr_t)m_pCur & (_Alignment - 1))) & (_Alignment - 1);
+    }
+
+    char* pResult = m_pCur + padding;
+    m_pCur += padding + _Size;
+    m_Left -= padding + _Size;
+    m_UsedBytes += _Size;
+    return pResult;
+}
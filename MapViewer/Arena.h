@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "Span.h"
+
+// Bump allocator, the memory is freed all at once with the arena.
+// Only types without destructors may live in it.
+class Arena
+{
+public:
+    explicit Arena(size_t _ChunkSize = 64 * 1024);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* Allocate(size_t _Size, size_t _Alignment);
+
+    // default constructed array
+    template<typename T>
+    Span<T> NewArray(size_t _Count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        if (_Count == 0)
+        {
+            return Span<T>();
+        }
+        T* pData = (T*)Allocate(sizeof(T) * _Count, alignof(T));
+        for (size_t i = 0; i < _Count; ++i)
+        {
+            new (pData + i) T();
+        }
+        return Span<T>(pData, _Count);
+    }
+
+    // copy of the given elements
+    template<typename T>
+    Span<const T> Copy(const T* _pData, size_t _Count)
+    {
+        static_assert(std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value, "arena objects are copied as bytes");
+        if (_Count == 0)
+        {
+            return Span<const T>();
+        }
+        T* pData = (T*)Allocate(sizeof(T) * _Count, alignof(T));
+        memcpy(pData, _pData, sizeof(T) * _Count);
+        return Span<const T>(pData, _Count);
+    }
+
+    size_t GetNumChunks() const { return m_Chunks.size(); }
+    size_t GetUsedBytes() const { return m_UsedBytes; }
+
+private:
+    std::vector<std::unique_ptr<char[]>> m_Chunks;
+    char* m_pCur = nullptr;
+    size_t m_Left = 0;
+    size_t m_ChunkSize;
+    size_t m_UsedBytes = 0;
+};
@@ -0,0 +1,62 @@
+#include "Culling.h"
+
+
+IOGAabb TransformAabb(const IOGAabb& _Aabb, const OGMatrix& _World)
+{
+    const OGVec3& vMin = _Aabb.GetMin();
+    const OGVec3& vMax = _Aabb.GetMax();
+
+    OGVec3 vNewMin, vNewMax;
+    for (int i = 0; i < 8; ++i)
+    {
+        OGVec3 vCorner = OGVec3((i & 1) ? vMax.x : vMin.x, (i & 2) ? vMax.y : vMin.y, (i & 4) ? vMax.z : vMin.z);
+        OGVec3 vWorld;
+        MatrixVecMultiply(vWorld, vCorner, _World);
+        if (i == 0)
+        {
+            vNewMin = vNewMax = vWorld;
+            continue;
+        }
+
+        if (vWorld.x < vNewMin.x) vNewMin.x = vWorld.x;
+        if (vWorld.y < vNewMin.y) vNewMin.y = vWorld.y;
+        if (vWorld.z < vNewMin.z) vNewMin.z = vWorld.z;
+        if (vWorld.x > vNewMax.x) vNewMax.x = vWorld.x;
+        if (vWorld.y > vNewMax.y) vNewMax.y = vWorld.y;
+        if (vWorld.z > vNewMax.z) vNewMax.z = vWorld.z;
+    }
+    return IOGAabb(vNewMin, vNewMax);
+}
+
+
+bool IsAabbVisible(const IOGFrustum& _Frustum, const IOGAabb& _Aabb, const OGMatrix& _World)
+{
+    return _Frustum.CheckAabb(TransformAabb(_Aabb, _World));
+}
+
+
+void CullTile(const IOGFrustum& _Frustum, const OGMatrix& _World, const IOGAabb& _TileBounds,
+    const std::vector<IOGAabb>& _MeshBounds, std::vector<uint32_t>& _OutVisibleMeshes, CullingStats& _Stats)
+{
+    _OutVisibleMeshes.clear();
+    if (!IsAabbVisible(_Frustum, _TileBounds, _World))
+    {
+        ++_Stats.TilesCulled;
+        _Stats.MeshesCulled += (uint32_t)_MeshBounds.size();
+        return;
+    }
+
+    ++_Stats.TilesDrawn;
+    for (size_t i = 0; i < _MeshBounds.size(); ++i)
+    {
+        if (IsAabbVisible(_Frustum, _MeshBounds[i], _World))
+        {
+            _OutVisibleMeshes.push_back((uint32_t)i);
+            ++_Stats.MeshesDrawn;
+        }
+        else
+        {
+            ++_Stats.MeshesCulled;
+        }
+    }
+}
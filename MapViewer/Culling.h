@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "IOGAabb.h"
+#include "IOGFrustum.h"
+#include "IOGMatrix.h"
+
+// Counters of the last culled frame
+struct CullingStats
+{
+    uint32_t TilesDrawn = 0;
+    uint32_t TilesCulled = 0;
+    uint32_t MeshesDrawn = 0;
+    uint32_t MeshesCulled = 0;
+};
+
+// Box enclosing _Aabb transformed by _World
+IOGAabb TransformAabb(const IOGAabb& _Aabb, const OGMatrix& _World);
+
+// Checks a box given in the object space of _World against the (world space) frustum
+bool IsAabbVisible(const IOGFrustum& _Frustum, const IOGAabb& _Aabb, const OGMatrix& _World);
+
+// Culls the whole tile first and then each of it's meshes, updates _Stats.
+// _OutVisibleMeshes receives the ids (in _MeshBounds) of the meshes to draw.
+void CullTile(const IOGFrustum& _Frustum, const OGMatrix& _World, const IOGAabb& _TileBounds,
+    const std::vector<IOGAabb>& _MeshBounds, std::vector<uint32_t>& _OutVisibleMeshes, CullingStats& _Stats);
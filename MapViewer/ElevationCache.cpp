@@ -0,0 +1,341 @@
+#include "ElevationCache.h"
+#include "ElevationMap.h"
+#include "ElevationRawFile.h"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+
+QuantizedElevationSampler ElevationTile::GetSampler(int _LevelsUp, int _X, int _Y) const
+{
+    const ElevationWindow window = GetElevationWindow(Extent, ELEVATION_TILE_BORDER, _LevelsUp, _X, _Y);
+    QuantizedElevationSampler sampler(Samples.data(), GetSampleExtent(), window.Scale, window.OffsetX, window.OffsetY);
+    sampler.SetQuantization(Scale, Offset);
+    return sampler;
+}
+
+
+NormalGridSampler ElevationTile::GetNormalSampler(int _LevelsUp, int _X, int _Y) const
+{
+    const ElevationWindow window = GetElevationWindow(Extent, ELEVATION_TILE_BORDER - 1, _LevelsUp, _X, _Y);
+    return NormalGridSampler(Normals.data(), GetNormalExtent(), window.Scale, window.OffsetX, window.OffsetY);
+}
+
+
+void ElevationTile::GetElevationRange(int _LevelsUp, int _X, int _Y, float& _OutMin, float& _OutMax) const
+{
+    // all of the samples the window of GetSampler interpolates between
+    const ElevationWindow window = GetElevationWindow(Extent, ELEVATION_TILE_BORDER, _LevelsUp, _X, _Y);
+    const float size = window.Scale * VECTOR_TILE_EXTENT;
+    int16_t minSample = 0;
+    int16_t maxSample = 0;
+    MinMax.GetRange((int)floorf(window.OffsetX), (int)floorf(window.OffsetY),
+        (int)ceilf(window.OffsetX + size), (int)ceilf(window.OffsetY + size), minSample, maxSample);
+    _OutMin = Scale * minSample + Offset;
+    _OutMax = Scale * maxSample + Offset;
+}
+
+
+ElevationCache::ElevationCache(FilenameFunc _Filename, size_t _BudgetBytes)
+    : m_Filename(_Filename)
+    , m_BudgetBytes(_BudgetBytes)
+{
+}
+
+
+ElevationTilePtr ElevationCache::Get(int _Zoom, int _X, int _Y)
+{
+    const Key key = { _Zoom, _X, _Y };
+    std::promise<ElevationTilePtr> decoded;
+    std::shared_future<ElevationTilePtr> cached;
+    FilenameFunc rawFilename;
+    int leafZoom = -1;
+    uint64_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        auto it = m_Entries.find(key);
+        if (it != m_Entries.end())
+        {
+            Entry& entry = it->second;
+            m_LruOrder.splice(m_LruOrder.begin(), m_LruOrder, entry.LruPos);
+            if (entry.bReady)
+            {
+                ++m_Stats.Hits;
+            }
+            else
+            {
+                ++m_Stats.InFlightWaits;
+            }
+            cached = entry.Tile;
+        }
+        else
+        {
+            Entry& entry = m_Entries[key];
+            entry.Tile = decoded.get_future().share();
+            entry.Generation = ++m_LastGeneration;
+            m_LruOrder.push_front(key);
+            entry.LruPos = m_LruOrder.begin();
+            rawFilename = m_RawFilename;
+            leafZoom = m_LeafZoom;
+            generation = entry.Generation;
+        }
+    }
+
+    // the tile is there or somebody is decoding it right now, wait for them outside of the lock
+    if (cached.valid())
+    {
+        return cached.get();
+    }
+
+    // decode without holding the lock, the other lookups of this tile wait on the future
+    TileSource source = SOURCE_PNG;
+    ElevationTilePtr pTile = LoadTile(_Zoom, _X, _Y, rawFilename, leafZoom, source);
+    decoded.set_value(pTile);
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (pTile)
+    {
+        switch (source)
+        {
+        case SOURCE_PNG: ++m_Stats.Decodes; break;
+        case SOURCE_RAW_FILE: ++m_Stats.RawFileLoads; break;
+        case SOURCE_CHILDREN: ++m_Stats.Derived; break;
+        }
+    }
+    auto it = m_Entries.find(key);
+    // the entry could have been dropped by Clear() in the meantime, and even replaced by the one of a newer decode
+    if (it != m_Entries.end() && it->second.Generation == generation)
+    {
+        it->second.bReady = true;
+        it->second.Bytes = pTile ? pTile->Samples.size() * sizeof(int16_t) + pTile->Normals.size() + pTile->MinMax.GetBytes() : 0;
+        m_Stats.UsedBytes += it->second.Bytes;
+        EvictOverBudget();
+    }
+    return pTile;
+}
+
+
+ElevationTilePtr ElevationCache::GetOrAncestor(int _Zoom, int _X, int _Y, int _MaxLevelsUp, int& _OutLevelsUp)
+{
+    for (int levelsUp = 0; levelsUp <= _MaxLevelsUp && levelsUp <= _Zoom; ++levelsUp)
+    {
+        ElevationTilePtr pTile = Get(_Zoom - levelsUp, _X >> levelsUp, _Y >> levelsUp);
+        if (pTile)
+        {
+            _OutLevelsUp = levelsUp;
+            return pTile;
+        }
+    }
+    _OutLevelsUp = 0;
+    return nullptr;
+}
+
+
+void ElevationCache::SampleElevations(int _Zoom, int _MaxLevelsUp, Span<const double> _Lon, Span<const double> _Lat, Span<float> _OutElevations)
+{
+    const size_t numPoints = _OutElevations.size();
+    std::vector<Key> tiles(numPoints);
+    std::vector<float> x(numPoints);
+    std::vector<float> y(numPoints);
+    std::vector<size_t> order(numPoints);
+    for (size_t i = 0; i < numPoints; ++i)
+    {
+        tiles[i].Zoom = _Zoom;
+        GetTilePosition(_Zoom, _Lon[i], _Lat[i], tiles[i].X, tiles[i].Y, x[i], y[i]);
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&tiles](size_t _A, size_t _B) { return tiles[_A] < tiles[_B]; });
+
+    std::vector<float> batchX;
+    std::vector<float> batchY;
+    std::vector<float> batchZ;
+    for (size_t first = 0; first < numPoints;)
+    {
+        const Key& tile = tiles[order[first]];
+        size_t last = first + 1;
+        while (last < numPoints && !(tile < tiles[order[last]]))
+        {
+            ++last;
+        }
+
+        int levelsUp = 0;
+        ElevationTilePtr pTile = GetOrAncestor(tile.Zoom, tile.X, tile.Y, _MaxLevelsUp, levelsUp);
+        if (!pTile)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                _OutElevations[order[i]] = std::numeric_limits<float>::quiet_NaN();
+            }
+            first = last;
+            continue;
+        }
+
+        batchX.clear();
+        batchY.clear();
+        for (size_t i = first; i < last; ++i)
+        {
+            batchX.push_back(x[order[i]]);
+            batchY.push_back(y[order[i]]);
+        }
+        batchZ.resize(batchX.size());
+        pTile->GetSampler(levelsUp, tile.X, tile.Y).Sample(Span<const float>(batchX.data(), batchX.size()),
+            Span<const float>(batchY.data(), batchY.size()), Span<float>(batchZ.data(), batchZ.size()));
+        for (size_t i = first; i < last; ++i)
+        {
+            _OutElevations[order[i]] = batchZ[i - first];
+        }
+        first = last;
+    }
+}
+
+
+void ElevationCache::SetRawFilename(FilenameFunc _RawFilename)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_RawFilename = _RawFilename;
+}
+
+
+void ElevationCache::SetLeafZoom(int _Zoom)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_LeafZoom = _Zoom;
+}
+
+
+void ElevationCache::SetBudget(size_t _BudgetBytes)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_BudgetBytes = _BudgetBytes;
+    EvictOverBudget();
+}
+
+
+void ElevationCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    // tiles in flight are left to their decoders, they just don't come back into the cache
+    m_Entries.clear();
+    m_LruOrder.clear();
+    m_Stats.UsedBytes = 0;
+}
+
+
+ElevationCacheStats ElevationCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Stats;
+}
+
+
+ElevationTilePtr ElevationCache::LoadTile(int _Zoom, int _X, int _Y, const FilenameFunc& _RawFilename, int _LeafZoom, TileSource& _OutSource)
+{
+    if (_Zoom < _LeafZoom)
+    {
+        ElevationTilePtr pTile = DeriveTile(_Zoom, _X, _Y);
+        if (pTile)
+        {
+            _OutSource = SOURCE_CHILDREN;
+            return pTile;
+        }
+    }
+
+    MappedFilePtr pSource = MappedFile::Load(m_Filename(_Zoom, _X, _Y));
+    if (!pSource)
+    {
+        return nullptr;
+    }
+
+    // the raw file is up to date if it was written for the same PNG content
+    auto pTile = std::make_shared<ElevationTile>();
+    uint64_t rawKey = 0;
+    std::string rawFilename;
+    if (_RawFilename)
+    {
+        rawKey = ComputeElevationRawKey(pSource->GetData(), pSource->GetSize(), _Zoom);
+        rawFilename = _RawFilename(_Zoom, _X, _Y);
+        if (LoadElevationRawFile(rawFilename, rawKey, *pTile))
+        {
+            pTile->MinMax.Build(pTile->Samples.data(), pTile->GetSampleExtent());
+            _OutSource = SOURCE_RAW_FILE;
+            return pTile;
+        }
+    }
+
+    std::vector<float> elevations;
+    if (!LoadTerrariumElevationMap(pSource->GetData(), pSource->GetSize(), pTile->Extent, elevations, ELEVATION_TILE_BORDER) ||
+        pTile->Extent < 2)
+    {
+        return nullptr;
+    }
+    SetElevations(_Zoom, elevations, *pTile);
+
+    // failing to write the raw file only costs the next decode
+    if (_RawFilename)
+    {
+        SaveElevationRawFile(rawFilename, rawKey, *pTile);
+    }
+    return pTile;
+}
+
+
+ElevationTilePtr ElevationCache::DeriveTile(int _Zoom, int _X, int _Y)
+{
+    // the children come from the cache, so the leaf tiles are decoded once for all of the levels
+    ElevationTilePtr children[4];
+    QuantizedElevationMapView views[4];
+    for (int c = 0; c < 4; ++c)
+    {
+        children[c] = Get(_Zoom + 1, _X * 2 + (c & 1), _Y * 2 + (c >> 1));
+        if (!children[c] || children[c]->Extent != children[0]->Extent || children[c]->Extent % 2 != 0)
+        {
+            return nullptr;
+        }
+        views[c] = { children[c]->Samples.data(), children[c]->Scale, children[c]->Offset };
+    }
+
+    auto pTile = std::make_shared<ElevationTile>();
+    pTile->Extent = children[0]->Extent;
+    std::vector<float> elevations;
+    DownsampleElevationMaps(views, pTile->Extent, elevations, ELEVATION_TILE_BORDER);
+    SetElevations(_Zoom, elevations, *pTile);
+    return pTile;
+}
+
+
+void ElevationCache::SetElevations(int _Zoom, const std::vector<float>& _Elevations, ElevationTile& _OutTile)
+{
+    // the normals of the first ring of the border need the second one
+    const size_t stride = _OutTile.GetSampleExtent();
+    ComputeNormalGrid(_Elevations.data() + stride + 1, stride, _OutTile.GetNormalExtent(),
+        VECTOR_TILE_EXTENT / (float)_OutTile.Extent, GetElevationScale(_Zoom), _OutTile.DecodedNormals);
+    _OutTile.Normals = Span<const int8_t>(_OutTile.DecodedNormals.data(), _OutTile.DecodedNormals.size());
+
+    QuantizeElevationMap(_Elevations, _OutTile.DecodedSamples, _OutTile.Scale, _OutTile.Offset);
+    _OutTile.Samples = Span<const int16_t>(_OutTile.DecodedSamples.data(), _OutTile.DecodedSamples.size());
+    _OutTile.MinMax.Build(_OutTile.Samples.data(), _OutTile.GetSampleExtent());
+}
+
+
+void ElevationCache::EvictOverBudget()
+{
+    // the most recently used tile stays even if it alone is over the budget
+    auto it = m_LruOrder.end();
+    while (m_Stats.UsedBytes > m_BudgetBytes && it != m_LruOrder.begin())
+    {
+        --it;
+        if (it == m_LruOrder.begin())
+        {
+            break;
+        }
+        auto entryIt = m_Entries.find(*it);
+        if (!entryIt->second.bReady)
+        {
+            continue;
+        }
+        m_Stats.UsedBytes -= entryIt->second.Bytes;
+        ++m_Stats.Evictions;
+        m_Entries.erase(entryIt);
+        it = m_LruOrder.erase(it);
+    }
+}
@@ -0,0 +1,170 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ElevationMinMax.h"
+#include "MappedFile.h"
+#include "NormalGrid.h"
+#include "Span.h"
+#include "ElevationSampler.h"
+
+// Pixels of the DEM border the tiles keep around their elevation maps (all of the border of the PNGs), the normals
+// have one less. The border is the data of the neighbour tiles, so the tiles agree on the elevations and the
+// normals along their edges and the meshes of neighbours meet without stitching.
+const unsigned int ELEVATION_TILE_BORDER = 2;
+
+// Decoded elevation map of a DEM tile, quantized to 16 bits (half of the memory of the floats)
+struct ElevationTile
+{
+    ElevationTile() = default;
+    // Samples may point into the tile itself
+    ElevationTile(const ElevationTile&) = delete;
+    ElevationTile& operator=(const ElevationTile&) = delete;
+
+    // Extent x Extent pixels of the tile itself
+    unsigned int Extent = 0;
+    // GetSampleExtent() x GetSampleExtent() samples with the border, in DecodedSamples or in the mapped raw file
+    Span<const int16_t> Samples;
+    std::vector<int16_t> DecodedSamples;
+    MappedFilePtr pRawFile;
+    // elevation = Scale * sample + Offset
+    float Scale = 1.0f;
+    float Offset = 0.0f;
+    // GetNormalExtent() x GetNormalExtent() terrain normals in tile space, 2 bytes each (see NormalGrid.h),
+    // in DecodedNormals or in the raw file
+    Span<const int8_t> Normals;
+    std::vector<int8_t> DecodedNormals;
+    // ranges of the samples, built along with them
+    ElevationMinMaxTree MinMax;
+
+    unsigned int GetSampleExtent() const { return Extent + 2 * ELEVATION_TILE_BORDER; }
+    unsigned int GetNormalExtent() const { return Extent + 2 * (ELEVATION_TILE_BORDER - 1); }
+
+    // Sampler for the part of the map covered by the descendant (_X, _Y) _LevelsUp levels below,
+    // _LevelsUp = 0 samples the whole map. The tile has to outlive the sampler.
+    QuantizedElevationSampler GetSampler(int _LevelsUp = 0, int _X = 0, int _Y = 0) const;
+    // Normals of the same part of the map as GetSampler
+    NormalGridSampler GetNormalSampler(int _LevelsUp = 0, int _X = 0, int _Y = 0) const;
+    // Elevation range of the same part of the map, embraces everything its sampler can return
+    void GetElevationRange(int _LevelsUp, int _X, int _Y, float& _OutMin, float& _OutMax) const;
+};
+
+typedef std::shared_ptr<const ElevationTile> ElevationTilePtr;
+
+struct ElevationCacheStats
+{
+    uint64_t Hits = 0;
+    // tiles decoded from their PNGs
+    uint64_t Decodes = 0;
+    // tiles mapped from their raw files instead
+    uint64_t RawFileLoads = 0;
+    // tiles downsampled from their 4 children
+    uint64_t Derived = 0;
+    // lookups which found the tile being decoded by another thread and waited for it
+    uint64_t InFlightWaits = 0;
+    uint64_t Evictions = 0;
+    size_t UsedBytes = 0;
+};
+
+// DEM tiles keyed by (zoom, x, y), decoded once and kept while they fit into the byte budget, the least recently
+// used ones are evicted first. Concurrent lookups of the same tile wait for a single decode. Thread safe.
+class ElevationCache
+{
+public:
+    // DEM file of a tile
+    typedef std::function<std::string(int _Zoom, int _X, int _Y)> FilenameFunc;
+
+    ElevationCache(FilenameFunc _Filename, size_t _BudgetBytes = 64 * 1024 * 1024);
+
+    ElevationCache(const ElevationCache&) = delete;
+    ElevationCache& operator=(const ElevationCache&) = delete;
+
+    // Map of the tile or nullptr if its file is missing or broken (that is cached too)
+    ElevationTilePtr Get(int _Zoom, int _X, int _Y);
+
+    // Map of the tile, or if it has none, of the nearest ancestor at most _MaxLevelsUp levels up.
+    // _OutLevelsUp is how far up the returned map is, sample it with GetSampler(_OutLevelsUp, _X, _Y).
+    ElevationTilePtr GetOrAncestor(int _Zoom, int _X, int _Y, int _MaxLevelsUp, int& _OutLevelsUp);
+
+    // Elevations of WGS84 points (degrees), each one sampled from the map of the _Zoom tile it falls into or of its
+    // nearest ancestor at most _MaxLevelsUp levels up. The points are grouped by tile and every group is sampled in
+    // one batch. The points without any map get NaN. The spans must be of the same size.
+    void SampleElevations(int _Zoom, int _MaxLevelsUp, Span<const double> _Lon, Span<const double> _Lat, Span<float> _OutElevations);
+
+    // Raw files of the tiles: a decoded tile is written there, and the next time (in any process) it's mapped from
+    // there if its PNG is still the same. An empty function (the default) turns them off.
+    void SetRawFilename(FilenameFunc _RawFilename);
+
+    // Tiles above _Zoom are downsampled from their 4 children (recursively, down to _Zoom), so all of the levels
+    // agree on the elevations and only the leaf DEMs are decoded. A tile is taken from its own file if any of its
+    // children is missing. -1 (the default) decodes every tile from its file.
+    void SetLeafZoom(int _Zoom);
+
+    void SetBudget(size_t _BudgetBytes);
+    // Drops all of the tiles, the ones still in use stay alive until they're released
+    void Clear();
+
+    ElevationCacheStats GetStats() const;
+
+private:
+    struct Key
+    {
+        int Zoom;
+        int X;
+        int Y;
+        bool operator<(const Key& _Other) const
+        {
+            if (Zoom != _Other.Zoom) return Zoom < _Other.Zoom;
+            if (X != _Other.X) return X < _Other.X;
+            return Y < _Other.Y;
+        }
+    };
+
+    struct Entry
+    {
+        std::shared_future<ElevationTilePtr> Tile;
+        bool bReady = false;
+        // tells the entries of the same key apart, see Clear()
+        uint64_t Generation = 0;
+        size_t Bytes = 0;
+        // position in m_LruOrder
+        std::list<Key>::iterator LruPos;
+    };
+
+    enum TileSource
+    {
+        SOURCE_PNG,
+        SOURCE_RAW_FILE,
+        SOURCE_CHILDREN,
+    };
+
+    // Downsamples the tile from its children or reads it from its raw file or PNG, nullptr if there is none.
+    // Call without m_Mutex locked.
+    ElevationTilePtr LoadTile(int _Zoom, int _X, int _Y, const FilenameFunc& _RawFilename, int _LeafZoom, TileSource& _OutSource);
+    ElevationTilePtr DeriveTile(int _Zoom, int _X, int _Y);
+    // Normals, quantized samples and min/max tree of a tile from its elevations (with the border)
+    static void SetElevations(int _Zoom, const std::vector<float>& _Elevations, ElevationTile& _OutTile);
+
+    // call with m_Mutex locked
+    void EvictOverBudget();
+
+private:
+    FilenameFunc m_Filename;
+    FilenameFunc m_RawFilename;
+    int m_LeafZoom = -1;
+    size_t m_BudgetBytes;
+
+    mutable std::mutex m_Mutex;
+    std::map<Key, Entry> m_Entries;
+    // most recently used first
+    std::list<Key> m_LruOrder;
+    uint64_t m_LastGeneration = 0;
+    ElevationCacheStats m_Stats;
+};
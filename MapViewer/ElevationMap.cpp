@@ -1,99 +1,403 @@
 #include "ElevationMap.h"
 #include <png.h>
 #include <pngconf.h>
-#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "MappedFile.h"
+#include "ReferenceKernels.h"
+#include "SimdConfig.h"
 
 
-bool LoadTerrariumElevationMap(const std::string& _Filename, unsigned int& _OutExtent, std::vector<float>& _OutElevationMap)
+// libpng reads the whole image from the mapped file
+struct PngMemoryReader
 {
-    int width, height;
-    png_byte color_type;
-    png_byte bit_depth;
+    const png_byte* pData;
+    size_t Size;
+    size_t Offset;
+};
+
 
-    png_structp png_ptr;
-    png_infop info_ptr;
-    int number_of_passes;
-    png_bytep* row_pointers;
+static void ReadPngData(png_structp _pPng, png_bytep _pOut, png_size_t _Size)
+{
+    PngMemoryReader* pReader = (PngMemoryReader*)png_get_io_ptr(_pPng);
+    if (_Size > pReader->Size - pReader->Offset)
+    {
+        png_error(_pPng, "unexpected end of file");
+    }
+    memcpy(_pOut, pReader->pData + pReader->Offset, _Size);
+    pReader->Offset += _Size;
+}
 
-    char header[8];    // 8 is the maximum size that can be checked
 
-    /* open file and test for it being a png */
-    FILE* fp = fopen(_Filename.c_str(), "rb");
-    if (!fp)
-        return false; // File could not be opened for reading
-    fread(header, 1, 8, fp);
-    if (png_sig_cmp((png_const_bytep)header, 0, 8))
+// Terrarium encoding: (red * 256 + green + blue / 256) - 32768. Every term and the sum are exact
+// in a float (at most 24 significant bits), so any evaluation order gives the same bits.
+static void DecodeTerrariumPixelsScalar(const png_byte* _pRGBA, size_t _NumPixels, float* _pOut)
+{
+    for (size_t i = 0; i < _NumPixels; ++i)
+    {
+        // R = ptr[0], G = ptr[1], B = ptr[2], A = ptr[3] (unused)
+        const png_byte* ptr = _pRGBA + i * 4;
+        _pOut[i] = (float)(ptr[0] * 256 + ptr[1] - 32768) + ptr[2] * (1.0f / 256.0f);
+    }
+}
+
+
+#if MAPVIEWER_SSE2
+// 4 pixels at a time, a pixel is a little endian 32 bit word
+static void DecodeTerrariumPixelsSSE2(const png_byte* _pRGBA, size_t _NumPixels, float* _pOut)
+{
+    const __m128i byteMask = _mm_set1_epi32(0xFF);
+    const __m128i offset = _mm_set1_epi32(32768);
+    const __m128 blueScale = _mm_set1_ps(1.0f / 256.0f);
+    size_t i = 0;
+    for (; i + 4 <= _NumPixels; i += 4)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i*)(_pRGBA + i * 4));
+        __m128i r = _mm_and_si128(pixels, byteMask);
+        __m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 8), byteMask);
+        __m128i b = _mm_and_si128(_mm_srli_epi32(pixels, 16), byteMask);
+        __m128i rg = _mm_sub_epi32(_mm_add_epi32(_mm_slli_epi32(r, 8), g), offset);
+        __m128 elev = _mm_add_ps(_mm_cvtepi32_ps(rg), _mm_mul_ps(_mm_cvtepi32_ps(b), blueScale));
+        _mm_storeu_ps(_pOut + i, elev);
+    }
+    DecodeTerrariumPixelsScalar(_pRGBA + i * 4, _NumPixels - i, _pOut + i);
+}
+#endif
+
+
+static void DecodeTerrariumPixels(const png_byte* _pRGBA, size_t _NumPixels, float* _pOut, bool _bScalar)
+{
+#if MAPVIEWER_SSE2
+    if (!_bScalar)
+    {
+        DecodeTerrariumPixelsSSE2(_pRGBA, _NumPixels, _pOut);
+        return;
+    }
+#endif
+    DecodeTerrariumPixelsScalar(_pRGBA, _NumPixels, _pOut);
+}
+
+
+// Reads the PNG set up in _pPng and decodes its pixels. png_error (e.g. on a truncated file) jumps back to the
+// setjmp here, so nothing after it changes a local of this function: the buffers belong to the caller, they're
+// valid after the jump and freed by the caller.
+static bool ReadTerrariumPng(png_structp _pPng, png_infop _pInfo, unsigned int _Border, bool _bScalar,
+    std::vector<png_byte>& _Rows, std::vector<png_bytep>& _RowPointers, unsigned int& _OutExtent, std::vector<float>& _OutElevationMap)
+{
+    if (setjmp(png_jmpbuf(_pPng)))
+    {
+        return false;
+    }
+
+    png_read_info(_pPng, _pInfo);
+
+    const png_uint_32 width = png_get_image_width(_pPng, _pInfo);
+    const png_uint_32 height = png_get_image_height(_pPng, _pInfo);
+    const png_byte color_type = png_get_color_type(_pPng, _pInfo);
+    const png_byte bit_depth = png_get_bit_depth(_pPng, _pInfo);
+
+    // the image is square and has a 2 pixel border
+    if (width != height || width <= 4 || color_type != PNG_COLOR_TYPE_RGBA || bit_depth != 8)
+    {
+        return false;
+    }
+
+    const int number_of_passes = png_set_interlace_handling(_pPng);
+    png_read_update_info(_pPng, _pInfo);
+
+    const unsigned int extent = width - 4;
+    const size_t rowBytes = png_get_rowbytes(_pPng, _pInfo);
+    // the decoded rows and columns: the inner ones and _Border of the border on every side
+    const unsigned int first = 2 - _Border;
+    const unsigned int outExtent = extent + 2 * _Border;
+    _OutExtent = extent;
+    _OutElevationMap.resize((size_t)outExtent * outExtent);
+    float* pOut = _OutElevationMap.data();
+
+    if (number_of_passes == 1)
+    {
+        /* stream the rows through a single buffer, the rest of the bottom border is never decoded */
+        _Rows.resize(rowBytes);
+        for (png_uint_32 y = 0; y < first + outExtent; y++)
+        {
+            png_read_row(_pPng, _Rows.data(), NULL);
+            if (y >= first)
+            {
+                DecodeTerrariumPixels(_Rows.data() + first * 4, outExtent, pOut, _bScalar);
+                pOut += outExtent;
+            }
+        }
+    }
+    else
+    {
+        /* interlaced images need all of the rows at once */
+        _Rows.resize(rowBytes * height);
+        _RowPointers.resize(height);
+        for (png_uint_32 y = 0; y < height; y++)
+        {
+            _RowPointers[y] = _Rows.data() + rowBytes * y;
+        }
+        png_read_image(_pPng, _RowPointers.data());
+        for (png_uint_32 y = first; y < first + outExtent; y++)
+        {
+            DecodeTerrariumPixels(_RowPointers[y] + first * 4, outExtent, pOut, _bScalar);
+            pOut += outExtent;
+        }
+    }
+    return true;
+}
+
+
+// LoadTerrariumElevationMap, _bScalar forces the scalar pixel decoding
+static bool DecodeTerrariumElevationMap(const char* _pData, size_t _Size, unsigned int& _OutExtent, std::vector<float>& _OutElevationMap,
+    unsigned int _Border, bool _bScalar)
+{
+    if (_Border > 2)
+        return false; // There are only 2 border pixels
+    /* test for it being a png */
+    // 8 is the maximum size that can be checked
+    if (_Size < 8 || png_sig_cmp((png_const_bytep)_pData, 0, 8))
         return false; // File is not recognized as a PNG file
+    PngMemoryReader reader = { (const png_byte*)_pData, _Size, 8 };
 
     /* initialize stuff */
-    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-
+    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (!png_ptr)
         return false; // png_create_read_struct failed
 
-    info_ptr = png_create_info_struct(png_ptr);
+    png_infop info_ptr = png_create_info_struct(png_ptr);
     if (!info_ptr)
+    {
+        png_destroy_read_struct(&png_ptr, NULL, NULL);
         return false; // png_create_info_struct failed
+    }
 
-    png_init_io(png_ptr, fp);
+    png_set_read_fn(png_ptr, &reader, ReadPngData);
     png_set_sig_bytes(png_ptr, 8);
 
-    png_read_info(png_ptr, info_ptr);
+    std::vector<png_byte> rows;
+    std::vector<png_bytep> row_pointers;
+    const bool bOk = ReadTerrariumPng(png_ptr, info_ptr, _Border, _bScalar, rows, row_pointers, _OutExtent, _OutElevationMap);
 
-    width = png_get_image_width(png_ptr, info_ptr);
-    height = png_get_image_height(png_ptr, info_ptr);
-    color_type = png_get_color_type(png_ptr, info_ptr);
-    bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    return bOk;
+}
 
-    number_of_passes = png_set_interlace_handling(png_ptr);
-    png_read_update_info(png_ptr, info_ptr);
 
-    /* read file */
-    row_pointers = (png_bytep*)malloc(sizeof(png_bytep) * height);
-    for (int y = 0; y < height; y++)
+bool LoadTerrariumElevationMap(const std::string& _Filename, unsigned int& _OutExtent, std::vector<float>& _OutElevationMap)
+{
+    /* map file */
+    MappedFile file;
+    if (!file.Open(_Filename))
+        return false; // File could not be opened for reading
+    return DecodeTerrariumElevationMap(file.GetData(), file.GetSize(), _OutExtent, _OutElevationMap, 0, false);
+}
+
+
+bool LoadTerrariumElevationMap(const char* _pData, size_t _Size, unsigned int& _OutExtent, std::vector<float>& _OutElevationMap,
+    unsigned int _Border)
+{
+    return DecodeTerrariumElevationMap(_pData, _Size, _OutExtent, _OutElevationMap, _Border, false);
+}
+
+
+bool detail::LoadTerrariumElevationMapScalar(const char* _pData, size_t _Size, unsigned int& _OutExtent, std::vector<float>& _OutElevationMap,
+    unsigned int _Border)
+{
+    return DecodeTerrariumElevationMap(_pData, _Size, _OutExtent, _OutElevationMap, _Border, true);
+}
+
+
+static void QuantizeSamplesScalar(const float* _pElevations, size_t _Count, float _Offset, float _InvScale, int16_t* _pOut)
+{
+    for (size_t i = 0; i < _Count; ++i)
+    {
+        float q = floorf((_pElevations[i] - _Offset) * _InvScale + 0.5f);
+        _pOut[i] = (int16_t)std::min(std::max(q, -32768.0f), 32767.0f);
+    }
+}
+
+
+#if MAPVIEWER_SSE2
+// Clamping before the floor gives the same as after it, and keeps the truncation in the int range.
+// SSE2 has no floor: truncate and step down where that rounded up (the negative fractions).
+static void QuantizeSamplesSSE2(const float* _pElevations, size_t _Count, float _Offset, float _InvScale, int16_t* _pOut)
+{
+    const __m128 offset = _mm_set1_ps(_Offset);
+    const __m128 invScale = _mm_set1_ps(_InvScale);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 minValue = _mm_set1_ps(-32768.0f);
+    const __m128 maxValue = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= _Count; i += 8)
     {
-        row_pointers[y] = (png_byte*)malloc(png_get_rowbytes(png_ptr, info_ptr));
+        __m128i q[2];
+        for (int h = 0; h < 2; ++h)
+        {
+            __m128 v = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(_pElevations + i + h * 4), offset), invScale), half);
+            v = _mm_min_ps(_mm_max_ps(v, minValue), maxValue);
+            __m128i t = _mm_cvttps_epi32(v);
+            // the compare mask is -1 where the truncation went up
+            q[h] = _mm_add_epi32(t, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(t), v)));
+        }
+        _mm_storeu_si128((__m128i*)(_pOut + i), _mm_packs_epi32(q[0], q[1]));
     }
+    QuantizeSamplesScalar(_pElevations + i, _Count - i, _Offset, _InvScale, _pOut + i);
+}
+#endif
 
-    png_read_image(png_ptr, row_pointers);
 
-    fclose(fp);
+void QuantizeElevationMap(const std::vector<float>& _ElevationMap, std::vector<int16_t>& _OutSamples, float& _OutScale, float& _OutOffset)
+{
+    _OutSamples.resize(_ElevationMap.size());
+    if (_ElevationMap.empty())
+    {
+        _OutScale = 1.0f;
+        _OutOffset = 0.0f;
+        return;
+    }
 
-    if (width != height)
+    const float* pElevations = _ElevationMap.data();
+    const size_t count = _ElevationMap.size();
+    float minElevation = pElevations[0];
+    float maxElevation = pElevations[0];
+    size_t i = 0;
+#if MAPVIEWER_SSE2
+    __m128 minV = _mm_set1_ps(minElevation);
+    __m128 maxV = minV;
+    for (; i + 4 <= count; i += 4)
     {
-        return false;
+        __m128 v = _mm_loadu_ps(pElevations + i);
+        minV = _mm_min_ps(minV, v);
+        maxV = _mm_max_ps(maxV, v);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, minV);
+    minElevation = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    _mm_storeu_ps(lanes, maxV);
+    maxElevation = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+    for (; i < count; ++i)
+    {
+        minElevation = std::min(minElevation, pElevations[i]);
+        maxElevation = std::max(maxElevation, pElevations[i]);
+    }
+
+    _OutScale = (maxElevation > minElevation) ? (maxElevation - minElevation) / 65535.0f : 1.0f;
+    // the middle of the range is sample 0
+    _OutOffset = minElevation + 32768.0f * _OutScale;
+
+    const float invScale = 1.0f / _OutScale;
+#if MAPVIEWER_SSE2
+    QuantizeSamplesSSE2(pElevations, count, _OutOffset, invScale, _OutSamples.data());
+#else
+    QuantizeSamplesScalar(pElevations, count, _OutOffset, invScale, _OutSamples.data());
+#endif
+}
+
+
+// Averages of 2x2 blocks of two rows, the sums are exact in 32 bits and in a float,
+// so the only rounding is in the final scale and offset
+static void DownsampleRowsScalar(const int16_t* _pRow0, const int16_t* _pRow1, size_t _NumOut, float _Scale, float _Offset, float* _pOut)
+{
+    for (size_t i = 0; i < _NumOut; ++i)
+    {
+        int sum = _pRow0[i * 2] + _pRow0[i * 2 + 1] + _pRow1[i * 2] + _pRow1[i * 2 + 1];
+        _pOut[i] = (float)sum * _Scale + _Offset;
     }
-    _OutExtent = width - 4;
+}
+
+
+#if MAPVIEWER_SSE2
+// 4 outputs at a time: madd with ones sums the horizontal pairs into 32 bits
+static void DownsampleRowsSSE2(const int16_t* _pRow0, const int16_t* _pRow1, size_t _NumOut, float _Scale, float _Offset, float* _pOut)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128 scale = _mm_set1_ps(_Scale);
+    const __m128 offset = _mm_set1_ps(_Offset);
+    size_t i = 0;
+    for (; i + 4 <= _NumOut; i += 4)
+    {
+        __m128i row0 = _mm_loadu_si128((const __m128i*)(_pRow0 + i * 2));
+        __m128i row1 = _mm_loadu_si128((const __m128i*)(_pRow1 + i * 2));
+        __m128i sum = _mm_add_epi32(_mm_madd_epi16(row0, ones), _mm_madd_epi16(row1, ones));
+        _mm_storeu_ps(_pOut + i, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(sum), scale), offset));
+    }
+    DownsampleRowsScalar(_pRow0 + i * 2, _pRow1 + i * 2, _NumOut - i, _Scale, _Offset, _pOut + i);
+}
+#endif
+
 
-    png_byte colorType = png_get_color_type(png_ptr, info_ptr);
-    if (colorType == PNG_COLOR_TYPE_RGBA)
+// DownsampleElevationMaps, _bScalar forces the scalar code
+static void DownsampleQuantizedMaps(const QuantizedElevationMapView _Children[4], unsigned int _Extent, std::vector<float>& _OutElevationMap,
+    unsigned int _Border, bool _bScalar)
+{
+    const int extent = (int)_Extent;
+    const int half = extent / 2;
+    const int border = (int)_Border;
+    // the parent samples [-reach, _Extent + reach) are averaged from the children
+    const int reach = border / 2;
+    const size_t stride = _Extent + 2 * _Border;
+    _OutElevationMap.resize(stride * stride);
+    for (int y = -reach; y < extent + reach; ++y)
     {
-        for (int y = 2; y < height - 2; y++)
+        const int cy = (y >= half) ? 1 : 0;
+        const int childRow = y * 2 - cy * extent + border;
+        float* pOut = _OutElevationMap.data() + (size_t)(y + border) * stride + (border - reach);
+        for (int cx = 0; cx < 2; ++cx)
         {
-            png_byte* row = row_pointers[y];
-            for (int x = 2; x < width - 2; x++)
+            const QuantizedElevationMapView& child = _Children[cy * 2 + cx];
+            // the average of 4 samples
+            const float scale = child.Scale * 0.25f;
+            const int firstX = cx ? half : -reach;
+            const int16_t* pRow0 = child.pSamples + (size_t)childRow * stride + (firstX * 2 - cx * extent + border);
+            const size_t numOut = (size_t)(half + reach);
+#if MAPVIEWER_SSE2
+            if (!_bScalar)
             {
-                png_byte* ptr = &(row[x * 4]);
-                // R = ptr[0], G = ptr[1], B = ptr[3], A = ptr[4] (unused)
-                // Elevation value decoding: (red * 256 + green + blue / 256) - 32768
-                int elevValue = (ptr[0] * 256 + ptr[1] + ptr[3] / 256) - 32768;
-                _OutElevationMap.push_back((float)elevValue);
+                DownsampleRowsSSE2(pRow0, pRow0 + stride, numOut, scale, child.Offset, pOut + cx * numOut);
+                continue;
             }
+#endif
+            DownsampleRowsScalar(pRow0, pRow0 + stride, numOut, scale, child.Offset, pOut + cx * numOut);
         }
     }
-    else
+
+    // the outer half of the border continues the slope at the edge of the inner half, so the gradients
+    // (and the normals) of the edge samples stay about the same
+    const size_t first = (size_t)(border - reach);
+    const size_t last = stride - 1 - first;
+    for (size_t b = first; b-- > 0;)
     {
-        return false; // incorrect color format
+        for (size_t y = first; y <= last; ++y)
+        {
+            float* pRow = _OutElevationMap.data() + y * stride;
+            pRow[b] = 2.0f * pRow[b + 1] - pRow[b + 2];
+            pRow[stride - 1 - b] = 2.0f * pRow[stride - 2 - b] - pRow[stride - 3 - b];
+        }
+    }
+    for (size_t b = first; b-- > 0;)
+    {
+        for (size_t x = 0; x < stride; ++x)
+        {
+            float* pColumn = _OutElevationMap.data() + x;
+            pColumn[b * stride] = 2.0f * pColumn[(b + 1) * stride] - pColumn[(b + 2) * stride];
+            pColumn[(stride - 1 - b) * stride] = 2.0f * pColumn[(stride - 2 - b) * stride] - pColumn[(stride - 3 - b) * stride];
+        }
     }
-
-    free(row_pointers);
-    return true;
 }
 
-float GetElevation(const std::vector<float>& _ElevationMap, float _normalizedX, float _normalizedY)
+
+void DownsampleElevationMaps(const QuantizedElevationMapView _Children[4], unsigned int _Extent, std::vector<float>& _OutElevationMap,
+    unsigned int _Border)
 {
-    assert(_ElevationMap.size() == 262144);
-    float fDerivative = 511.f / 8192.f;
-    return _ElevationMap[(uint32_t)(_normalizedY * fDerivative) * 512 + (uint32_t)(_normalizedX * fDerivative)];
+    DownsampleQuantizedMaps(_Children, _Extent, _OutElevationMap, _Border, false);
 }
 
+
+void detail::DownsampleElevationMapsScalar(const QuantizedElevationMapView _Children[4], unsigned int _Extent, std::vector<float>& _OutElevationMap,
+    unsigned int _Border)
+{
+    DownsampleQuantizedMaps(_Children, _Extent, _OutElevationMap, _Border, true);
+}
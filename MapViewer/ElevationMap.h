@@ -1,6 +1,32 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <cstddef>
 
+// Decodes the elevations (in meters) inside the 2 pixel border of a Terrarium PNG
 bool LoadTerrariumElevationMap(const std::string& _Filename, unsigned int& _OutExtent, std::vector<float>& _OutElevationMap);
-float GetElevation(const std::vector<float>& _ElevationMap, float _normalizedX, float _normalizedY);
+// Same for a PNG file already in memory. _Border (at most 2) pixels of the border are kept around the map:
+// _OutExtent is still the extent of the inner map, _OutElevationMap is (_OutExtent + 2 * _Border) pixels wide.
+bool LoadTerrariumElevationMap(const char* _pData, size_t _Size, unsigned int& _OutExtent, std::vector<float>& _OutElevationMap,
+    unsigned int _Border = 0);
+
+// 16 bit copy of the elevations, elevation = _OutScale * sample + _OutOffset. The step is fitted to the range
+// of the map, so the error is at most half of (max - min) / 65535.
+void QuantizeElevationMap(const std::vector<float>& _ElevationMap, std::vector<int16_t>& _OutSamples, float& _OutScale, float& _OutOffset);
+
+// Read-only quantized elevation map, elevation = Scale * sample + Offset
+struct QuantizedElevationMapView
+{
+    const int16_t* pSamples;
+    float Scale;
+    float Offset;
+};
+
+// Elevations of a parent tile from its 4 children (_Extent x _Extent each, _Extent is even) by averaging 2x2 samples,
+// every child fills a quarter of the parent. The children go in the order (x, y) = (0, 0), (1, 0), (0, 1), (1, 1).
+// With a _Border (at most 2) the children and the parent have that many pixels of border around them (see
+// LoadTerrariumElevationMap). The border of the children reaches over the inner half of the border of the parent,
+// the outer half is extrapolated from it.
+void DownsampleElevationMaps(const QuantizedElevationMapView _Children[4], unsigned int _Extent, std::vector<float>& _OutElevationMap,
+    unsigned int _Border = 0);
@@ -0,0 +1,212 @@
+#include "ElevationMinMax.h"
+#include "SimdConfig.h"
+#include <algorithm>
+
+// level 0 cells are 4x4 samples
+static const unsigned int LEAF_SHIFT = 2;
+
+
+struct MinOp
+{
+    static int16_t Scalar(int16_t _A, int16_t _B) { return std::min(_A, _B); }
+#if MAPVIEWER_SSE2
+    static __m128i Vector(__m128i _A, __m128i _B) { return _mm_min_epi16(_A, _B); }
+#endif
+};
+
+
+struct MaxOp
+{
+    static int16_t Scalar(int16_t _A, int16_t _B) { return std::max(_A, _B); }
+#if MAPVIEWER_SSE2
+    static __m128i Vector(__m128i _A, __m128i _B) { return _mm_max_epi16(_A, _B); }
+#endif
+};
+
+
+// _pOut[i] = Op(_pA[i], _pB[i]), _pOut may be _pA
+template<typename Op>
+static void CombineRows(const int16_t* _pA, const int16_t* _pB, size_t _Count, int16_t* _pOut, bool _bScalar)
+{
+    size_t i = 0;
+#if MAPVIEWER_SSE2
+    if (!_bScalar)
+    {
+        for (; i + 8 <= _Count; i += 8)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(_pA + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(_pB + i));
+            _mm_storeu_si128((__m128i*)(_pOut + i), Op::Vector(a, b));
+        }
+    }
+#endif
+    for (; i < _Count; ++i)
+    {
+        _pOut[i] = Op::Scalar(_pA[i], _pB[i]);
+    }
+}
+
+
+// _pOut[i] = Op(_pIn[2 * i], _pIn[2 * i + 1]), the last element of an odd row is taken as is
+template<typename Op>
+static void ReducePairs(const int16_t* _pIn, size_t _Count, int16_t* _pOut, bool _bScalar)
+{
+    size_t i = 0;
+#if MAPVIEWER_SSE2
+    if (!_bScalar)
+    {
+        // 16 inputs to 8 outputs: reduce the neighbours into the low halves of the 32 bit lanes,
+        // sign extend them and pack the lanes back to 16 bits (nothing saturates)
+        for (; i + 16 <= _Count; i += 16)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(_pIn + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(_pIn + i + 8));
+            a = Op::Vector(a, _mm_srli_epi32(a, 16));
+            b = Op::Vector(b, _mm_srli_epi32(b, 16));
+            a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+            b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+            _mm_storeu_si128((__m128i*)(_pOut + i / 2), _mm_packs_epi32(a, b));
+        }
+    }
+#endif
+    for (; i + 2 <= _Count; i += 2)
+    {
+        _pOut[i / 2] = Op::Scalar(_pIn[i], _pIn[i + 1]);
+    }
+    if (i < _Count)
+    {
+        _pOut[i / 2] = _pIn[i];
+    }
+}
+
+
+// Reduces _NumRows rows of _RowLength values into one row, halved _Halvings times (at least once)
+template<typename Op>
+static void ReduceBlock(const int16_t* _pRows, size_t _RowLength, unsigned int _NumRows, unsigned int _Halvings,
+    std::vector<int16_t>& _Scratch, int16_t* _pOut, bool _bScalar)
+{
+    _Scratch.assign(_pRows, _pRows + _RowLength);
+    for (unsigned int r = 1; r < _NumRows; ++r)
+    {
+        CombineRows<Op>(_Scratch.data(), _pRows + r * _RowLength, _RowLength, _Scratch.data(), _bScalar);
+    }
+    // in place is fine, a pass never writes ahead of what it has read
+    size_t count = _RowLength;
+    for (unsigned int h = 0; h + 1 < _Halvings; ++h)
+    {
+        ReducePairs<Op>(_Scratch.data(), count, _Scratch.data(), _bScalar);
+        count = (count + 1) / 2;
+    }
+    ReducePairs<Op>(_Scratch.data(), count, _pOut, _bScalar);
+}
+
+
+void ElevationMinMaxTree::Build(const int16_t* _pSamples, unsigned int _Extent)
+{
+    Build(_pSamples, _Extent, false);
+}
+
+
+void detail::BuildMinMaxTreeScalar(ElevationMinMaxTree& _Tree, const int16_t* _pSamples, unsigned int _Extent)
+{
+    _Tree.Build(_pSamples, _Extent, true);
+}
+
+
+void ElevationMinMaxTree::Build(const int16_t* _pSamples, unsigned int _Extent, bool _bScalar)
+{
+    m_Extent = _Extent;
+    m_Levels.clear();
+    if (_Extent == 0)
+    {
+        return;
+    }
+
+    std::vector<int16_t> scratch;
+
+    // level 0 straight from the samples
+    const unsigned int blockSize = 1 << LEAF_SHIFT;
+    m_Levels.emplace_back();
+    Level* pLevel = &m_Levels.back();
+    pLevel->Size = (_Extent + blockSize - 1) >> LEAF_SHIFT;
+    pLevel->Min.resize((size_t)pLevel->Size * pLevel->Size);
+    pLevel->Max.resize((size_t)pLevel->Size * pLevel->Size);
+    for (unsigned int y = 0; y < pLevel->Size; ++y)
+    {
+        const int16_t* pRows = _pSamples + (size_t)y * blockSize * _Extent;
+        const unsigned int numRows = std::min(blockSize, _Extent - y * blockSize);
+        ReduceBlock<MinOp>(pRows, _Extent, numRows, LEAF_SHIFT, scratch, &pLevel->Min[(size_t)y * pLevel->Size], _bScalar);
+        ReduceBlock<MaxOp>(pRows, _Extent, numRows, LEAF_SHIFT, scratch, &pLevel->Max[(size_t)y * pLevel->Size], _bScalar);
+    }
+
+    // every next level merges 2x2 cells, down to a single one
+    while (m_Levels.back().Size > 1)
+    {
+        Level next;
+        const Level& prev = m_Levels.back();
+        next.Size = (prev.Size + 1) / 2;
+        next.Min.resize((size_t)next.Size * next.Size);
+        next.Max.resize((size_t)next.Size * next.Size);
+        for (unsigned int y = 0; y < next.Size; ++y)
+        {
+            const size_t rowOffset = (size_t)y * 2 * prev.Size;
+            const unsigned int numRows = std::min(2u, prev.Size - y * 2);
+            ReduceBlock<MinOp>(&prev.Min[rowOffset], prev.Size, numRows, 1, scratch, &next.Min[(size_t)y * next.Size], _bScalar);
+            ReduceBlock<MaxOp>(&prev.Max[rowOffset], prev.Size, numRows, 1, scratch, &next.Max[(size_t)y * next.Size], _bScalar);
+        }
+        m_Levels.push_back(std::move(next));
+    }
+}
+
+
+size_t ElevationMinMaxTree::GetBytes() const
+{
+    size_t bytes = 0;
+    for (const auto& l : m_Levels)
+    {
+        bytes += (l.Min.size() + l.Max.size()) * sizeof(int16_t);
+    }
+    return bytes;
+}
+
+
+void ElevationMinMaxTree::GetRange(int _X0, int _Y0, int _X1, int _Y1, int16_t& _OutMin, int16_t& _OutMax) const
+{
+    if (m_Levels.empty())
+    {
+        _OutMin = 0;
+        _OutMax = 0;
+        return;
+    }
+
+    const int lastSample = (int)m_Extent - 1;
+    int x0 = std::min(std::max(std::min(_X0, _X1), 0), lastSample);
+    int x1 = std::min(std::max(std::max(_X0, _X1), 0), lastSample);
+    int y0 = std::min(std::max(std::min(_Y0, _Y1), 0), lastSample);
+    int y1 = std::min(std::max(std::max(_Y0, _Y1), 0), lastSample);
+
+    // go up until the region spans at most 4 cells in each direction
+    x0 >>= LEAF_SHIFT; x1 >>= LEAF_SHIFT;
+    y0 >>= LEAF_SHIFT; y1 >>= LEAF_SHIFT;
+    size_t levelId = 0;
+    while (levelId + 1 < m_Levels.size() && (x1 - x0 > 3 || y1 - y0 > 3))
+    {
+        x0 >>= 1; x1 >>= 1;
+        y0 >>= 1; y1 >>= 1;
+        ++levelId;
+    }
+
+    const Level& level = m_Levels[levelId];
+    int16_t minValue = level.Min[(size_t)y0 * level.Size + x0];
+    int16_t maxValue = level.Max[(size_t)y0 * level.Size + x0];
+    for (int y = y0; y <= y1; ++y)
+    {
+        for (int x = x0; x <= x1; ++x)
+        {
+            minValue = std::min(minValue, level.Min[(size_t)y * level.Size + x]);
+            maxValue = std::max(maxValue, level.Max[(size_t)y * level.Size + x]);
+        }
+    }
+    _OutMin = minValue;
+    _OutMax = maxValue;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ElevationMinMaxTree;
+
+namespace detail
+{
+    // ElevationMinMaxTree::Build with the scalar reductions (see ReferenceKernels.h)
+    void BuildMinMaxTreeScalar(ElevationMinMaxTree& _Tree, const int16_t* _pSamples, unsigned int _Extent);
+}
+
+// Min/max pyramid over a square int16 elevation map: level 0 has the ranges of 4x4 sample blocks,
+// every next level merges 2x2 cells of the previous one, up to a single cell over the whole map.
+// The pyramid is about 1/6 of the memory of the samples.
+class ElevationMinMaxTree
+{
+public:
+    // Builds the pyramid with SSE2 reductions when the CPU has them
+    void Build(const int16_t* _pSamples, unsigned int _Extent);
+
+    bool IsEmpty() const { return m_Levels.empty(); }
+    size_t GetBytes() const;
+
+    // Range of the samples [_X0, _X1] x [_Y0, _Y1] (inclusive, clamped to the map) in O(log n): it's read from
+    // at most 4x4 cells of the level where the region fits, so it embraces the exact range and is exact for
+    // the regions aligned to the cells. An empty pyramid returns 0, 0.
+    void GetRange(int _X0, int _Y0, int _X1, int _Y1, int16_t& _OutMin, int16_t& _OutMax) const;
+
+private:
+    friend void detail::BuildMinMaxTreeScalar(ElevationMinMaxTree& _Tree, const int16_t* _pSamples, unsigned int _Extent);
+
+    // _bScalar forces the scalar code
+    void Build(const int16_t* _pSamples, unsigned int _Extent, bool _bScalar);
+
+private:
+    struct Level
+    {
+        unsigned int Size = 0;
+        // Size x Size cells, row by row
+        std::vector<int16_t> Min;
+        std::vector<int16_t> Max;
+    };
+
+private:
+    unsigned int m_Extent = 0;
+    std::vector<Level> m_Levels;
+};
@@ -0,0 +1,143 @@
+#include "ElevationRawFile.h"
+#include "SceneCache.h"
+#include "MappedFile.h"
+#include <stdio.h>
+#include <string.h>
+
+// File layout:
+//   RawElevationHeader
+//   zero padding up to g_SamplesOffset
+//   int16 samples with the border, GetSampleExtent() x GetSampleExtent(), row by row
+//   zero padding up to the next page
+//   normals, GetNormalExtent() x GetNormalExtent() x 2 bytes, row by row
+
+static const char g_RawMagic[8] = { 'M', 'V', 'R', 'A', 'W', 'D', 'E', 'M' };
+static const uint32_t g_ByteOrderMark = 0x01020304;
+// the samples and the normals start at pages of the mapping
+static const uint64_t g_PageSize = 4096;
+static const uint64_t g_SamplesOffset = g_PageSize;
+
+struct RawElevationHeader
+{
+    char Magic[8];
+    uint32_t Version;
+    uint32_t ByteOrder;
+    uint64_t Key;
+    uint64_t FileSize;
+    uint32_t Extent;
+    float Scale;
+    float Offset;
+    uint32_t Reserved;
+    uint64_t NormalsOffset;
+};
+
+
+static uint64_t GetNormalsOffset(uint32_t _SampleExtent)
+{
+    const uint64_t samplesEnd = g_SamplesOffset + (uint64_t)_SampleExtent * _SampleExtent * sizeof(int16_t);
+    return (samplesEnd + g_PageSize - 1) & ~(g_PageSize - 1);
+}
+
+
+uint64_t ComputeElevationRawKey(const char* _pSourceData, size_t _SourceSize, int _Zoom)
+{
+    CacheKeyHash hash;
+    hash.AddValue(ELEVATION_RAW_CONTENT_VERSION);
+    hash.AddValue(ELEVATION_TILE_BORDER);
+    hash.AddValue(VECTOR_TILE_EXTENT);
+    hash.AddValue(GetElevationScale(_Zoom));
+    hash.AddValue((uint64_t)_SourceSize);
+    hash.Add(_pSourceData, _SourceSize);
+    return hash.Get();
+}
+
+
+bool SaveElevationRawFile(const std::string& _Filename, uint64_t _Key, const ElevationTile& _Tile)
+{
+    const uint64_t samplesSize = (uint64_t)_Tile.Samples.size() * sizeof(int16_t);
+    const size_t sampleExtent = _Tile.GetSampleExtent();
+    const size_t normalExtent = _Tile.GetNormalExtent();
+    if (_Tile.Extent < 2 || _Tile.Samples.size() != sampleExtent * sampleExtent ||
+        _Tile.Normals.size() != normalExtent * normalExtent * 2)
+    {
+        return false;
+    }
+
+    RawElevationHeader header = {};
+    memcpy(header.Magic, g_RawMagic, sizeof(g_RawMagic));
+    header.Version = ELEVATION_RAW_FILE_VERSION;
+    header.ByteOrder = g_ByteOrderMark;
+    header.Key = _Key;
+    header.NormalsOffset = GetNormalsOffset(_Tile.GetSampleExtent());
+    header.FileSize = header.NormalsOffset + _Tile.Normals.size();
+    header.Extent = _Tile.Extent;
+    header.Scale = _Tile.Scale;
+    header.Offset = _Tile.Offset;
+
+    // written next to the target and renamed, so a reader never sees a partial file
+    std::string tmpFilename = _Filename + ".tmp";
+    FILE* fp = fopen(tmpFilename.c_str(), "wb");
+    if (!fp)
+    {
+        return false;
+    }
+
+    static const char zeros[g_PageSize] = {};
+    uint64_t written = fwrite(&header, 1, sizeof(header), fp);
+    written += fwrite(zeros, 1, (size_t)(g_SamplesOffset - written), fp);
+    written += fwrite(_Tile.Samples.data(), 1, (size_t)samplesSize, fp);
+    written += fwrite(zeros, 1, (size_t)(header.NormalsOffset - written), fp);
+    written += fwrite(_Tile.Normals.data(), 1, _Tile.Normals.size(), fp);
+
+    bool bOk = (written == header.FileSize);
+    bOk = (fclose(fp) == 0) && bOk;
+    if (bOk)
+    {
+        remove(_Filename.c_str());
+        bOk = (rename(tmpFilename.c_str(), _Filename.c_str()) == 0);
+    }
+    if (!bOk)
+    {
+        remove(tmpFilename.c_str());
+    }
+    return bOk;
+}
+
+
+bool LoadElevationRawFile(const std::string& _Filename, uint64_t _Key, ElevationTile& _OutTile)
+{
+    MappedFilePtr pFile = MappedFile::Load(_Filename);
+    if (!pFile || pFile->GetSize() < g_SamplesOffset)
+    {
+        return false;
+    }
+
+    const uint64_t fileSize = pFile->GetSize();
+    const RawElevationHeader* pHeader = (const RawElevationHeader*)pFile->GetData();
+    if (memcmp(pHeader->Magic, g_RawMagic, sizeof(g_RawMagic)) != 0 ||
+        pHeader->Version != ELEVATION_RAW_FILE_VERSION ||
+        pHeader->ByteOrder != g_ByteOrderMark ||
+        pHeader->Key != _Key ||
+        pHeader->FileSize != fileSize ||
+        pHeader->Extent < 2 || pHeader->Extent > 65536)
+    {
+        return false;
+    }
+    const uint64_t sampleExtent = pHeader->Extent + 2 * ELEVATION_TILE_BORDER;
+    const uint64_t normalExtent = pHeader->Extent + 2 * (ELEVATION_TILE_BORDER - 1);
+    if (pHeader->NormalsOffset != GetNormalsOffset((uint32_t)sampleExtent) ||
+        fileSize != pHeader->NormalsOffset + normalExtent * normalExtent * 2)
+    {
+        return false;
+    }
+
+    _OutTile.Extent = pHeader->Extent;
+    _OutTile.Scale = pHeader->Scale;
+    _OutTile.Offset = pHeader->Offset;
+    _OutTile.Samples = Span<const int16_t>((const int16_t*)(pFile->GetData() + g_SamplesOffset), (size_t)(sampleExtent * sampleExtent));
+    _OutTile.Normals = Span<const int8_t>((const int8_t*)(pFile->GetData() + pHeader->NormalsOffset), (size_t)(normalExtent * normalExtent * 2));
+    _OutTile.DecodedSamples.clear();
+    _OutTile.DecodedNormals.clear();
+    _OutTile.pRawFile = pFile;
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "ElevationCache.h"
+
+// Raw file of a decoded DEM tile: a header, the int16 samples and the normals (with their borders), each at
+// a page aligned offset, so loading one is a memory mapping and a few header checks.
+// Bump the version whenever the layout changes.
+const uint32_t ELEVATION_RAW_FILE_VERSION = 3;
+// Bump it whenever the decoded contents change (the decoding, the quantization or the normals), it's hashed
+// into the keys, so the files written by the older code are decoded again
+const uint32_t ELEVATION_RAW_CONTENT_VERSION = 1;
+
+// Key of the raw file of a DEM of _Zoom: the hash of the whole content of its PNG, of the content version and of
+// the parameters the samples and the normals depend on (the border, the tile extent and the elevation scale)
+uint64_t ComputeElevationRawKey(const char* _pSourceData, size_t _SourceSize, int _Zoom);
+
+bool SaveElevationRawFile(const std::string& _Filename, uint64_t _Key, const ElevationTile& _Tile);
+
+// Fails (leaving _OutTile untouched) if the file is missing, broken, of another version or was written for another key.
+// Otherwise the samples and normals of _OutTile point into the mapped file, which the tile keeps open. The min/max tree isn't stored.
+bool LoadElevationRawFile(const std::string& _Filename, uint64_t _Key, ElevationTile& _OutTile);
@@ -0,0 +1,320 @@
+#include "ElevationSampler.h"
+#include "ReferenceKernels.h"
+#include "SimdConfig.h"
+#include <algorithm>
+#include <math.h>
+#include <assert.h>
+
+// AVX2 is compiled in for the single function using it and picked at runtime,
+// the rest of the code stays runnable on any x64 CPU
+#if MAPVIEWER_SSE2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ELEVATION_SAMPLER_AVX2_TARGET
+#else
+#define ELEVATION_SAMPLER_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+
+#if MAPVIEWER_SSE2
+static bool HasAVX2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    // the OS has to save the AVX registers too
+    const bool bOsAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+    __cpuidex(info, 7, 0);
+    return bOsAvx && (info[1] & (1 << 5));
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static const bool g_bHasAVX2 = HasAVX2();
+#endif
+
+
+float GetElevationScale(int _ZoomLevel)
+{
+    switch (_ZoomLevel)
+    {
+    case 13: return 2.0f;
+    case 14: return 4.0f;
+    }
+    return 1.0f;
+}
+
+
+ElevationWindow GetElevationWindow(unsigned int _Extent, unsigned int _Border, int _LevelsUp, int _X, int _Y)
+{
+    // the descendant covers 1 / 2^_LevelsUp of the tile in each direction
+    const int numParts = 1 << std::max(_LevelsUp, 0);
+    const float partPixels = (float)_Extent / (float)numParts;
+    // tile position 0 is the left edge of pixel 0, half a pixel before its center
+    const float origin = (float)_Border - 0.5f;
+    ElevationWindow window;
+    window.Scale = partPixels / VECTOR_TILE_EXTENT;
+    window.OffsetX = origin + (float)(_X & (numParts - 1)) * partPixels;
+    window.OffsetY = origin + (float)(_Y & (numParts - 1)) * partPixels;
+    return window;
+}
+
+
+void GetTilePosition(int _ZoomLevel, double _Lon, double _Lat, int& _OutTileX, int& _OutTileY, float& _OutX, float& _OutY)
+{
+    const double pi = 3.14159265358979323846;
+    const double maxLat = 85.0511287798066;
+    const double numTiles = (double)(1 << _ZoomLevel);
+    const double lat = std::min(std::max(_Lat, -maxLat), maxLat) * pi / 180.0;
+    const double x = (_Lon + 180.0) / 360.0 * numTiles;
+    const double y = (1.0 - log(tan(lat) + 1.0 / cos(lat)) / pi) * 0.5 * numTiles;
+    // the points on the east and the south edges of the map belong to the last tile
+    _OutTileX = std::min(std::max((int)floor(x), 0), (1 << _ZoomLevel) - 1);
+    _OutTileY = std::min(std::max((int)floor(y), 0), (1 << _ZoomLevel) - 1);
+    _OutX = (float)((x - _OutTileX) * VECTOR_TILE_EXTENT);
+    _OutY = (float)((y - _OutTileY) * VECTOR_TILE_EXTENT);
+}
+
+
+// the quantized samples are decoded while sampling, the float ones are used as they are
+template<typename T> struct SampleTraits;
+template<> struct SampleTraits<float> { static const bool bQuantized = false; };
+template<> struct SampleTraits<int16_t> { static const bool bQuantized = true; };
+
+
+template<typename T>
+BasicElevationSampler<T>::BasicElevationSampler(const T* _pElevations, unsigned int _Extent, float _TileExtent)
+    : BasicElevationSampler(_pElevations, _Extent, (float)(_Extent - 1) / _TileExtent, 0.0f, 0.0f)
+{
+}
+
+
+template<typename T>
+BasicElevationSampler<T>::BasicElevationSampler(const T* _pElevations, unsigned int _Extent, float _Scale, float _OffsetX, float _OffsetY)
+    : m_pElevations(_pElevations)
+    , m_Extent(_Extent)
+    , m_Scale(_Scale)
+    , m_OffsetX(_OffsetX)
+    , m_OffsetY(_OffsetY)
+    , m_MaxCoord((float)(_Extent - 1))
+    , m_MaxCell((int)_Extent - 2)
+{
+    assert(_Extent >= 2);
+}
+
+
+template<typename T>
+BasicElevationSampler<T>::BasicElevationSampler(const std::vector<T>& _ElevationMap, unsigned int _Extent, float _TileExtent)
+    : BasicElevationSampler(_ElevationMap.data(), _Extent, _TileExtent)
+{
+    assert(_ElevationMap.size() == (size_t)_Extent * _Extent);
+}
+
+
+template<typename T>
+void BasicElevationSampler<T>::SetQuantization(float _Scale, float _Offset)
+{
+    m_QuantScale = _Scale;
+    m_QuantOffset = _Offset;
+}
+
+
+template<typename T>
+inline float BasicElevationSampler<T>::Decode(T _Sample) const
+{
+    if (SampleTraits<T>::bQuantized)
+    {
+        return (float)_Sample * m_QuantScale + m_QuantOffset;
+    }
+    return (float)_Sample;
+}
+
+
+template<typename T>
+float BasicElevationSampler<T>::Sample(float _X, float _Y) const
+{
+    // std::max(0, NaN) is 0, the same as _mm_max_ps(NaN, 0) of the kernels
+    float fx = std::min(std::max(0.0f, _X * m_Scale + m_OffsetX), m_MaxCoord);
+    float fy = std::min(std::max(0.0f, _Y * m_Scale + m_OffsetY), m_MaxCoord);
+    int ix = std::min((int)fx, m_MaxCell);
+    int iy = std::min((int)fy, m_MaxCell);
+    float tx = fx - (float)ix;
+    float ty = fy - (float)iy;
+
+    const T* p = m_pElevations + (size_t)iy * m_Extent + ix;
+    float c00 = Decode(p[0]);
+    float c10 = Decode(p[1]);
+    float c01 = Decode(p[m_Extent]);
+    float c11 = Decode(p[m_Extent + 1]);
+    float z0 = c00 + (c10 - c00) * tx;
+    float z1 = c01 + (c11 - c01) * tx;
+    return z0 + (z1 - z0) * ty;
+}
+
+
+template<typename T>
+void BasicElevationSampler<T>::Sample(Span<const float> _X, Span<const float> _Y, Span<float> _OutZ) const
+{
+    assert(_X.size() == _Y.size() && _X.size() == _OutZ.size());
+#if MAPVIEWER_SSE2
+    if (g_bHasAVX2)
+    {
+        SampleAVX2(_X.data(), _Y.data(), _X.size(), _OutZ.data());
+    }
+    else
+    {
+        SampleSSE2(_X.data(), _Y.data(), _X.size(), _OutZ.data());
+    }
+#else
+    detail::SampleElevationsScalar(*this, _X, _Y, _OutZ);
+#endif
+}
+
+
+template<typename T>
+void detail::SampleElevationsScalar(const BasicElevationSampler<T>& _Sampler, Span<const float> _X, Span<const float> _Y, Span<float> _OutZ)
+{
+    assert(_X.size() == _Y.size() && _X.size() == _OutZ.size());
+    for (size_t i = 0; i < _X.size(); ++i)
+    {
+        _OutZ[i] = _Sampler.Sample(_X[i], _Y[i]);
+    }
+}
+
+
+#if MAPVIEWER_SSE2
+template<typename T>
+void BasicElevationSampler<T>::SampleSSE2(const float* _pX, const float* _pY, size_t _Count, float* _pOutZ) const
+{
+    const __m128 scale = _mm_set1_ps(m_Scale);
+    const __m128 offsetX = _mm_set1_ps(m_OffsetX);
+    const __m128 offsetY = _mm_set1_ps(m_OffsetY);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 maxCoord = _mm_set1_ps(m_MaxCoord);
+    const __m128i maxCell = _mm_set1_epi32(m_MaxCell);
+    const __m128 quantScale = _mm_set1_ps(m_QuantScale);
+    const __m128 quantOffset = _mm_set1_ps(m_QuantOffset);
+    const size_t stride = m_Extent;
+
+    size_t i = 0;
+    for (; i + 4 <= _Count; i += 4)
+    {
+        __m128 fx = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(_pX + i), scale), offsetX), zero), maxCoord);
+        __m128 fy = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(_pY + i), scale), offsetY), zero), maxCoord);
+        // the positions aren't negative, truncation is floor. The last row and column belong to the previous cell.
+        __m128i ix = _mm_cvttps_epi32(fx);
+        __m128i iy = _mm_cvttps_epi32(fy);
+        ix = _mm_add_epi32(ix, _mm_cmpgt_epi32(ix, maxCell));
+        iy = _mm_add_epi32(iy, _mm_cmpgt_epi32(iy, maxCell));
+        __m128 tx = _mm_sub_ps(fx, _mm_cvtepi32_ps(ix));
+        __m128 ty = _mm_sub_ps(fy, _mm_cvtepi32_ps(iy));
+
+        // no gathers in SSE2, the corners are loaded one by one
+        alignas(16) int cellX[4];
+        alignas(16) int cellY[4];
+        _mm_store_si128((__m128i*)cellX, ix);
+        _mm_store_si128((__m128i*)cellY, iy);
+        alignas(16) float corners[4][4];
+        for (int l = 0; l < 4; ++l)
+        {
+            const T* p = m_pElevations + (size_t)cellY[l] * stride + cellX[l];
+            corners[0][l] = (float)p[0];
+            corners[1][l] = (float)p[1];
+            corners[2][l] = (float)p[stride];
+            corners[3][l] = (float)p[stride + 1];
+        }
+        __m128 c00 = _mm_load_ps(corners[0]);
+        __m128 c10 = _mm_load_ps(corners[1]);
+        __m128 c01 = _mm_load_ps(corners[2]);
+        __m128 c11 = _mm_load_ps(corners[3]);
+        if (SampleTraits<T>::bQuantized)
+        {
+            c00 = _mm_add_ps(_mm_mul_ps(c00, quantScale), quantOffset);
+            c10 = _mm_add_ps(_mm_mul_ps(c10, quantScale), quantOffset);
+            c01 = _mm_add_ps(_mm_mul_ps(c01, quantScale), quantOffset);
+            c11 = _mm_add_ps(_mm_mul_ps(c11, quantScale), quantOffset);
+        }
+
+        __m128 z0 = _mm_add_ps(c00, _mm_mul_ps(_mm_sub_ps(c10, c00), tx));
+        __m128 z1 = _mm_add_ps(c01, _mm_mul_ps(_mm_sub_ps(c11, c01), tx));
+        _mm_storeu_ps(_pOutZ + i, _mm_add_ps(z0, _mm_mul_ps(_mm_sub_ps(z1, z0), ty)));
+    }
+    for (; i < _Count; ++i)
+    {
+        _pOutZ[i] = Sample(_pX[i], _pY[i]);
+    }
+}
+
+
+// Horizontal neighbour corners of 8 cells at once
+ELEVATION_SAMPLER_AVX2_TARGET
+static inline void GatherCorners(const float* _pElevations, __m256i _Ids, __m256& _OutLeft, __m256& _OutRight)
+{
+    _OutLeft = _mm256_i32gather_ps(_pElevations, _Ids, 4);
+    _OutRight = _mm256_i32gather_ps(_pElevations, _mm256_add_epi32(_Ids, _mm256_set1_epi32(1)), 4);
+}
+
+
+ELEVATION_SAMPLER_AVX2_TARGET
+static inline void GatherCorners(const int16_t* _pElevations, __m256i _Ids, __m256& _OutLeft, __m256& _OutRight)
+{
+    // the two 16 bit neighbours come in a single 32 bit load, the right one is always inside of the map
+    __m256i pairs = _mm256_i32gather_epi32((const int*)_pElevations, _Ids, 2);
+    _OutLeft = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(pairs, 16), 16));
+    _OutRight = _mm256_cvtepi32_ps(_mm256_srai_epi32(pairs, 16));
+}
+
+
+template<typename T>
+ELEVATION_SAMPLER_AVX2_TARGET
+void BasicElevationSampler<T>::SampleAVX2(const float* _pX, const float* _pY, size_t _Count, float* _pOutZ) const
+{
+    const __m256 scale = _mm256_set1_ps(m_Scale);
+    const __m256 offsetX = _mm256_set1_ps(m_OffsetX);
+    const __m256 offsetY = _mm256_set1_ps(m_OffsetY);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 maxCoord = _mm256_set1_ps(m_MaxCoord);
+    const __m256i maxCell = _mm256_set1_epi32(m_MaxCell);
+    const __m256i stride = _mm256_set1_epi32((int)m_Extent);
+    const __m256 quantScale = _mm256_set1_ps(m_QuantScale);
+    const __m256 quantOffset = _mm256_set1_ps(m_QuantOffset);
+
+    size_t i = 0;
+    for (; i + 8 <= _Count; i += 8)
+    {
+        __m256 fx = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(_pX + i), scale), offsetX), zero), maxCoord);
+        __m256 fy = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(_pY + i), scale), offsetY), zero), maxCoord);
+        __m256i ix = _mm256_min_epi32(_mm256_cvttps_epi32(fx), maxCell);
+        __m256i iy = _mm256_min_epi32(_mm256_cvttps_epi32(fy), maxCell);
+        __m256 tx = _mm256_sub_ps(fx, _mm256_cvtepi32_ps(ix));
+        __m256 ty = _mm256_sub_ps(fy, _mm256_cvtepi32_ps(iy));
+
+        // the map is at most 46340 samples wide, so the offsets fit into 32 bits
+        __m256i id00 = _mm256_add_epi32(_mm256_mullo_epi32(iy, stride), ix);
+        __m256 c00, c10, c01, c11;
+        GatherCorners(m_pElevations, id00, c00, c10);
+        GatherCorners(m_pElevations, _mm256_add_epi32(id00, stride), c01, c11);
+        if (SampleTraits<T>::bQuantized)
+        {
+            c00 = _mm256_add_ps(_mm256_mul_ps(c00, quantScale), quantOffset);
+            c10 = _mm256_add_ps(_mm256_mul_ps(c10, quantScale), quantOffset);
+            c01 = _mm256_add_ps(_mm256_mul_ps(c01, quantScale), quantOffset);
+            c11 = _mm256_add_ps(_mm256_mul_ps(c11, quantScale), quantOffset);
+        }
+
+        __m256 z0 = _mm256_add_ps(c00, _mm256_mul_ps(_mm256_sub_ps(c10, c00), tx));
+        __m256 z1 = _mm256_add_ps(c01, _mm256_mul_ps(_mm256_sub_ps(c11, c01), tx));
+        _mm256_storeu_ps(_pOutZ + i, _mm256_add_ps(z0, _mm256_mul_ps(_mm256_sub_ps(z1, z0), ty)));
+    }
+    SampleSSE2(_pX + i, _pY + i, _Count - i, _pOutZ + i);
+}
+#endif
+
+
+template class BasicElevationSampler<float>;
+template class BasicElevationSampler<int16_t>;
+template void detail::SampleElevationsScalar(const ElevationSampler&, Span<const float>, Span<const float>, Span<float>);
+template void detail::SampleElevationsScalar(const QuantizedElevationSampler&, Span<const float>, Span<const float>, Span<float>);
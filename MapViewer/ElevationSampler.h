@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Span.h"
+
+// Size of the coordinate space of the vector tiles
+const float VECTOR_TILE_EXTENT = 8192.0f;
+
+// Elevations are exaggerated by the zoom level, so the tiles of all levels have the same relief in tile space
+float GetElevationScale(int _ZoomLevel);
+
+// Tile coordinates to the samples of a map of _Extent x _Extent pixels with a _Border pixel border around it
+// (sample = Offset + position * Scale), for the part of the tile covered by the descendant (_X, _Y) _LevelsUp levels
+// below (_LevelsUp = 0 is the whole tile). The pixels are centered in the tile: its edge is half way between the
+// last pixel and the first one of the border, which is the first pixel of the neighbour tile, so the neighbours
+// interpolate between the same elevations along their shared edge.
+struct ElevationWindow
+{
+    float Scale;
+    float OffsetX;
+    float OffsetY;
+};
+ElevationWindow GetElevationWindow(unsigned int _Extent, unsigned int _Border, int _LevelsUp = 0, int _X = 0, int _Y = 0);
+
+// Web Mercator tile of _ZoomLevel a WGS84 point (degrees) falls into, and the position of the point in the tile
+// coordinates of that tile (y grows southwards, as in the vector tiles). The latitudes are clamped to the ones
+// the projection covers.
+void GetTilePosition(int _ZoomLevel, double _Lon, double _Lat, int& _OutTileX, int& _OutTileY, float& _OutX, float& _OutY);
+
+// Bilinear elevation queries over a square elevation map of any extent (at least 2). The positions are
+// in tile coordinates, [0, _TileExtent] covers the whole map and the positions outside are clamped to it.
+// The sampler doesn't own the map, it has to outlive the sampler.
+//
+// T is the sample type of the map: float elevations, or int16_t ones quantized as Scale * sample + Offset
+// (see SetQuantization). Everything is specialized on it at compile time, there are float and int16_t builds.
+template<typename T>
+class BasicElevationSampler
+{
+public:
+    BasicElevationSampler(const T* _pElevations, unsigned int _Extent, float _TileExtent = VECTOR_TILE_EXTENT);
+    BasicElevationSampler(const std::vector<T>& _ElevationMap, unsigned int _Extent, float _TileExtent = VECTOR_TILE_EXTENT);
+    // Samples a window of the map: a position maps to (_OffsetX + x * _Scale, _OffsetY + y * _Scale) in map samples
+    BasicElevationSampler(const T* _pElevations, unsigned int _Extent, float _Scale, float _OffsetX, float _OffsetY);
+
+    // elevation = _Scale * sample + _Offset, ignored by the float samplers
+    void SetQuantization(float _Scale, float _Offset);
+
+    unsigned int GetExtent() const { return m_Extent; }
+
+    float Sample(float _X, float _Y) const;
+
+    // _OutZ[i] = Sample(_X[i], _Y[i]) for the whole spans (they must be of the same size). Runs the AVX2 or SSE2
+    // kernel when the CPU has one, the results are the same as of the scalar Sample bit for bit.
+    void Sample(Span<const float> _X, Span<const float> _Y, Span<float> _OutZ) const;
+
+private:
+    float Decode(T _Sample) const;
+    void SampleSSE2(const float* _pX, const float* _pY, size_t _Count, float* _pOutZ) const;
+    void SampleAVX2(const float* _pX, const float* _pY, size_t _Count, float* _pOutZ) const;
+
+private:
+    const T* m_pElevations;
+    unsigned int m_Extent;
+    // tile coordinates to elevation map cells
+    float m_Scale;
+    float m_OffsetX;
+    float m_OffsetY;
+    // last elevation map position and the last cell a sample can be interpolated in
+    float m_MaxCoord;
+    int m_MaxCell;
+    float m_QuantScale = 1.0f;
+    float m_QuantOffset = 0.0f;
+};
+
+typedef BasicElevationSampler<float> ElevationSampler;
+typedef BasicElevationSampler<int16_t> QuantizedElevationSampler;
@@ -5,6 +5,7 @@
 #include "ogcamera.h"
 #include "ogvertexbuffers.h"
 #include "Scene.h"
+#include "Culling.h"
 #include <vector>
 #include <map>
 
@@ -28,14 +29,23 @@ const OGVec3 g_LanduseColor = OGVec3(0.0f, 0.5f, 0.0f);
 const int g_TileLength = 8192;
 
 
+struct TileMesh
+{
+    COGVertexBuffers* pBuffers;
+    OGVec3 Color;
+};
+
+
 struct TileGeometry
 {
     OGMatrix mTilePosition;
     OGMatrix mWorld;
 
-    std::vector<COGVertexBuffers*> TerrainMeshes;
-    std::vector<COGVertexBuffers*> WaterMeshes;
-    std::vector<COGVertexBuffers*> LanduseMeshes;
+    // drawn in order: terrain, water, landuse
+    std::vector<TileMesh> Meshes;
+    // tile space bounds of the tile and of every mesh, used for culling
+    IOGAabb Bounds;
+    std::vector<IOGAabb> MeshBounds;
 };
 
 
@@ -52,6 +62,9 @@ std::map<int, TileZoomLevel> g_ZoomLevels;
 
 int g_SelectedZoomLevel = 12;
 
+CullingStats g_CullingStats;
+std::vector<uint32_t> g_VisibleMeshes;
+
 
 void InitRenderer(HWND _hWnd, int _ScrWidth, int _ScrHeight)
 {
@@ -110,23 +123,12 @@ void DestroyRenderer()
     {
         for (auto& t : z.second.Tiles)
         {
-            for (auto& m : t.WaterMeshes)
-            {
-                delete m;
-            }
-            t.WaterMeshes.clear();
-
-            for (auto& m : t.TerrainMeshes)
-            {
-                delete m;
-            }
-            t.TerrainMeshes.clear();
-
-            for (auto& m : t.LanduseMeshes)
+            for (auto& m : t.Meshes)
             {
-                delete m;
+                delete m.pBuffers;
             }
-            t.LanduseMeshes.clear();
+            t.Meshes.clear();
+            t.MeshBounds.clear();
         }
     }
 
@@ -144,7 +146,7 @@ void LoadSceneData(const SceneMeshes& _SceneData)
     // TODO: either calculate them on the flight or move to tile config
     std::map<int, float> TileOffsets = { {12, -1.0f * g_TileLength / 2}, {13, -1.0f * g_TileLength}, {14, -1.0f * g_TileLength - g_TileLength} };
 
-    for (auto l : _SceneData.ZoomLevels)
+    for (const auto& l : _SceneData.ZoomLevels)
     {
         if (g_ZoomLevels.find(l.first) == g_ZoomLevels.end())
         {
@@ -171,26 +173,31 @@ void LoadSceneData(const SceneMeshes& _SceneData)
 
         // fill meshes (GL index+vertex buffs) for the appropriate tiles
         auto& curLevel = g_ZoomLevels[l.first];
-        for (auto t : l.second.Tiles)
+        for (const auto& t : l.second.Tiles)
         {
             auto& curTile = curLevel.Tiles.at(l.second.TilesInRow * t.TileY + t.TileX);
-            for (auto mt : t.TerrainMeshes)
+            if (curTile.Meshes.empty())
             {
-                COGVertexBuffers* pNewMesh = new COGVertexBuffers();
-                pNewMesh->Fill(mt.Vertices.data(), mt.Vertices.size() / 6, mt.Indices.size() / 3, sizeof(float) * 6, mt.Indices.data(), mt.Indices.size());
-                curTile.TerrainMeshes.push_back(pNewMesh);
+                curTile.Bounds = t.Bounds;
             }
-            for (auto mt : t.WaterMeshes)
+            else
             {
-                COGVertexBuffers* pNewMesh = new COGVertexBuffers();
-                pNewMesh->Fill(mt.Vertices.data(), mt.Vertices.size() / 6, mt.Indices.size() / 3, sizeof(float) * 6, mt.Indices.data(), mt.Indices.size());
-                curTile.WaterMeshes.push_back(pNewMesh);
+                curTile.Bounds.EmbraceAABB(t.Bounds);
             }
-            for (auto mt : t.LanduseMeshes)
+
+            const std::pair<const std::vector<SceneMeshes::TileMeshes::MeshData>*, OGVec3> meshTypes[] = {
+                { &t.TerrainMeshes, g_TerrainColor }, { &t.WaterMeshes, g_WaterColor }, { &t.LanduseMeshes, g_LanduseColor } };
+            for (const auto& mt : meshTypes)
             {
-                COGVertexBuffers* pNewMesh = new COGVertexBuffers();
-                pNewMesh->Fill(mt.Vertices.data(), mt.Vertices.size() / 6, mt.Indices.size() / 3, sizeof(float) * 6, mt.Indices.data(), mt.Indices.size());
-                curTile.LanduseMeshes.push_back(pNewMesh);
+                for (const auto& m : *mt.first)
+                {
+                    COGVertexBuffers* pNewMesh = new COGVertexBuffers();
+                    const Span<const float> vertices = m.GetVertices();
+                    const Span<const uint32_t> indices = m.GetIndices();
+                    pNewMesh->Upload(vertices.data(), vertices.size() / 6, indices.size() / 3, sizeof(float) * 6, indices.data(), indices.size());
+                    curTile.Meshes.push_back({ pNewMesh, mt.second });
+                    curTile.MeshBounds.push_back(m.Bounds);
+                }
             }
         }
     }
@@ -225,33 +232,36 @@ void RenderFrame()
 
     glUseProgram(g_ProgId);
 
-    for (auto t : g_ZoomLevels[g_SelectedZoomLevel].Tiles)
-    {
-        MatrixMultiply(g_mMV, t.mWorld, g_mView);
-        MatrixMultiply(g_mMVP, g_mMV, g_mProjection);
-        glUniformMatrix4fv(g_MVPMatrixLoc, 1, GL_FALSE, g_mMVP.f);
+    g_CullingStats = CullingStats();
+    const IOGFrustum& frustum = g_Camera.GetFrustum();
 
-        for (auto m : t.TerrainMeshes)
+    for (const auto& t : g_ZoomLevels[g_SelectedZoomLevel].Tiles)
+    {
+        // tiles and meshes out of the view are skipped before any GL call
+        CullTile(frustum, t.mWorld, t.Bounds, t.MeshBounds, g_VisibleMeshes, g_CullingStats);
+        if (g_VisibleMeshes.empty())
         {
-            glUniform3fv(g_MeshColorLoc, 1, g_TerrainColor.ptr());
-            m->Apply();
-            m->Render();
+            continue;
         }
 
-        for (auto m : t.WaterMeshes)
-        {
-            glUniform3fv(g_MeshColorLoc, 1, g_WaterColor.ptr());
-            m->Apply();
-            m->Render();
-        }
+        MatrixMultiply(g_mMV, t.mWorld, g_mView);
+        MatrixMultiply(g_mMVP, g_mMV, g_mProjection);
+        glUniformMatrix4fv(g_MVPMatrixLoc, 1, GL_FALSE, g_mMVP.f);
 
-        for (auto m : t.LanduseMeshes)
+        for (auto id : g_VisibleMeshes)
         {
-            glUniform3fv(g_MeshColorLoc, 1, g_LanduseColor.ptr());
-            m->Apply();
-            m->Render();
+            const auto& m = t.Meshes[id];
+            glUniform3fv(g_MeshColorLoc, 1, m.Color.ptr());
+            m.pBuffers->Apply();
+            m.pBuffers->Render();
         }
     }
 
     SwapBuffers(g_hDC);
 }
+
+
+const CullingStats& GetCullingStats()
+{
+    return g_CullingStats;
+}
@@ -3,6 +3,7 @@
 #include <wglew.h>
 #include <ogvertexbuffers.h>
 #include "Scene.h"
+#include "Culling.h"
 
 void InitRenderer(HWND _hWnd, int _ScrWidth, int _ScrHeight);
 void DestroyRenderer();
@@ -11,3 +12,6 @@ void RenderFrame();
 void LoadSceneData(const SceneMeshes& _SceneData);
 
 void SelectZoomLevel(int _ZoomLevel);
+
+// Tiles and meshes drawn and culled in the last RenderFrame
+const CullingStats& GetCullingStats();
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string>
+#include <iostream>
+#include <memory>
+
+#include <clara.hpp>
+
+#include "Scene.h"
+#include "Utils.h"
+
+
+static const char* g_StageNames[STAGE_COUNT] =
+{
+    "elevation map",
+    "read tile",
+    "tesselate",
+    "subdivide",
+    "construct mesh",
+    "merge",
+    "stitch",
+};
+
+static const char* g_StageUnits[STAGE_COUNT] =
+{
+    "tiles",
+    "tiles",
+    "tris",
+    "tris",
+    "tris",
+    "tiles",
+    "tiles",
+};
+
+
+/// Prints the statistics of a single Scene::Load call.
+static void PrintStats(int _Run, const SceneLoadStats& _Stats)
+{
+    double wall = _Stats.WallTime > 0.0 ? _Stats.WallTime : 1e-9;
+    printf("run %d: %.1f ms, %llu tiles, %llu meshes, %llu triangles, %llu vertices\n",
+        _Run, _Stats.WallTime * 1000.0,
+        (unsigned long long)_Stats.NumTiles, (unsigned long long)_Stats.NumMeshes,
+        (unsigned long long)_Stats.NumTriangles, (unsigned long long)_Stats.NumVertices);
+    printf("  total: %.1f tiles/s, %.0f tris/s\n", _Stats.NumTiles / wall, _Stats.NumTriangles / wall);
+    if (_Stats.FromCache)
+    {
+        printf("  loaded from the scene cache\n");
+        return;
+    }
+    printf("  skipped %.1f KB of unused tile layers\n", _Stats.SkippedTileBytes / 1024.0);
+    printf("  DEM tiles: %llu decoded, %llu from raw files, %llu downsampled, %llu from the elevation cache\n",
+        (unsigned long long)_Stats.DemDecodes, (unsigned long long)_Stats.DemRawFileLoads,
+        (unsigned long long)_Stats.DemDerived, (unsigned long long)_Stats.DemCacheHits);
+
+    // stage times are summed over all worker threads
+    printf("  %-16s %12s %12s %16s\n", "stage", "cpu ms", "items", "throughput");
+    for (int i = 0; i < STAGE_COUNT; ++i)
+    {
+        double time = _Stats.StageTime[i];
+        double rate = time > 0.0 ? _Stats.StageItems[i] / time : 0.0;
+        printf("  %-16s %12.2f %12llu %10.0f %s/s\n", g_StageNames[i], time * 1000.0,
+            (unsigned long long)_Stats.StageItems[i], rate, g_StageUnits[i]);
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    std::string assetsPath;
+    std::string cachePath;
+    unsigned int numThreads = 0;
+    int numRepeats = 1;
+    bool bWarm = false;
+    unsigned int demCacheMB = 64;
+    bool bNoRawDem = false;
+    bool bNoDerivedDem = false;
+    bool bStitch = false;
+    bool showHelp = false;
+
+    auto cli = clara::Help(showHelp)
+        | clara::Opt(assetsPath, "path")["-a"]["--assets"]("assets directory (default: <exe dir>/assets/)")
+        | clara::Opt(numThreads, "count")["-t"]["--threads"]("number of loading threads, 0 = all hardware threads")
+        | clara::Opt(numRepeats, "count")["-r"]["--repeat"]("number of times to load the scene")
+        | clara::Opt(bWarm)["-w"]["--warm"]("reload the same scene, so the repeats reuse its decoded DEMs")
+        | clara::Opt(demCacheMB, "MB")["-d"]["--dem-cache"]("budget of the decoded DEM cache (default: 64)")
+        | clara::Opt(bNoRawDem)["--no-raw-dem"]("always decode the DEM PNGs, don't read or write their raw files")
+        | clara::Opt(bNoDerivedDem)["--no-derived-dem"]("decode the DEMs of every zoom level instead of downsampling the highest one")
+        | clara::Opt(bStitch)["--stitch"]("weld the terrain, water and landuse meshes of neighbour tiles after each zoom level is loaded")
+        | clara::Opt(cachePath, "file")["-c"]["--cache"]("bake the scene into this cache file, or load it from there if it's up to date");
+
+    auto result = cli.parse(clara::Args(argc, argv));
+    if (!result)
+    {
+        std::cerr << "Error in command line: " << result.errorMessage() << '\n';
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << cli << '\n';
+        return 0;
+    }
+
+    if (assetsPath.empty())
+    {
+        assetsPath = GetResourcePath() + std::string("/assets/");
+    }
+    else if (assetsPath.back() != '/' && assetsPath.back() != '\\')
+    {
+        assetsPath += '/';
+    }
+
+    std::unique_ptr<Scene> pScene;
+    for (int run = 0; run < numRepeats; ++run)
+    {
+        if (!pScene || !bWarm)
+        {
+            pScene.reset(new Scene());
+            pScene->SetElevationCacheBudget((size_t)demCacheMB * 1024 * 1024);
+            pScene->SetRawElevationFiles(!bNoRawDem);
+            pScene->SetDerivedElevationLevels(!bNoDerivedDem);
+            pScene->SetTileStitching(bStitch);
+        }
+        Scene& scene = *pScene;
+        bool bLoaded = cachePath.empty() ? scene.Load(assetsPath, numThreads) : scene.LoadCached(assetsPath, cachePath, numThreads);
+        if (!bLoaded)
+        {
+            std::cerr << "Failed to load the scene from " << assetsPath << '\n';
+            return 1;
+        }
+
+        PrintStats(run, scene.GetLoadStats());
+    }
+
+    return 0;
+}
@@ -0,0 +1,875 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+#include <clara.hpp>
+
+#include "VTZeroRead.h"
+#include "Tesselator.h"
+#include "ElevationMap.h"
+#include "ElevationMinMax.h"
+#include "ElevationCache.h"
+#include "ElevationSampler.h"
+#include "NormalGrid.h"
+#include "MappedFile.h"
+#include "MeshSubdivision.h"
+#include "MeshConstructor.h"
+#include "Scene.h"
+#include "ReferenceKernels.h"
+#include "Utils.h"
+
+
+// Every operator new of the process is counted, so the benchmarks can report allocations
+static std::atomic<uint64_t> g_NumAllocs(0);
+static std::atomic<uint64_t> g_NumAllocBytes(0);
+
+void* operator new(size_t _Size)
+{
+    g_NumAllocs.fetch_add(1, std::memory_order_relaxed);
+    g_NumAllocBytes.fetch_add(_Size, std::memory_order_relaxed);
+    void* p = malloc(_Size ? _Size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t _Size)
+{
+    return operator new(_Size);
+}
+
+void* operator new(size_t _Size, const std::nothrow_t&) noexcept
+{
+    g_NumAllocs.fetch_add(1, std::memory_order_relaxed);
+    g_NumAllocBytes.fetch_add(_Size, std::memory_order_relaxed);
+    return malloc(_Size ? _Size : 1);
+}
+
+void* operator new[](size_t _Size, const std::nothrow_t& _Tag) noexcept
+{
+    return operator new(_Size, _Tag);
+}
+
+// GCC doesn't see that the operator new above is malloc as well and takes these free() calls for mismatched ones
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* _Ptr) noexcept { free(_Ptr); }
+void operator delete[](void* _Ptr) noexcept { free(_Ptr); }
+void operator delete(void* _Ptr, size_t) noexcept { free(_Ptr); }
+void operator delete[](void* _Ptr, size_t) noexcept { free(_Ptr); }
+void operator delete(void* _Ptr, const std::nothrow_t&) noexcept { free(_Ptr); }
+void operator delete[](void* _Ptr, const std::nothrow_t&) noexcept { free(_Ptr); }
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+
+struct BenchResult
+{
+    std::string Name;
+    std::string Unit;
+    // items processed by one iteration
+    uint64_t Items = 0;
+    std::vector<double> Times;
+    std::vector<uint64_t> Allocs;
+    std::vector<uint64_t> AllocBytes;
+};
+
+
+struct BenchOptions
+{
+    int Iterations = 10;
+    int Warmup = 1;
+    std::string Filter;
+    // the results table, stderr when the JSON goes to stdout
+    FILE* pTextOut = stdout;
+};
+
+
+template<typename T>
+static T Percentile(std::vector<T> _Values, double _Pct)
+{
+    if (_Values.empty())
+    {
+        return T();
+    }
+    std::sort(_Values.begin(), _Values.end());
+    size_t id = (size_t)(_Pct * _Values.size() + 0.999999);
+    id = id > 0 ? id - 1 : 0;
+    return _Values[std::min(id, _Values.size() - 1)];
+}
+
+
+/// Runs _Run for the warmup and measured iterations. _Setup is called before every
+/// iteration and isn't timed, _Run returns the number of items it processed.
+static bool RunBench(const BenchOptions& _Opt, const std::string& _Name, const std::string& _Unit,
+    const std::function<void()>& _Setup, const std::function<uint64_t()>& _Run, std::vector<BenchResult>& _OutResults)
+{
+    if (!_Opt.Filter.empty() && _Name.find(_Opt.Filter) == std::string::npos)
+    {
+        return false;
+    }
+
+    BenchResult res;
+    res.Name = _Name;
+    res.Unit = _Unit;
+    for (int i = 0; i < _Opt.Warmup + _Opt.Iterations; ++i)
+    {
+        if (_Setup)
+        {
+            _Setup();
+        }
+
+        uint64_t allocs = g_NumAllocs.load();
+        uint64_t allocBytes = g_NumAllocBytes.load();
+        double start = GetTime();
+        uint64_t items = _Run();
+        double time = GetTime() - start;
+        allocs = g_NumAllocs.load() - allocs;
+        allocBytes = g_NumAllocBytes.load() - allocBytes;
+
+        if (i >= _Opt.Warmup)
+        {
+            res.Items = items;
+            res.Times.push_back(time);
+            res.Allocs.push_back(allocs);
+            res.AllocBytes.push_back(allocBytes);
+        }
+    }
+
+    double median = Percentile(res.Times, 0.5);
+    fprintf(_Opt.pTextOut, "%-42s %10.3f %10.3f %14.0f %-6s %12llu %14llu\n", _Name.c_str(), median * 1000.0,
+        Percentile(res.Times, 0.95) * 1000.0, median > 0.0 ? res.Items / median : 0.0, (_Unit + "/s").c_str(),
+        (unsigned long long)Percentile(res.Allocs, 0.5), (unsigned long long)Percentile(res.AllocBytes, 0.5));
+    fflush(_Opt.pTextOut);
+
+    _OutResults.push_back(res);
+    return true;
+}
+
+
+static void WriteJson(FILE* _File, const BenchOptions& _Opt, unsigned int _NumThreads, const std::vector<BenchResult>& _Results)
+{
+    fprintf(_File, "{\n");
+    fprintf(_File, "  \"iterations\": %d,\n", _Opt.Iterations);
+    fprintf(_File, "  \"warmup\": %d,\n", _Opt.Warmup);
+    fprintf(_File, "  \"threads\": %u,\n", _NumThreads);
+    fprintf(_File, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < _Results.size(); ++i)
+    {
+        const auto& r = _Results[i];
+        double median = Percentile(r.Times, 0.5);
+        fprintf(_File, "    {\n");
+        fprintf(_File, "      \"name\": \"%s\",\n", r.Name.c_str());
+        fprintf(_File, "      \"unit\": \"%s\",\n", r.Unit.c_str());
+        fprintf(_File, "      \"items\": %llu,\n", (unsigned long long)r.Items);
+        fprintf(_File, "      \"median_ms\": %.6f,\n", median * 1000.0);
+        fprintf(_File, "      \"p95_ms\": %.6f,\n", Percentile(r.Times, 0.95) * 1000.0);
+        fprintf(_File, "      \"min_ms\": %.6f,\n", Percentile(r.Times, 0.0) * 1000.0);
+        fprintf(_File, "      \"throughput\": %.3f,\n", median > 0.0 ? r.Items / median : 0.0);
+        fprintf(_File, "      \"allocs\": %llu,\n", (unsigned long long)Percentile(r.Allocs, 0.5));
+        fprintf(_File, "      \"alloc_bytes\": %llu\n", (unsigned long long)Percentile(r.AllocBytes, 0.5));
+        fprintf(_File, "    }%s\n", i + 1 < _Results.size() ? "," : "");
+    }
+    fprintf(_File, "  ]\n");
+    fprintf(_File, "}\n");
+}
+
+
+struct TileInput
+{
+    int ZoomLevel;
+    int TileX;
+    int TileY;
+    std::string DemFilename;
+    std::string MvtFilename;
+};
+
+struct PolygonInput
+{
+    int ZoomLevel;
+    size_t TileId;
+    // meshes of the same tile layer are merged together
+    size_t LayerId;
+    const Polygon* pPolygon;
+};
+
+struct MeshInput
+{
+    std::vector<uint32_t> Indices;
+    std::vector<float> Vertices;
+};
+
+
+int main(int argc, char* argv[])
+{
+    std::string assetsPath;
+    std::string jsonPath;
+    unsigned int numThreads = 0;
+    BenchOptions opt;
+    bool showHelp = false;
+
+    auto cli = clara::Help(showHelp)
+        | clara::Opt(assetsPath, "path")["-a"]["--assets"]("assets directory (default: <exe dir>/assets/)")
+        | clara::Opt(opt.Iterations, "count")["-i"]["--iterations"]("measured iterations per benchmark")
+        | clara::Opt(opt.Warmup, "count")["-w"]["--warmup"]("warmup iterations per benchmark")
+        | clara::Opt(opt.Filter, "name")["-f"]["--filter"]("run only the benchmarks containing this string")
+        | clara::Opt(numThreads, "count")["-t"]["--threads"]("Scene::Load threads, 0 = all hardware threads")
+        | clara::Opt(jsonPath, "file")["-j"]["--json"]("write the results as JSON, '-' for stdout");
+
+    // clara takes a lone '-' for an option, so "--json -" is passed on as "--json=-"
+    std::vector<std::string> args(argv, argv + argc);
+    for (size_t i = 1; i + 1 < args.size(); ++i)
+    {
+        if ((args[i] == "-j" || args[i] == "--json") && args[i + 1] == "-")
+        {
+            args[i] = "--json=-";
+            args.erase(args.begin() + i + 1);
+        }
+    }
+    std::vector<char*> argPtrs;
+    for (auto& a : args)
+    {
+        argPtrs.push_back(&a[0]);
+    }
+
+    auto result = cli.parse(clara::Args((int)argPtrs.size(), argPtrs.data()));
+    if (!result)
+    {
+        std::cerr << "Error in command line: " << result.errorMessage() << '\n';
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << cli << '\n';
+        return 0;
+    }
+
+    if (opt.Iterations < 1)
+    {
+        opt.Iterations = 1;
+    }
+    if (opt.Warmup < 0)
+    {
+        opt.Warmup = 0;
+    }
+
+    if (jsonPath == "-")
+    {
+        opt.pTextOut = stderr;
+    }
+
+    if (assetsPath.empty())
+    {
+        assetsPath = GetResourcePath() + std::string("/assets/");
+    }
+    else if (assetsPath.back() != '/' && assetsPath.back() != '\\')
+    {
+        assetsPath += '/';
+    }
+
+    // The raw DEM files written by the benchmarks go to a temp directory, the assets stay untouched
+    TempDirectory rawDirectory("mapbench");
+    if (rawDirectory.GetPath().empty())
+    {
+        std::cerr << "Can't create a temp directory\n";
+        return 1;
+    }
+    const std::string& rawPath = rawDirectory.GetPath();
+
+    // The scene is loaded once up front: it provides the tile list and the terrain meshes to stitch
+    Scene refScene;
+    refScene.SetRawElevationFiles(true, rawPath);
+    if (!refScene.Load(assetsPath, numThreads))
+    {
+        std::cerr << "Failed to load the scene from " << assetsPath << '\n';
+        return 1;
+    }
+
+    std::vector<TileInput> tileInputs;
+    for (const auto& zl : refScene.GetZoomLevelConfigs())
+    {
+        for (const auto& tc : zl.TileCoords)
+        {
+            std::stringstream suffix;
+            suffix << zl.ZoomLevel << "_" << tc.TileCoordX << "_" << tc.TileCoordY;
+            tileInputs.push_back({ zl.ZoomLevel, tc.TileCoordX, tc.TileCoordY,
+                assetsPath + "dem/dem_" + suffix.str() + ".png",
+                assetsPath + "mvt/mvt_" + suffix.str() + ".mvt" });
+        }
+    }
+
+    const std::vector<std::string>& meshLayers = refScene.GetMeshLayers();
+    const float maxEdgeLength = refScene.GetMaxEdgeLength();
+
+    // Inputs of every stage are the outputs of the previous one, prepared outside of the timed code
+    std::vector<Tile> tiles(tileInputs.size());
+    // the elevation maps keep the DEM border the same way as the tiles of ElevationCache
+    std::vector<std::vector<float>> elevationMaps(tileInputs.size());
+    std::vector<unsigned int> extents(tileInputs.size());
+    std::vector<ElevationSampler> samplers;
+    std::vector<std::vector<int16_t>> quantizedMaps(tileInputs.size());
+    std::vector<QuantizedElevationSampler> quantizedSamplers;
+    std::vector<ElevationMinMaxTree> minMaxTrees(tileInputs.size());
+    std::vector<float> quantScales(tileInputs.size());
+    std::vector<float> quantOffsets(tileInputs.size());
+    std::vector<std::vector<int8_t>> normalGrids(tileInputs.size());
+    std::vector<NormalGridSampler> normalSamplers;
+    for (size_t i = 0; i < tileInputs.size(); ++i)
+    {
+        unsigned int& extent = extents[i];
+        MappedFilePtr pDem = MappedFile::Load(tileInputs[i].DemFilename);
+        if (!ReadTile(tileInputs[i].MvtFilename, meshLayers, tiles[i]) || !pDem ||
+            !LoadTerrariumElevationMap(pDem->GetData(), pDem->GetSize(), extent, elevationMaps[i], ELEVATION_TILE_BORDER))
+        {
+            std::cerr << "Failed to load tile " << tileInputs[i].MvtFilename << '\n';
+            return 1;
+        }
+        const unsigned int sampleExtent = extent + 2 * ELEVATION_TILE_BORDER;
+        const unsigned int normalExtent = sampleExtent - 2;
+
+        const ElevationWindow window = GetElevationWindow(extent, ELEVATION_TILE_BORDER);
+        samplers.push_back(ElevationSampler(elevationMaps[i].data(), sampleExtent, window.Scale, window.OffsetX, window.OffsetY));
+
+        float quantScale = 1.0f;
+        float quantOffset = 0.0f;
+        QuantizeElevationMap(elevationMaps[i], quantizedMaps[i], quantScale, quantOffset);
+        quantizedSamplers.push_back(QuantizedElevationSampler(quantizedMaps[i].data(), sampleExtent, window.Scale, window.OffsetX, window.OffsetY));
+        quantizedSamplers.back().SetQuantization(quantScale, quantOffset);
+        minMaxTrees[i].Build(quantizedMaps[i].data(), sampleExtent);
+        quantScales[i] = quantScale;
+        quantOffsets[i] = quantOffset;
+
+        // the normals of the first ring of the border
+        ComputeNormalGrid(elevationMaps[i].data() + sampleExtent + 1, sampleExtent, normalExtent, VECTOR_TILE_EXTENT / (float)extent,
+            GetElevationScale(tileInputs[i].ZoomLevel), normalGrids[i]);
+        const ElevationWindow normalWindow = GetElevationWindow(extent, ELEVATION_TILE_BORDER - 1);
+        normalSamplers.push_back(NormalGridSampler(normalGrids[i].data(), normalExtent, normalWindow.Scale, normalWindow.OffsetX, normalWindow.OffsetY));
+    }
+
+    // elevation queries spread over the tiles and a bit outside of them
+    const size_t numSamples = 16384;
+    std::vector<float> sampleX(numSamples);
+    std::vector<float> sampleY(numSamples);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        sampleX[i] = (float)(seed >> 8) / (float)(1 << 24) * 8400.0f - 100.0f;
+        seed = seed * 1664525u + 1013904223u;
+        sampleY[i] = (float)(seed >> 8) / (float)(1 << 24) * 8400.0f - 100.0f;
+    }
+    std::vector<float> sampleZ(numSamples);
+
+    // the raw DEM files go to the temp directory
+    auto demFilename = [&assetsPath, &rawPath](const char* _Extension)
+    {
+        const std::string directory = strcmp(_Extension, ".raw") == 0 ? rawPath : assetsPath + "dem/";
+        return [directory, _Extension](int _Zoom, int _X, int _Y)
+        {
+            std::stringstream filename;
+            filename << directory << "dem_" << _Zoom << "_" << _X << "_" << _Y << _Extension;
+            return filename.str();
+        };
+    };
+    // the reference scene wrote the raw files of the leaf tiles only, the ones of the levels it downsampled are written here
+    {
+        ElevationCache writeCache(demFilename(".png"));
+        writeCache.SetRawFilename(demFilename(".raw"));
+        for (const auto& ti : tileInputs)
+        {
+            writeCache.Get(ti.ZoomLevel, ti.TileX, ti.TileY);
+        }
+    }
+
+    // parents with all of their 4 children
+    struct DownsampleInput
+    {
+        size_t ParentId;
+        QuantizedElevationMapView Children[4];
+    };
+    std::vector<DownsampleInput> downsampleInputs;
+    for (size_t i = 0; i < tileInputs.size(); ++i)
+    {
+        DownsampleInput input = {};
+        input.ParentId = i;
+        int numChildren = 0;
+        for (size_t j = 0; j < tileInputs.size(); ++j)
+        {
+            const int c = (tileInputs[j].TileX - tileInputs[i].TileX * 2) + (tileInputs[j].TileY - tileInputs[i].TileY * 2) * 2;
+            if (tileInputs[j].ZoomLevel == tileInputs[i].ZoomLevel + 1 &&
+                tileInputs[j].TileX / 2 == tileInputs[i].TileX && tileInputs[j].TileY / 2 == tileInputs[i].TileY)
+            {
+                input.Children[c] = { quantizedMaps[j].data(), quantScales[j], quantOffsets[j] };
+                ++numChildren;
+            }
+        }
+        if (numChildren == 4)
+        {
+            downsampleInputs.push_back(input);
+        }
+    }
+
+    // region queries over the elevation maps, from single samples up to the whole map
+    struct RangeQuery
+    {
+        int X0, Y0, X1, Y1;
+    };
+    std::vector<RangeQuery> rangeQueries;
+    for (size_t i = 0; i < 4096; ++i)
+    {
+        const unsigned int extent = quantizedSamplers[0].GetExtent();
+        seed = seed * 1664525u + 1013904223u;
+        const int size = 1 + (int)((seed >> 8) % extent);
+        seed = seed * 1664525u + 1013904223u;
+        const int x0 = (int)((seed >> 8) % (extent - size + 1));
+        seed = seed * 1664525u + 1013904223u;
+        const int y0 = (int)((seed >> 8) % (extent - size + 1));
+        rangeQueries.push_back({ x0, y0, x0 + size - 1, y0 + size - 1 });
+    }
+    rangeQueries.push_back({ 0, 0, (int)quantizedSamplers[0].GetExtent() - 1, (int)quantizedSamplers[0].GetExtent() - 1 });
+
+    std::vector<PolygonInput> polygons;
+    size_t numMeshLayers = 0;
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        for (const auto& l : tiles[i].m_Layers)
+        {
+            if (std::find(meshLayers.begin(), meshLayers.end(), l.m_Name) == meshLayers.end())
+            {
+                continue;
+            }
+            for (const auto& f : l.m_Features)
+            {
+                for (const auto& p : f.m_Polygons)
+                {
+                    polygons.push_back({ tileInputs[i].ZoomLevel, i, numMeshLayers, &p });
+                }
+            }
+            ++numMeshLayers;
+        }
+    }
+
+    std::vector<MeshInput> coarseMeshes(polygons.size());
+    std::vector<MeshInput> fineMeshes(polygons.size());
+    for (size_t i = 0; i < polygons.size(); ++i)
+    {
+        TesselatePolygon(*polygons[i].pPolygon, coarseMeshes[i].Indices, coarseMeshes[i].Vertices);
+        if (!SubdivideMesh(coarseMeshes[i].Indices, coarseMeshes[i].Vertices, maxEdgeLength, fineMeshes[i].Indices, fineMeshes[i].Vertices))
+        {
+            fineMeshes[i] = coarseMeshes[i];
+        }
+    }
+
+    fprintf(opt.pTextOut, "%-42s %10s %10s %21s %12s %14s\n", "benchmark", "median ms", "p95 ms", "throughput", "allocs", "alloc bytes");
+
+    std::vector<BenchResult> results;
+
+    RunBench(opt, "ReadTile", "tiles", nullptr, [&]()
+    {
+        for (const auto& ti : tileInputs)
+        {
+            Tile tile;
+            ReadTile(ti.MvtFilename, tile);
+        }
+        return (uint64_t)tileInputs.size();
+    }, results);
+
+    RunBench(opt, "ReadTile (mesh layers)", "tiles", nullptr, [&]()
+    {
+        for (const auto& ti : tileInputs)
+        {
+            Tile tile;
+            ReadTile(ti.MvtFilename, meshLayers, tile);
+        }
+        return (uint64_t)tileInputs.size();
+    }, results);
+
+    RunBench(opt, "LoadTerrariumElevationMap", "tiles", nullptr, [&]()
+    {
+        for (const auto& ti : tileInputs)
+        {
+            unsigned int extent = 0;
+            std::vector<float> elevationMap;
+            LoadTerrariumElevationMap(ti.DemFilename, extent, elevationMap);
+        }
+        return (uint64_t)tileInputs.size();
+    }, results);
+
+    RunBench(opt, "LoadTerrariumElevationMap (scalar)", "tiles", nullptr, [&]()
+    {
+        for (const auto& ti : tileInputs)
+        {
+            unsigned int extent = 0;
+            std::vector<float> elevationMap;
+            MappedFile file;
+            if (file.Open(ti.DemFilename))
+            {
+                detail::LoadTerrariumElevationMapScalar(file.GetData(), file.GetSize(), extent, elevationMap);
+            }
+        }
+        return (uint64_t)tileInputs.size();
+    }, results);
+
+    RunBench(opt, "QuantizeElevationMap", "tiles", nullptr, [&]()
+    {
+        std::vector<int16_t> samples;
+        float quantScale = 1.0f;
+        float quantOffset = 0.0f;
+        for (const auto& elevationMap : elevationMaps)
+        {
+            QuantizeElevationMap(elevationMap, samples, quantScale, quantOffset);
+        }
+        return (uint64_t)elevationMaps.size();
+    }, results);
+
+    RunBench(opt, "DownsampleElevationMaps", "tiles", nullptr, [&]()
+    {
+        std::vector<float> parent;
+        for (const auto& d : downsampleInputs)
+        {
+            DownsampleElevationMaps(d.Children, extents[d.ParentId], parent, ELEVATION_TILE_BORDER);
+        }
+        return (uint64_t)downsampleInputs.size();
+    }, results);
+
+    RunBench(opt, "DownsampleElevationMaps (scalar)", "tiles", nullptr, [&]()
+    {
+        std::vector<float> parent;
+        for (const auto& d : downsampleInputs)
+        {
+            detail::DownsampleElevationMapsScalar(d.Children, extents[d.ParentId], parent, ELEVATION_TILE_BORDER);
+        }
+        return (uint64_t)downsampleInputs.size();
+    }, results);
+
+    RunBench(opt, "ElevationCache::Get", "tiles", nullptr, [&]()
+    {
+        ElevationCache cache(demFilename(".png"));
+        for (const auto& ti : tileInputs)
+        {
+            cache.Get(ti.ZoomLevel, ti.TileX, ti.TileY);
+        }
+        return (uint64_t)tileInputs.size();
+    }, results);
+
+    RunBench(opt, "ElevationCache::Get (raw files)", "tiles", nullptr, [&]()
+    {
+        ElevationCache cache(demFilename(".png"));
+        cache.SetRawFilename(demFilename(".raw"));
+        for (const auto& ti : tileInputs)
+        {
+            cache.Get(ti.ZoomLevel, ti.TileX, ti.TileY);
+        }
+        return (uint64_t)tileInputs.size();
+    }, results);
+
+    RunBench(opt, "ElevationSampler::Sample", "samples", nullptr, [&]()
+    {
+        float sum = 0.0f;
+        for (const auto& sampler : samplers)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                sum += sampler.Sample(sampleX[i], sampleY[i]);
+            }
+        }
+        sampleZ[0] = sum;
+        return (uint64_t)(samplers.size() * numSamples);
+    }, results);
+
+    RunBench(opt, "ElevationSampler::Sample (batched)", "samples", nullptr, [&]()
+    {
+        for (const auto& sampler : samplers)
+        {
+            sampler.Sample(Span<const float>(sampleX.data(), numSamples), Span<const float>(sampleY.data(), numSamples), Span<float>(sampleZ.data(), numSamples));
+        }
+        return (uint64_t)(samplers.size() * numSamples);
+    }, results);
+
+    RunBench(opt, "ElevationSampler::Sample (batched, int16)", "samples", nullptr, [&]()
+    {
+        for (const auto& sampler : quantizedSamplers)
+        {
+            sampler.Sample(Span<const float>(sampleX.data(), numSamples), Span<const float>(sampleY.data(), numSamples), Span<float>(sampleZ.data(), numSamples));
+        }
+        return (uint64_t)(quantizedSamplers.size() * numSamples);
+    }, results);
+
+    RunBench(opt, "ElevationMinMaxTree::Build", "tiles", nullptr, [&]()
+    {
+        for (size_t i = 0; i < quantizedMaps.size(); ++i)
+        {
+            minMaxTrees[i].Build(quantizedMaps[i].data(), quantizedSamplers[i].GetExtent());
+        }
+        return (uint64_t)quantizedMaps.size();
+    }, results);
+
+    RunBench(opt, "ElevationMinMaxTree::Build (scalar)", "tiles", nullptr, [&]()
+    {
+        for (size_t i = 0; i < quantizedMaps.size(); ++i)
+        {
+            detail::BuildMinMaxTreeScalar(minMaxTrees[i], quantizedMaps[i].data(), quantizedSamplers[i].GetExtent());
+        }
+        return (uint64_t)quantizedMaps.size();
+    }, results);
+
+    RunBench(opt, "ElevationMinMaxTree::GetRange", "queries", nullptr, [&]()
+    {
+        int sum = 0;
+        for (const auto& tree : minMaxTrees)
+        {
+            for (const auto& q : rangeQueries)
+            {
+                int16_t minValue = 0, maxValue = 0;
+                tree.GetRange(q.X0, q.Y0, q.X1, q.Y1, minValue, maxValue);
+                sum += maxValue - minValue;
+            }
+        }
+        sampleZ[0] = (float)sum;
+        return (uint64_t)(minMaxTrees.size() * rangeQueries.size());
+    }, results);
+
+    // the baseline: scanning the samples, over a part of the queries only, they're that slow
+    const size_t numScannedQueries = 256;
+    RunBench(opt, "ElevationMinMaxTree::GetRange (full scan)", "queries", nullptr, [&]()
+    {
+        int sum = 0;
+        for (size_t i = 0; i < quantizedMaps.size(); ++i)
+        {
+            const unsigned int extent = quantizedSamplers[i].GetExtent();
+            for (size_t qi = 0; qi < numScannedQueries; ++qi)
+            {
+                const RangeQuery& q = rangeQueries[qi];
+                int16_t minValue = 32767, maxValue = -32768;
+                for (int y = q.Y0; y <= q.Y1; ++y)
+                {
+                    const int16_t* pRow = &quantizedMaps[i][(size_t)y * extent];
+                    auto range = std::minmax_element(pRow + q.X0, pRow + q.X1 + 1);
+                    minValue = std::min(minValue, *range.first);
+                    maxValue = std::max(maxValue, *range.second);
+                }
+                sum += maxValue - minValue;
+            }
+        }
+        sampleZ[0] = (float)sum;
+        return (uint64_t)(quantizedMaps.size() * numScannedQueries);
+    }, results);
+
+    RunBench(opt, "ComputeNormalGrid", "tiles", nullptr, [&]()
+    {
+        std::vector<int8_t> normals;
+        for (size_t i = 0; i < elevationMaps.size(); ++i)
+        {
+            const unsigned int sampleExtent = quantizedSamplers[i].GetExtent();
+            ComputeNormalGrid(elevationMaps[i].data() + sampleExtent + 1, sampleExtent, sampleExtent - 2, 1.0f, 1.0f, normals);
+        }
+        return (uint64_t)elevationMaps.size();
+    }, results);
+
+    RunBench(opt, "ComputeNormalGrid (scalar)", "tiles", nullptr, [&]()
+    {
+        std::vector<int8_t> normals;
+        for (size_t i = 0; i < elevationMaps.size(); ++i)
+        {
+            const unsigned int sampleExtent = quantizedSamplers[i].GetExtent();
+            detail::ComputeNormalGridScalar(elevationMaps[i].data() + sampleExtent + 1, sampleExtent, sampleExtent - 2, 1.0f, 1.0f, normals);
+        }
+        return (uint64_t)elevationMaps.size();
+    }, results);
+
+    RunBench(opt, "TesselatePolygon", "tris", nullptr, [&]()
+    {
+        uint64_t numTris = 0;
+        for (const auto& p : polygons)
+        {
+            std::vector<uint32_t> indices;
+            std::vector<float> vertices;
+            TesselatePolygon(*p.pPolygon, indices, vertices);
+            numTris += indices.size() / 3;
+        }
+        return numTris;
+    }, results);
+
+    RunBench(opt, "SubdivideMesh", "tris", nullptr, [&]()
+    {
+        uint64_t numTris = 0;
+        for (const auto& m : coarseMeshes)
+        {
+            std::vector<uint32_t> indices;
+            std::vector<float> vertices;
+            SubdivideMesh(m.Indices, m.Vertices, maxEdgeLength, indices, vertices);
+            numTris += indices.size() / 3;
+        }
+        return numTris;
+    }, results);
+
+    RunBench(opt, "SubdivideMesh (edge map adjacency)", "tris", nullptr, [&]()
+    {
+        uint64_t numTris = 0;
+        for (const auto& m : coarseMeshes)
+        {
+            std::vector<uint32_t> indices;
+            std::vector<float> vertices;
+            detail::SubdivideMeshEdgeMap(m.Indices, m.Vertices, maxEdgeLength, indices, vertices);
+            numTris += indices.size() / 3;
+        }
+        return numTris;
+    }, results);
+
+    RunBench(opt, "ConstructMesh", "tris", nullptr, [&]()
+    {
+        uint64_t numTris = 0;
+        for (size_t i = 0; i < polygons.size(); ++i)
+        {
+            std::vector<float> vertices;
+            ConstructMesh(polygons[i].ZoomLevel, fineMeshes[i].Indices, fineMeshes[i].Vertices, samplers[polygons[i].TileId], vertices);
+            numTris += fineMeshes[i].Indices.size() / 3;
+        }
+        return numTris;
+    }, results);
+
+    RunBench(opt, "ConstructMesh (normal grid)", "tris", nullptr, [&]()
+    {
+        uint64_t numTris = 0;
+        for (size_t i = 0; i < polygons.size(); ++i)
+        {
+            std::vector<float> vertices;
+            ConstructMesh(polygons[i].ZoomLevel, fineMeshes[i].Vertices, samplers[polygons[i].TileId], normalSamplers[polygons[i].TileId], vertices);
+            numTris += fineMeshes[i].Indices.size() / 3;
+        }
+        return numTris;
+    }, results);
+
+    std::vector<std::vector<SceneMeshes::TileMeshes::MeshData>> layerMeshes(numMeshLayers);
+    for (size_t i = 0; i < polygons.size(); ++i)
+    {
+        SceneMeshes::TileMeshes::MeshData mesh;
+        mesh.Indices = fineMeshes[i].Indices;
+        ConstructMesh(polygons[i].ZoomLevel, fineMeshes[i].Indices, fineMeshes[i].Vertices, samplers[polygons[i].TileId], mesh.Vertices);
+        mesh.Bounds = ComputeMeshBounds(mesh.Vertices);
+        layerMeshes[polygons[i].LayerId].push_back(std::move(mesh));
+    }
+
+    // Merging replaces the polygon meshes, so every iteration works on a fresh copy of them
+    std::vector<std::vector<SceneMeshes::TileMeshes::MeshData>> mergeMeshes;
+    RunBench(opt, "MergeMeshes", "tiles", [&]()
+    {
+        mergeMeshes = layerMeshes;
+    }, [&]()
+    {
+        for (auto& m : mergeMeshes)
+        {
+            Scene::MergeMeshes(m);
+        }
+        return (uint64_t)tileInputs.size();
+    }, results);
+
+    // Stitching modifies the meshes, so every iteration works on a fresh copy of the loaded tiles
+    struct StitchPair
+    {
+        SceneMeshes::TileMeshes* pTileA;
+        SceneMeshes::TileMeshes* pTileB;
+        StitchSide Side;
+    };
+    std::map<int, SceneMeshes::ZoomLevel> stitchLevels;
+    std::vector<StitchPair> stitchPairs;
+    uint64_t numStitchTiles = 0;
+    RunBench(opt, "StitchMeshes", "tiles", [&]()
+    {
+        stitchLevels = refScene.GetData().ZoomLevels;
+        stitchPairs.clear();
+        numStitchTiles = 0;
+        for (auto& zl : stitchLevels)
+        {
+            auto& levelTiles = zl.second.Tiles;
+            std::map<std::pair<int, int>, SceneMeshes::TileMeshes*> tilesByPos;
+            for (auto& t : levelTiles)
+            {
+                tilesByPos[{ t.TileX, t.TileY }] = &t;
+            }
+            for (auto& a : levelTiles)
+            {
+                auto right = tilesByPos.find({ a.TileX + 1, a.TileY });
+                if (right != tilesByPos.end())
+                {
+                    stitchPairs.push_back({ &a, right->second, STITCH_VER });
+                }
+                auto below = tilesByPos.find({ a.TileX, a.TileY + 1 });
+                if (below != tilesByPos.end())
+                {
+                    stitchPairs.push_back({ &a, below->second, STITCH_HOR });
+                }
+            }
+            if (levelTiles.size() > 1)
+            {
+                numStitchTiles += levelTiles.size();
+            }
+        }
+    }, [&]()
+    {
+        for (const auto& sp : stitchPairs)
+        {
+            Scene::StitchMeshes(sp.pTileA->TerrainMeshes, sp.pTileB->TerrainMeshes, sp.Side);
+            Scene::StitchMeshes(sp.pTileA->WaterMeshes, sp.pTileB->WaterMeshes, sp.Side);
+            Scene::StitchMeshes(sp.pTileA->LanduseMeshes, sp.pTileB->LanduseMeshes, sp.Side);
+        }
+        return numStitchTiles;
+    }, results);
+
+    RunBench(opt, "Scene::Load (stitched)", "tiles", nullptr, [&]()
+    {
+        Scene scene;
+        scene.SetRawElevationFiles(true, rawPath);
+        scene.SetTileStitching(true);
+        scene.Load(assetsPath, numThreads);
+        return scene.GetLoadStats().NumTiles;
+    }, results);
+
+    RunBench(opt, "Scene::Load", "tiles", nullptr, [&]()
+    {
+        Scene scene;
+        scene.SetRawElevationFiles(true, rawPath);
+        scene.Load(assetsPath, numThreads);
+        return scene.GetLoadStats().NumTiles;
+    }, results);
+
+    RunBench(opt, "Scene::Load (no raw DEMs)", "tiles", nullptr, [&]()
+    {
+        Scene scene;
+        scene.SetRawElevationFiles(false);
+        scene.Load(assetsPath, numThreads);
+        return scene.GetLoadStats().NumTiles;
+    }, results);
+
+    if (!jsonPath.empty())
+    {
+        FILE* pFile = jsonPath == "-" ? stdout : fopen(jsonPath.c_str(), "w");
+        if (!pFile)
+        {
+            std::cerr << "Can't write " << jsonPath << '\n';
+            return 1;
+        }
+        WriteJson(pFile, opt, numThreads, results);
+        if (pFile != stdout)
+        {
+            fclose(pFile);
+        }
+    }
+
+    return 0;
+}
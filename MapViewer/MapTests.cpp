@@ -0,0 +1,1119 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <sstream>
+
+#include <clara.hpp>
+
+#include "VTZeroRead.h"
+#include "Tesselator.h"
+#include "ElevationMap.h"
+#include "ElevationMinMax.h"
+#include "ElevationCache.h"
+#include "ElevationRawFile.h"
+#include "ElevationSampler.h"
+#include "NormalGrid.h"
+#include "MappedFile.h"
+#include "MeshSubdivision.h"
+#include "MeshConstructor.h"
+#include "Scene.h"
+#include "SceneCache.h"
+#include "Culling.h"
+#include "ReferenceKernels.h"
+#include "Utils.h"
+
+
+static const double DEGREES_PER_RADIAN = 180.0 / 3.14159265358979323846;
+
+static int g_NumFailures = 0;
+
+static void ReportFailure(const char* _File, int _Line, const char* _Condition, const std::string& _Context)
+{
+    fprintf(stderr, "%s:%d: check failed: %s (%s)\n", _File, _Line, _Condition, _Context.c_str());
+    ++g_NumFailures;
+}
+
+// Reports a failed condition and goes on with the test, _Context tells what was checked
+#define CHECK(_Condition, _Context) \
+    do { if (!(_Condition)) { ReportFailure(__FILE__, __LINE__, #_Condition, _Context); } } while (0)
+
+
+// DEM of a tile of the scene, decoded with its border the same way as the tiles of ElevationCache
+struct TileData
+{
+    int ZoomLevel;
+    int TileX;
+    int TileY;
+    std::string DemFilename;
+    std::string MvtFilename;
+    MappedFilePtr pDem;
+    unsigned int Extent = 0;
+    std::vector<float> Elevations;
+    std::vector<int16_t> Samples;
+    float QuantScale = 1.0f;
+    float QuantOffset = 0.0f;
+    // normals of the first ring of the border
+    std::vector<int8_t> Normals;
+
+    unsigned int GetSampleExtent() const { return Extent + 2 * ELEVATION_TILE_BORDER; }
+    unsigned int GetNormalExtent() const { return Extent + 2 * (ELEVATION_TILE_BORDER - 1); }
+
+    ElevationSampler GetSampler() const
+    {
+        const ElevationWindow window = GetElevationWindow(Extent, ELEVATION_TILE_BORDER);
+        return ElevationSampler(Elevations.data(), GetSampleExtent(), window.Scale, window.OffsetX, window.OffsetY);
+    }
+
+    QuantizedElevationSampler GetQuantizedSampler() const
+    {
+        const ElevationWindow window = GetElevationWindow(Extent, ELEVATION_TILE_BORDER);
+        QuantizedElevationSampler sampler(Samples.data(), GetSampleExtent(), window.Scale, window.OffsetX, window.OffsetY);
+        sampler.SetQuantization(QuantScale, QuantOffset);
+        return sampler;
+    }
+
+    NormalGridSampler GetNormalSampler() const
+    {
+        const ElevationWindow window = GetElevationWindow(Extent, ELEVATION_TILE_BORDER - 1);
+        return NormalGridSampler(Normals.data(), GetNormalExtent(), window.Scale, window.OffsetX, window.OffsetY);
+    }
+};
+
+struct TestContext
+{
+    std::string AssetsPath;
+    std::vector<TileData> Tiles;
+    std::vector<std::string> MeshLayers;
+    float MaxEdgeLength = 0.0f;
+};
+
+
+static std::string GetDemFilename(const std::string& _Directory, int _Zoom, int _X, int _Y, const char* _Extension)
+{
+    std::stringstream filename;
+    filename << _Directory << "dem_" << _Zoom << "_" << _X << "_" << _Y << _Extension;
+    return filename.str();
+}
+
+
+static bool LoadTiles(const std::string& _AssetsPath, TestContext& _OutContext)
+{
+    // the scene only provides the tile list and the mesh parameters, nothing is loaded
+    Scene scene;
+    _OutContext.AssetsPath = _AssetsPath;
+    _OutContext.MeshLayers = scene.GetMeshLayers();
+    _OutContext.MaxEdgeLength = scene.GetMaxEdgeLength();
+    for (const auto& zl : scene.GetZoomLevelConfigs())
+    {
+        for (const auto& tc : zl.TileCoords)
+        {
+            std::stringstream suffix;
+            suffix << zl.ZoomLevel << "_" << tc.TileCoordX << "_" << tc.TileCoordY;
+            TileData tile;
+            tile.ZoomLevel = zl.ZoomLevel;
+            tile.TileX = tc.TileCoordX;
+            tile.TileY = tc.TileCoordY;
+            tile.DemFilename = _AssetsPath + "dem/dem_" + suffix.str() + ".png";
+            tile.MvtFilename = _AssetsPath + "mvt/mvt_" + suffix.str() + ".mvt";
+            tile.pDem = MappedFile::Load(tile.DemFilename);
+            if (!tile.pDem ||
+                !LoadTerrariumElevationMap(tile.pDem->GetData(), tile.pDem->GetSize(), tile.Extent, tile.Elevations, ELEVATION_TILE_BORDER))
+            {
+                std::cerr << "Failed to load " << tile.DemFilename << '\n';
+                return false;
+            }
+            QuantizeElevationMap(tile.Elevations, tile.Samples, tile.QuantScale, tile.QuantOffset);
+            const unsigned int sampleExtent = tile.GetSampleExtent();
+            ComputeNormalGrid(tile.Elevations.data() + sampleExtent + 1, sampleExtent, tile.GetNormalExtent(),
+                VECTOR_TILE_EXTENT / (float)tile.Extent, GetElevationScale(tile.ZoomLevel), tile.Normals);
+            _OutContext.Tiles.push_back(std::move(tile));
+        }
+    }
+    return !_OutContext.Tiles.empty();
+}
+
+
+// Tiles of the highest zoom level, their DEMs are never derived from other ones
+static std::vector<const TileData*> GetLeafTiles(const TestContext& _Ctx)
+{
+    std::vector<const TileData*> leafTiles;
+    for (const auto& t : _Ctx.Tiles)
+    {
+        if (!leafTiles.empty() && t.ZoomLevel > leafTiles[0]->ZoomLevel)
+        {
+            leafTiles.clear();
+        }
+        if (leafTiles.empty() || t.ZoomLevel == leafTiles[0]->ZoomLevel)
+        {
+            leafTiles.push_back(&t);
+        }
+    }
+    return leafTiles;
+}
+
+
+// The SIMD elevation decoding has to match the scalar reference bit for bit
+static void TestElevationDecoding(const TestContext& _Ctx)
+{
+    for (const auto& t : _Ctx.Tiles)
+    {
+        unsigned int extent = 0;
+        std::vector<float> reference;
+        CHECK(detail::LoadTerrariumElevationMapScalar(t.pDem->GetData(), t.pDem->GetSize(), extent, reference, ELEVATION_TILE_BORDER), t.DemFilename);
+        CHECK(extent == t.Extent && reference.size() == t.Elevations.size() &&
+            memcmp(reference.data(), t.Elevations.data(), reference.size() * sizeof(float)) == 0, t.DemFilename);
+    }
+}
+
+
+// A truncated PNG fails through the error jump of libpng, the buffers of the decoding are still freed
+static void TestTruncatedDem(const TestContext& _Ctx)
+{
+    const TileData& t = _Ctx.Tiles.front();
+    for (size_t size : { (size_t)7, (size_t)64, t.pDem->GetSize() / 2, t.pDem->GetSize() - 16 })
+    {
+        unsigned int extent = 0;
+        std::vector<float> elevations;
+        CHECK(!LoadTerrariumElevationMap(t.pDem->GetData(), size, extent, elevations, ELEVATION_TILE_BORDER),
+            t.DemFilename + " cut at " + std::to_string(size));
+    }
+}
+
+
+// The SIMD normal kernel has to match the scalar one bit for bit
+static void TestNormalGrid(const TestContext& _Ctx)
+{
+    for (const auto& t : _Ctx.Tiles)
+    {
+        const unsigned int sampleExtent = t.GetSampleExtent();
+        std::vector<int8_t> reference;
+        detail::ComputeNormalGridScalar(t.Elevations.data() + sampleExtent + 1, sampleExtent, t.GetNormalExtent(),
+            VECTOR_TILE_EXTENT / (float)t.Extent, GetElevationScale(t.ZoomLevel), reference);
+        CHECK(reference == t.Normals, t.DemFilename);
+    }
+}
+
+
+// The batched samplers have to match the scalar ones bit for bit, over the tiles and a bit outside of them
+static void TestElevationSampling(const TestContext& _Ctx)
+{
+    const size_t numSamples = 16384;
+    std::vector<float> sampleX(numSamples);
+    std::vector<float> sampleY(numSamples);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < numSamples; ++i)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        sampleX[i] = (float)(seed >> 8) / (float)(1 << 24) * 8400.0f - 100.0f;
+        seed = seed * 1664525u + 1013904223u;
+        sampleY[i] = (float)(seed >> 8) / (float)(1 << 24) * 8400.0f - 100.0f;
+    }
+    const Span<const float> x(sampleX.data(), numSamples);
+    const Span<const float> y(sampleY.data(), numSamples);
+
+    std::vector<float> sampleZ(numSamples);
+    std::vector<float> quantizedZ(numSamples);
+    std::vector<float> referenceZ(numSamples);
+    float maxQuantizationError = 0.0f;
+    for (const auto& t : _Ctx.Tiles)
+    {
+        const ElevationSampler sampler = t.GetSampler();
+        sampler.Sample(x, y, Span<float>(sampleZ.data(), numSamples));
+        detail::SampleElevationsScalar(sampler, x, y, Span<float>(referenceZ.data(), numSamples));
+        CHECK(memcmp(sampleZ.data(), referenceZ.data(), numSamples * sizeof(float)) == 0, t.DemFilename);
+
+        const QuantizedElevationSampler quantizedSampler = t.GetQuantizedSampler();
+        quantizedSampler.Sample(x, y, Span<float>(quantizedZ.data(), numSamples));
+        detail::SampleElevationsScalar(quantizedSampler, x, y, Span<float>(referenceZ.data(), numSamples));
+        CHECK(memcmp(quantizedZ.data(), referenceZ.data(), numSamples * sizeof(float)) == 0, t.DemFilename);
+
+        float maxError = 0.0f;
+        for (size_t s = 0; s < numSamples; ++s)
+        {
+            maxError = std::max(maxError, fabsf(quantizedZ[s] - sampleZ[s]));
+        }
+        // half a quantization step and the rounding of the interpolation
+        CHECK(maxError <= t.QuantScale, t.DemFilename);
+        maxQuantizationError = std::max(maxQuantizationError, maxError);
+    }
+    printf("  int16 elevations: max error %.4f m\n", maxQuantizationError);
+}
+
+
+// WGS84 position of a point given in the tile coordinates of a Web Mercator tile
+static void GetLonLat(int _Zoom, int _TileX, int _TileY, float _X, float _Y, double& _OutLon, double& _OutLat)
+{
+    const double numTiles = (double)(1 << _Zoom);
+    const double x = (_TileX + _X / (double)VECTOR_TILE_EXTENT) / numTiles;
+    const double y = (_TileY + _Y / (double)VECTOR_TILE_EXTENT) / numTiles;
+    _OutLon = x * 360.0 - 180.0;
+    _OutLat = atan(sinh(3.14159265358979323846 * (1.0 - 2.0 * y))) * DEGREES_PER_RADIAN;
+}
+
+
+// The elevations of geographic points have to be the ones of their tiles, sampled at their tile positions
+static void TestGeoSampling(const TestContext& _Ctx)
+{
+    const std::vector<const TileData*> leafTiles = GetLeafTiles(_Ctx);
+    CHECK(!leafTiles.empty(), "leaf tiles");
+    if (leafTiles.empty())
+    {
+        return;
+    }
+    const int zoom = leafTiles[0]->ZoomLevel;
+
+    // a grid of points in every tile, the tiles interleaved so the points have to be grouped by tile
+    const int gridSize = 16;
+    std::vector<double> lon;
+    std::vector<double> lat;
+    std::vector<float> expected;
+    for (int p = 0; p < gridSize * gridSize; ++p)
+    {
+        for (const TileData* pTile : leafTiles)
+        {
+            const float x = ((p % gridSize) + 0.5f) * VECTOR_TILE_EXTENT / gridSize;
+            const float y = ((p / gridSize) + 0.5f) * VECTOR_TILE_EXTENT / gridSize;
+            double pointLon = 0.0;
+            double pointLat = 0.0;
+            GetLonLat(zoom, pTile->TileX, pTile->TileY, x, y, pointLon, pointLat);
+            int tileX = -1;
+            int tileY = -1;
+            float tilePosX = 0.0f;
+            float tilePosY = 0.0f;
+            GetTilePosition(zoom, pointLon, pointLat, tileX, tileY, tilePosX, tilePosY);
+            CHECK(tileX == pTile->TileX && tileY == pTile->TileY && fabsf(tilePosX - x) < 0.01f && fabsf(tilePosY - y) < 0.01f,
+                pTile->DemFilename);
+            lon.push_back(pointLon);
+            lat.push_back(pointLat);
+            expected.push_back(pTile->GetQuantizedSampler().Sample(x, y));
+        }
+    }
+    // the other side of the world has no DEM
+    lon.push_back(-lon[0]);
+    lat.push_back(-lat[0]);
+    const size_t numPoints = lon.size();
+    const Span<const double> lonSpan(lon.data(), numPoints);
+    const Span<const double> latSpan(lat.data(), numPoints);
+
+    const std::string demPath = _Ctx.AssetsPath + "dem/";
+    ElevationCache cache([&demPath](int _Zoom, int _X, int _Y) { return GetDemFilename(demPath, _Zoom, _X, _Y, ".png"); });
+    std::vector<float> elevations(numPoints);
+    std::vector<float> ancestorElevations(numPoints);
+    cache.SampleElevations(zoom, 0, lonSpan, latSpan, Span<float>(elevations.data(), numPoints));
+    // the level below has no DEMs, it samples the same tiles through their windows
+    cache.SampleElevations(zoom + 1, 1, lonSpan, latSpan, Span<float>(ancestorElevations.data(), numPoints));
+    CHECK(cache.GetStats().Decodes == leafTiles.size(), "one decode per tile");
+
+    Scene scene;
+    scene.SetRawElevationFiles(false);
+    CHECK(scene.Load(_Ctx.AssetsPath), _Ctx.AssetsPath);
+    std::vector<float> sceneElevations(numPoints);
+    scene.SampleElevations(zoom, lonSpan, latSpan, Span<float>(sceneElevations.data(), numPoints));
+
+    float maxError = 0.0f;
+    for (size_t i = 0; i + 1 < numPoints; ++i)
+    {
+        maxError = std::max(maxError, fabsf(elevations[i] - expected[i]));
+        maxError = std::max(maxError, fabsf(ancestorElevations[i] - expected[i]));
+        maxError = std::max(maxError, fabsf(sceneElevations[i] - expected[i]));
+    }
+    printf("  geographic points: max error %.4f m\n", maxError);
+    CHECK(maxError < 0.05f, "elevations of the points");
+    CHECK(isnan(elevations.back()) && isnan(ancestorElevations.back()) && isnan(sceneElevations.back()), "point without DEM");
+}
+
+
+// The raw DEM files have to hold the same samples and normals as the PNGs
+static void TestRawFiles(const TestContext& _Ctx)
+{
+    TempDirectory rawDirectory("maptests");
+    CHECK(!rawDirectory.GetPath().empty(), "temp directory");
+    const std::string demPath = _Ctx.AssetsPath + "dem/";
+    const std::string& rawPath = rawDirectory.GetPath();
+    auto pngFilename = [&demPath](int _Zoom, int _X, int _Y) { return GetDemFilename(demPath, _Zoom, _X, _Y, ".png"); };
+    auto rawFilename = [&rawPath](int _Zoom, int _X, int _Y) { return GetDemFilename(rawPath, _Zoom, _X, _Y, ".raw"); };
+
+    ElevationCache writeCache(pngFilename);
+    writeCache.SetRawFilename(rawFilename);
+    for (const auto& t : _Ctx.Tiles)
+    {
+        writeCache.Get(t.ZoomLevel, t.TileX, t.TileY);
+    }
+    CHECK(writeCache.GetStats().Decodes == _Ctx.Tiles.size(), "all of the tiles decoded from their PNGs");
+    // the normals depend on the elevation scale of the zoom level, so the same PNG gets another key on another level
+    const TileData& t0 = _Ctx.Tiles[0];
+    CHECK(ComputeElevationRawKey(t0.pDem->GetData(), t0.pDem->GetSize(), 13) != ComputeElevationRawKey(t0.pDem->GetData(), t0.pDem->GetSize(), 14),
+        "raw keys of the zoom levels");
+
+    ElevationCache rawCache(pngFilename);
+    rawCache.SetRawFilename(rawFilename);
+    for (const auto& t : _Ctx.Tiles)
+    {
+        ElevationTilePtr pTile = rawCache.Get(t.ZoomLevel, t.TileX, t.TileY);
+        CHECK(pTile && pTile->pRawFile, t.DemFilename);
+        if (!pTile)
+        {
+            continue;
+        }
+        CHECK(pTile->Samples.size() == t.Samples.size() &&
+            memcmp(pTile->Samples.data(), t.Samples.data(), t.Samples.size() * sizeof(int16_t)) == 0, t.DemFilename);
+        CHECK(pTile->Normals.size() == t.Normals.size() &&
+            memcmp(pTile->Normals.data(), t.Normals.data(), t.Normals.size()) == 0, t.DemFilename);
+    }
+}
+
+
+// The neighbour tiles have to agree on the elevations and the normals along their shared edges,
+// with the zoom levels downsampled the same way as in the scene
+static void TestTileSeams(const TestContext& _Ctx)
+{
+    int leafZoom = -1;
+    for (const auto& t : _Ctx.Tiles)
+    {
+        leafZoom = std::max(leafZoom, t.ZoomLevel);
+    }
+    const std::string demPath = _Ctx.AssetsPath + "dem/";
+    ElevationCache seamCache([&demPath](int _Zoom, int _X, int _Y) { return GetDemFilename(demPath, _Zoom, _X, _Y, ".png"); });
+    seamCache.SetLeafZoom(leafZoom);
+
+    const size_t numEdgeSamples = 1024;
+    std::vector<float> edgeA(numEdgeSamples), edgeB(numEdgeSamples), along(numEdgeSamples);
+    std::vector<float> elevationA(numEdgeSamples), elevationB(numEdgeSamples);
+    std::vector<float> normalA(numEdgeSamples * 3), normalB(numEdgeSamples * 3);
+    for (size_t s = 0; s < numEdgeSamples; ++s)
+    {
+        edgeA[s] = VECTOR_TILE_EXTENT;
+        edgeB[s] = 0.0f;
+        along[s] = VECTOR_TILE_EXTENT * (float)s / (float)(numEdgeSamples - 1);
+    }
+    struct SeamError
+    {
+        float MaxElevation = 0.0f;
+        float MaxAngle = 0.0f;
+        double SumAngle = 0.0;
+        size_t NumSamples = 0;
+    };
+    std::map<int, SeamError> seamErrors;
+    for (const auto& a : _Ctx.Tiles)
+    {
+        for (const auto& b : _Ctx.Tiles)
+        {
+            const bool bRight = b.TileX == a.TileX + 1 && b.TileY == a.TileY;
+            const bool bBelow = b.TileX == a.TileX && b.TileY == a.TileY + 1;
+            if (b.ZoomLevel != a.ZoomLevel || (!bRight && !bBelow))
+            {
+                continue;
+            }
+            ElevationTilePtr pA = seamCache.Get(a.ZoomLevel, a.TileX, a.TileY);
+            ElevationTilePtr pB = seamCache.Get(b.ZoomLevel, b.TileX, b.TileY);
+            CHECK(pA && pB, a.DemFilename + " / " + b.DemFilename);
+            if (!pA || !pB)
+            {
+                continue;
+            }
+            const Span<const float> xA(bRight ? edgeA.data() : along.data(), numEdgeSamples);
+            const Span<const float> yA(bRight ? along.data() : edgeA.data(), numEdgeSamples);
+            const Span<const float> xB(bRight ? edgeB.data() : along.data(), numEdgeSamples);
+            const Span<const float> yB(bRight ? along.data() : edgeB.data(), numEdgeSamples);
+            pA->GetSampler().Sample(xA, yA, Span<float>(elevationA.data(), numEdgeSamples));
+            pB->GetSampler().Sample(xB, yB, Span<float>(elevationB.data(), numEdgeSamples));
+            pA->GetNormalSampler().Sample(xA, yA, Span<float>(&normalA[0], numEdgeSamples),
+                Span<float>(&normalA[numEdgeSamples], numEdgeSamples), Span<float>(&normalA[numEdgeSamples * 2], numEdgeSamples));
+            pB->GetNormalSampler().Sample(xB, yB, Span<float>(&normalB[0], numEdgeSamples),
+                Span<float>(&normalB[numEdgeSamples], numEdgeSamples), Span<float>(&normalB[numEdgeSamples * 2], numEdgeSamples));
+            auto& errors = seamErrors[a.ZoomLevel];
+            for (size_t s = 0; s < numEdgeSamples; ++s)
+            {
+                float cosAngle = 0.0f;
+                for (size_t c = 0; c < 3; ++c)
+                {
+                    cosAngle += normalA[c * numEdgeSamples + s] * normalB[c * numEdgeSamples + s];
+                }
+                const float angle = (float)(acos(std::min(std::max(cosAngle, -1.0f), 1.0f)) * DEGREES_PER_RADIAN);
+                errors.MaxElevation = std::max(errors.MaxElevation, fabsf(elevationA[s] - elevationB[s]));
+                errors.MaxAngle = std::max(errors.MaxAngle, angle);
+                errors.SumAngle += angle;
+                ++errors.NumSamples;
+            }
+        }
+    }
+    CHECK(!seamErrors.empty(), "neighbour tiles");
+    for (const auto& e : seamErrors)
+    {
+        printf("  tile edges of zoom %d: max elevation difference %.3f m, normal angle mean %.2f deg, max %.2f deg\n", e.first,
+            e.second.MaxElevation, e.second.SumAngle / e.second.NumSamples, e.second.MaxAngle);
+        // both sides sample the same DEM pixels, only the int16 quantization of each tile differs
+        CHECK(e.second.MaxElevation < 0.05f, "elevations along the edges of zoom " + std::to_string(e.first));
+        CHECK(e.second.SumAngle / e.second.NumSamples < 1.0, "normals along the edges of zoom " + std::to_string(e.first));
+    }
+}
+
+
+// Parents downsampled from their 4 children: SIMD against scalar and the difference to the shipped parent DEMs
+static void TestDownsampling(const TestContext& _Ctx)
+{
+    float maxDifference = 0.0f;
+    double sumDifference = 0.0;
+    size_t numSamples = 0;
+    size_t numParents = 0;
+    for (const auto& p : _Ctx.Tiles)
+    {
+        QuantizedElevationMapView children[4];
+        int numChildren = 0;
+        for (const auto& c : _Ctx.Tiles)
+        {
+            if (c.ZoomLevel == p.ZoomLevel + 1 && c.TileX / 2 == p.TileX && c.TileY / 2 == p.TileY)
+            {
+                children[(c.TileX - p.TileX * 2) + (c.TileY - p.TileY * 2) * 2] = { c.Samples.data(), c.QuantScale, c.QuantOffset };
+                ++numChildren;
+            }
+        }
+        if (numChildren != 4)
+        {
+            continue;
+        }
+        ++numParents;
+
+        std::vector<float> parent;
+        std::vector<float> reference;
+        DownsampleElevationMaps(children, p.Extent, parent, ELEVATION_TILE_BORDER);
+        detail::DownsampleElevationMapsScalar(children, p.Extent, reference, ELEVATION_TILE_BORDER);
+        CHECK(parent.size() == p.Elevations.size() && parent.size() == reference.size() &&
+            memcmp(parent.data(), reference.data(), parent.size() * sizeof(float)) == 0, p.DemFilename);
+        if (parent.size() != p.Elevations.size())
+        {
+            continue;
+        }
+        // the pixels of the tile, the border is extrapolated
+        const size_t stride = p.GetSampleExtent();
+        for (size_t y = ELEVATION_TILE_BORDER; y < p.Extent + ELEVATION_TILE_BORDER; ++y)
+        {
+            for (size_t x = ELEVATION_TILE_BORDER; x < p.Extent + ELEVATION_TILE_BORDER; ++x)
+            {
+                const float difference = fabsf(parent[y * stride + x] - p.Elevations[y * stride + x]);
+                maxDifference = std::max(maxDifference, difference);
+                sumDifference += difference;
+            }
+        }
+        numSamples += (size_t)p.Extent * p.Extent;
+    }
+    CHECK(numParents > 0, "parents with all of their children");
+    printf("  downsampled parent DEMs: %zu, difference to the shipped ones: mean %.2f m, max %.2f m\n", numParents,
+        numSamples > 0 ? sumDifference / numSamples : 0.0, maxDifference);
+}
+
+
+// The ranges of the min/max tree have to embrace the exact ones (and be exact for the whole map),
+// the SIMD build has to match the scalar one
+static void TestMinMaxTree(const TestContext& _Ctx)
+{
+    double rangeSlack = 0.0;
+    size_t numQueries = 0;
+    uint32_t seed = 4321;
+    for (const auto& t : _Ctx.Tiles)
+    {
+        const unsigned int extent = t.GetSampleExtent();
+        ElevationMinMaxTree tree;
+        ElevationMinMaxTree reference;
+        tree.Build(t.Samples.data(), extent);
+        detail::BuildMinMaxTreeScalar(reference, t.Samples.data(), extent);
+        for (int i = 0; i <= 1024; ++i)
+        {
+            // single samples up to the whole map, the last query
+            int x0 = 0, y0 = 0, size = (int)extent;
+            if (i < 1024)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                size = 1 + (int)((seed >> 8) % extent);
+                seed = seed * 1664525u + 1013904223u;
+                x0 = (int)((seed >> 8) % (extent - size + 1));
+                seed = seed * 1664525u + 1013904223u;
+                y0 = (int)((seed >> 8) % (extent - size + 1));
+            }
+            const int x1 = x0 + size - 1;
+            const int y1 = y0 + size - 1;
+
+            int16_t minValue = 0, maxValue = 0, refMin = 0, refMax = 0;
+            tree.GetRange(x0, y0, x1, y1, minValue, maxValue);
+            reference.GetRange(x0, y0, x1, y1, refMin, refMax);
+            int16_t exactMin = 32767, exactMax = -32768;
+            for (int y = y0; y <= y1; ++y)
+            {
+                for (int x = x0; x <= x1; ++x)
+                {
+                    exactMin = std::min(exactMin, t.Samples[(size_t)y * extent + x]);
+                    exactMax = std::max(exactMax, t.Samples[(size_t)y * extent + x]);
+                }
+            }
+            CHECK(minValue == refMin && maxValue == refMax, t.DemFilename);
+            CHECK(minValue <= exactMin && maxValue >= exactMax, t.DemFilename);
+            if (size == (int)extent)
+            {
+                CHECK(minValue == exactMin && maxValue == exactMax, t.DemFilename);
+            }
+            rangeSlack += (double)((exactMin - minValue) + (maxValue - exactMax)) * t.QuantScale;
+            ++numQueries;
+        }
+    }
+    printf("  min/max tree ranges: mean slack %.2f m\n", rangeSlack / (double)numQueries);
+}
+
+
+// Triangles of a 2D mesh as corner coordinates rounded to _Precision, each one starting from it's smallest corner
+// (keeping the winding), sorted, so meshes with the same triangles compare equal regardless of the vertex and index order
+static std::vector<std::array<int64_t, 6> > GetSortedTriangles(const std::vector<uint32_t>& _Indices, const std::vector<float>& _Vertices,
+    float _Precision)
+{
+    std::vector<std::array<int64_t, 6> > triangles;
+    for (size_t i = 0; i + 3 <= _Indices.size(); i += 3)
+    {
+        std::array<int64_t, 6> corners;
+        for (size_t n = 0; n < 3; ++n)
+        {
+            corners[n * 2] = llround(_Vertices[_Indices[i + n] * 2] / _Precision);
+            corners[n * 2 + 1] = llround(_Vertices[_Indices[i + n] * 2 + 1] / _Precision);
+        }
+        size_t first = 0;
+        for (size_t n = 1; n < 3; ++n)
+        {
+            if (std::make_pair(corners[n * 2], corners[n * 2 + 1]) < std::make_pair(corners[first * 2], corners[first * 2 + 1]))
+            {
+                first = n;
+            }
+        }
+        std::array<int64_t, 6> tri;
+        for (size_t n = 0; n < 3; ++n)
+        {
+            tri[n * 2] = corners[((first + n) % 3) * 2];
+            tri[n * 2 + 1] = corners[((first + n) % 3) * 2 + 1];
+        }
+        triangles.push_back(tri);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+
+// LRU eviction, single decodes for concurrent lookups, missing files and the ancestor fallback of ElevationCache
+static void TestElevationCache(const TestContext& _Ctx)
+{
+    const std::string demPath = _Ctx.AssetsPath + "dem/";
+    const std::vector<const TileData*> leafTiles = GetLeafTiles(_Ctx);
+    CHECK(leafTiles.size() >= 3, "leaf tiles");
+    if (leafTiles.size() < 3)
+    {
+        return;
+    }
+    const TileData& a = *leafTiles[0];
+    const TileData& b = *leafTiles[1];
+    const TileData& c = *leafTiles[2];
+
+    // concurrent lookups of a tile wait for the one decoding it, which holds on until all of them are waiting
+    const int numThreads = 8;
+    ElevationCache* pSharedCache = nullptr;
+    std::atomic<int> numOpens(0);
+    ElevationCache sharedCache([&](int _Zoom, int _X, int _Y)
+    {
+        ++numOpens;
+        for (int i = 0; i < 5000 && pSharedCache->GetStats().InFlightWaits < numThreads - 1; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return GetDemFilename(demPath, _Zoom, _X, _Y, ".png");
+    });
+    pSharedCache = &sharedCache;
+    std::vector<ElevationTilePtr> sharedTiles(numThreads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < numThreads; ++i)
+    {
+        threads.emplace_back([&, i]() { sharedTiles[i] = sharedCache.Get(a.ZoomLevel, a.TileX, a.TileY); });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    threads.clear();
+    ElevationCacheStats stats = sharedCache.GetStats();
+    CHECK(numOpens == 1 && stats.Decodes == 1 && stats.InFlightWaits == numThreads - 1 && stats.Hits == 0, "single decode");
+    CHECK(sharedTiles[0] && std::count(sharedTiles.begin(), sharedTiles.end(), sharedTiles[0]) == numThreads, "shared tile");
+
+    // missing files are looked up once
+    CHECK(!sharedCache.Get(0, 0, 0) && !sharedCache.Get(0, 0, 0), "missing tile");
+    stats = sharedCache.GetStats();
+    CHECK(numOpens == 2 && stats.Decodes == 1 && stats.Hits == 1, "missing tile cached");
+
+    // a tile without a DEM of it's own falls back to the nearest ancestor in the window
+    int levelsUp = -1;
+    ElevationTilePtr pAncestor = sharedCache.GetOrAncestor(a.ZoomLevel + 2, a.TileX * 4 + 3, a.TileY * 4 + 1, 2, levelsUp);
+    CHECK(pAncestor == sharedTiles[0] && levelsUp == 2, "ancestor");
+    pAncestor = sharedCache.GetOrAncestor(a.ZoomLevel + 2, a.TileX * 4 + 3, a.TileY * 4 + 1, 1, levelsUp);
+    CHECK(!pAncestor && levelsUp == 0, "ancestor out of the window");
+    pAncestor = sharedCache.GetOrAncestor(a.ZoomLevel, a.TileX, a.TileY, 2, levelsUp);
+    CHECK(pAncestor == sharedTiles[0] && levelsUp == 0, "tile itself");
+
+    // with the budget of two tiles the least recently used one goes first
+    ElevationCache lruCache([&demPath](int _Zoom, int _X, int _Y) { return GetDemFilename(demPath, _Zoom, _X, _Y, ".png"); });
+    lruCache.Get(a.ZoomLevel, a.TileX, a.TileY);
+    lruCache.Get(b.ZoomLevel, b.TileX, b.TileY);
+    const size_t twoTileBytes = lruCache.GetStats().UsedBytes;
+    lruCache.SetBudget(twoTileBytes);
+    lruCache.Get(a.ZoomLevel, a.TileX, a.TileY);
+    lruCache.Get(c.ZoomLevel, c.TileX, c.TileY);
+    stats = lruCache.GetStats();
+    CHECK(stats.Decodes == 3 && stats.Hits == 1 && stats.Evictions == 1 && stats.UsedBytes <= twoTileBytes, "eviction");
+    lruCache.Get(a.ZoomLevel, a.TileX, a.TileY);
+    CHECK(lruCache.GetStats().Hits == 2, "recently used tile kept");
+    lruCache.Get(b.ZoomLevel, b.TileX, b.TileY);
+    CHECK(lruCache.GetStats().Decodes == 4, "least recently used tile evicted");
+
+    // all of the threads walking all of the tiles, every lookup is either a hit, a wait or a decode
+    ElevationCache busyCache([&demPath](int _Zoom, int _X, int _Y) { return GetDemFilename(demPath, _Zoom, _X, _Y, ".png"); },
+        twoTileBytes);
+    std::atomic<int> numMissing(0);
+    for (int i = 0; i < numThreads; ++i)
+    {
+        threads.emplace_back([&, i]()
+        {
+            for (size_t n = 0; n < _Ctx.Tiles.size(); ++n)
+            {
+                const TileData& t = _Ctx.Tiles[(n * (i + 1)) % _Ctx.Tiles.size()];
+                if (!busyCache.Get(t.ZoomLevel, t.TileX, t.TileY))
+                {
+                    ++numMissing;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    stats = busyCache.GetStats();
+    CHECK(numMissing == 0, "tiles under a small budget");
+    CHECK(stats.Hits + stats.InFlightWaits + stats.Decodes == numThreads * _Ctx.Tiles.size(), "lookups");
+    // every tile is decoded at least once, and again after each of it's evictions
+    CHECK(stats.Evictions > 0 && stats.Decodes >= _Ctx.Tiles.size() && stats.Decodes > stats.Evictions, "decodes");
+    CHECK(stats.UsedBytes <= twoTileBytes, "budget");
+}
+
+
+// The bucketed welding of the tile seams has to give the same meshes as the comparison of all of the vertex pairs
+static void TestStitching(const TestContext& _Ctx)
+{
+    Scene scene;
+    scene.SetRawElevationFiles(false);
+    CHECK(scene.Load(_Ctx.AssetsPath), _Ctx.AssetsPath);
+
+    typedef std::vector<SceneMeshes::TileMeshes::MeshData> MeshList;
+    size_t numPairs = 0;
+    size_t numWelded = 0;
+    for (const auto& zl : scene.GetData().ZoomLevels)
+    {
+        std::vector<SceneMeshes::TileMeshes> tiles = zl.second.Tiles;
+        std::vector<SceneMeshes::TileMeshes> referenceTiles = zl.second.Tiles;
+        for (size_t a = 0; a < tiles.size(); ++a)
+        {
+            for (size_t b = 0; b < tiles.size(); ++b)
+            {
+                const bool bRight = tiles[b].TileX == tiles[a].TileX + 1 && tiles[b].TileY == tiles[a].TileY;
+                const bool bBelow = tiles[b].TileX == tiles[a].TileX && tiles[b].TileY == tiles[a].TileY + 1;
+                if (!bRight && !bBelow)
+                {
+                    continue;
+                }
+                const StitchSide side = bRight ? STITCH_VER : STITCH_HOR;
+                MeshList SceneMeshes::TileMeshes::* meshTypes[] =
+                    { &SceneMeshes::TileMeshes::TerrainMeshes, &SceneMeshes::TileMeshes::WaterMeshes, &SceneMeshes::TileMeshes::LanduseMeshes };
+                for (auto meshType : meshTypes)
+                {
+                    Scene::StitchMeshes(tiles[a].*meshType, tiles[b].*meshType, side);
+                    detail::StitchMeshesAllPairs(referenceTiles[a].*meshType, referenceTiles[b].*meshType, side);
+                }
+                ++numPairs;
+            }
+        }
+
+        for (size_t t = 0; t < tiles.size(); ++t)
+        {
+            const std::string context = "zoom " + std::to_string(zl.first) + " tile " + std::to_string(t);
+            const SceneMeshes::TileMeshes& tile = tiles[t];
+            const SceneMeshes::TileMeshes& referenceTile = referenceTiles[t];
+            const SceneMeshes::TileMeshes& loadedTile = zl.second.Tiles[t];
+            const MeshList* meshes[] = { &tile.TerrainMeshes, &tile.WaterMeshes, &tile.LanduseMeshes };
+            const MeshList* referenceMeshes[] = { &referenceTile.TerrainMeshes, &referenceTile.WaterMeshes, &referenceTile.LanduseMeshes };
+            const MeshList* loadedMeshes[] = { &loadedTile.TerrainMeshes, &loadedTile.WaterMeshes, &loadedTile.LanduseMeshes };
+            for (size_t type = 0; type < 3; ++type)
+            {
+                for (size_t m = 0; m < meshes[type]->size(); ++m)
+                {
+                    const auto& mesh = (*meshes[type])[m];
+                    const auto& reference = (*referenceMeshes[type])[m];
+                    const auto& loaded = (*loadedMeshes[type])[m];
+                    CHECK(mesh.Vertices.size() == reference.Vertices.size() &&
+                        memcmp(mesh.Vertices.data(), reference.Vertices.data(), mesh.Vertices.size() * sizeof(float)) == 0, context);
+                    CHECK(memcmp(&mesh.Bounds.GetMin(), &reference.Bounds.GetMin(), sizeof(OGVec3)) == 0 &&
+                        memcmp(&mesh.Bounds.GetMax(), &reference.Bounds.GetMax(), sizeof(OGVec3)) == 0, context);
+                    for (size_t v = 0; v + 6 <= std::min(mesh.Vertices.size(), loaded.Vertices.size()); v += 6)
+                    {
+                        if (memcmp(&mesh.Vertices[v], &loaded.Vertices[v], 6 * sizeof(float)) != 0)
+                        {
+                            ++numWelded;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    printf("  stitching: %zu neighbour pairs, %zu welded vertices\n", numPairs, numWelded);
+    CHECK(numPairs > 0 && numWelded > 0, "welded seams");
+}
+
+
+// The single pass subdivision has to give the same triangles as the original edge map adjacency path
+static void TestSubdivision(const TestContext& _Ctx)
+{
+    size_t numMeshes = 0;
+    size_t numTriangles = 0;
+    for (const auto& t : _Ctx.Tiles)
+    {
+        Tile tile;
+        CHECK(ReadTile(t.MvtFilename, _Ctx.MeshLayers, tile), t.MvtFilename);
+        for (const auto& l : tile.m_Layers)
+        {
+            for (const auto& f : l.m_Features)
+            {
+                for (const auto& p : f.m_Polygons)
+                {
+                    std::vector<uint32_t> indices, fineIndices, referenceIndices;
+                    std::vector<float> vertices, fineVertices, referenceVertices;
+                    TesselatePolygon(p, indices, vertices);
+                    const bool bSubdivided = SubdivideMesh(indices, vertices, _Ctx.MaxEdgeLength, fineIndices, fineVertices);
+                    const bool bReferenceSubdivided =
+                        detail::SubdivideMeshEdgeMap(indices, vertices, _Ctx.MaxEdgeLength, referenceIndices, referenceVertices);
+                    CHECK(bSubdivided == bReferenceSubdivided, t.MvtFilename);
+                    if (!bSubdivided || !bReferenceSubdivided)
+                    {
+                        continue;
+                    }
+
+                    CHECK(fineVertices.size() == referenceVertices.size(), t.MvtFilename);
+                    // the split points are interpolated differently, so they are compared up to a rounding error
+                    const auto triangles = GetSortedTriangles(fineIndices, fineVertices, 0.01f);
+                    const auto referenceTriangles = GetSortedTriangles(referenceIndices, referenceVertices, 0.01f);
+                    CHECK(triangles == referenceTriangles, t.MvtFilename);
+                    ++numMeshes;
+                    numTriangles += triangles.size();
+                }
+            }
+        }
+    }
+    CHECK(numMeshes > 0, "subdivided meshes");
+    printf("  subdivision: %zu meshes, %zu triangles\n", numMeshes, numTriangles);
+}
+
+
+// The normals of the grid against the ones accumulated from the triangles of the polygon meshes
+static void TestMeshNormals(const TestContext& _Ctx)
+{
+    double sumAngle = 0.0;
+    size_t numNormals = 0;
+    for (const auto& t : _Ctx.Tiles)
+    {
+        Tile tile;
+        CHECK(ReadTile(t.MvtFilename, _Ctx.MeshLayers, tile), t.MvtFilename);
+        const ElevationSampler sampler = t.GetSampler();
+        const NormalGridSampler normalSampler = t.GetNormalSampler();
+        for (const auto& l : tile.m_Layers)
+        {
+            for (const auto& f : l.m_Features)
+            {
+                for (const auto& p : f.m_Polygons)
+                {
+                    std::vector<uint32_t> indices, fineIndices;
+                    std::vector<float> vertices, fineVertices;
+                    TesselatePolygon(p, indices, vertices);
+                    if (!SubdivideMesh(indices, vertices, _Ctx.MaxEdgeLength, fineIndices, fineVertices))
+                    {
+                        fineIndices = indices;
+                        fineVertices = vertices;
+                    }
+                    std::vector<float> triangleVertices;
+                    std::vector<float> gridVertices;
+                    ConstructMesh(t.ZoomLevel, fineIndices, fineVertices, sampler, triangleVertices);
+                    ConstructMesh(t.ZoomLevel, fineVertices, sampler, normalSampler, gridVertices);
+                    CHECK(triangleVertices.size() == gridVertices.size(), t.MvtFilename);
+                    for (size_t v = 0; v + 6 <= std::min(triangleVertices.size(), gridVertices.size()); v += 6)
+                    {
+                        const float* pA = &triangleVertices[v + 3];
+                        const float* pB = &gridVertices[v + 3];
+                        const float lenA = sqrtf(pA[0] * pA[0] + pA[1] * pA[1] + pA[2] * pA[2]);
+                        if (lenA == 0.0f)
+                        {
+                            continue;
+                        }
+                        const float cosAngle = (pA[0] * pB[0] + pA[1] * pB[1] + pA[2] * pB[2]) / lenA;
+                        sumAngle += acos(std::min(std::max(cosAngle, -1.0f), 1.0f));
+                        ++numNormals;
+                    }
+                }
+            }
+        }
+    }
+    CHECK(numNormals > 0, "mesh vertices");
+    const double meanAngle = numNormals > 0 ? sumAngle / numNormals * DEGREES_PER_RADIAN : 0.0;
+    printf("  normal grid: mean angle to the triangle normals %.2f deg\n", meanAngle);
+    CHECK(meanAngle < 10.0, "normals of the grid");
+}
+
+
+// A scene loaded from its cache has the same meshes as the one it was baked from, and they point into the mapped
+// file instead of being copied out of it
+static void TestSceneCache(const TestContext& _Ctx)
+{
+    TempDirectory directory("maptests");
+    CHECK(!directory.GetPath().empty(), "temp directory");
+    const std::string cacheFilename = directory.GetPath() + "scene.cache";
+
+    Scene scene;
+    scene.SetRawElevationFiles(true, directory.GetPath());
+    CHECK(scene.LoadCached(_Ctx.AssetsPath, cacheFilename), _Ctx.AssetsPath);
+    CHECK(!scene.GetLoadStats().FromCache, "first load");
+
+    Scene cachedScene;
+    CHECK(cachedScene.LoadCached(_Ctx.AssetsPath, cacheFilename), cacheFilename);
+    CHECK(cachedScene.GetLoadStats().FromCache, "second load");
+    CHECK(cachedScene.GetData().pCacheFile != nullptr, "mapping of the cache");
+
+    const SceneMeshes& built = scene.GetData();
+    const SceneMeshes& cached = cachedScene.GetData();
+    CHECK(built.ZoomLevels.size() == cached.ZoomLevels.size(), "zoom levels");
+    size_t numMeshes = 0;
+    for (const auto& zl : built.ZoomLevels)
+    {
+        auto cachedLevel = cached.ZoomLevels.find(zl.first);
+        CHECK(cachedLevel != cached.ZoomLevels.end() && cachedLevel->second.Tiles.size() == zl.second.Tiles.size(),
+            "zoom level " + std::to_string(zl.first));
+        if (cachedLevel == cached.ZoomLevels.end() || cachedLevel->second.Tiles.size() != zl.second.Tiles.size())
+        {
+            continue;
+        }
+        for (size_t t = 0; t < zl.second.Tiles.size(); ++t)
+        {
+            const auto& builtTile = zl.second.Tiles[t];
+            const auto& cachedTile = cachedLevel->second.Tiles[t];
+            const std::string tileName = std::to_string(zl.first) + "_" + std::to_string(builtTile.TileX) + "_" + std::to_string(builtTile.TileY);
+            CHECK(builtTile.TileX == cachedTile.TileX && builtTile.TileY == cachedTile.TileY, tileName);
+            const std::vector<SceneMeshes::TileMeshes::MeshData>* builtTypes[] = { &builtTile.TerrainMeshes, &builtTile.WaterMeshes, &builtTile.LanduseMeshes };
+            const std::vector<SceneMeshes::TileMeshes::MeshData>* cachedTypes[] = { &cachedTile.TerrainMeshes, &cachedTile.WaterMeshes, &cachedTile.LanduseMeshes };
+            for (int type = 0; type < 3; ++type)
+            {
+                CHECK(builtTypes[type]->size() == cachedTypes[type]->size(), tileName);
+                for (size_t m = 0; m < std::min(builtTypes[type]->size(), cachedTypes[type]->size()); ++m)
+                {
+                    const auto& a = (*builtTypes[type])[m];
+                    const auto& b = (*cachedTypes[type])[m];
+                    CHECK(b.Vertices.empty() && b.Indices.empty(), tileName);
+                    const Span<const float> verticesA = a.GetVertices();
+                    const Span<const float> verticesB = b.GetVertices();
+                    const Span<const uint32_t> indicesA = a.GetIndices();
+                    const Span<const uint32_t> indicesB = b.GetIndices();
+                    CHECK(verticesA.size() == verticesB.size() &&
+                        memcmp(verticesA.data(), verticesB.data(), verticesA.size() * sizeof(float)) == 0, tileName);
+                    CHECK(indicesA.size() == indicesB.size() &&
+                        memcmp(indicesA.data(), indicesB.data(), indicesA.size() * sizeof(uint32_t)) == 0, tileName);
+                    const char* pFileBegin = cached.pCacheFile->GetData();
+                    const char* pFileEnd = pFileBegin + cached.pCacheFile->GetSize();
+                    CHECK(verticesB.empty() || ((const char*)verticesB.data() >= pFileBegin && (const char*)verticesB.end() <= pFileEnd), tileName);
+                    ++numMeshes;
+                }
+            }
+        }
+    }
+    CHECK(numMeshes > 0, "meshes");
+    CHECK(scene.GetLoadStats().NumVertices == cachedScene.GetLoadStats().NumVertices &&
+        scene.GetLoadStats().NumTriangles == cachedScene.GetLoadStats().NumTriangles, "load statistics");
+
+    // an index out of its mesh (as in a damaged file) makes the whole cache invalid
+    const SceneMeshes::TileMeshes::MeshData* pMesh = nullptr;
+    for (const auto& zl : cached.ZoomLevels)
+    {
+        for (const auto& t : zl.second.Tiles)
+        {
+            if (!pMesh && !t.TerrainMeshes.empty() && !t.TerrainMeshes[0].MappedIndices.empty())
+            {
+                pMesh = &t.TerrainMeshes[0];
+            }
+        }
+    }
+    CHECK(pMesh != nullptr, "mapped mesh");
+    if (pMesh)
+    {
+        const MappedFilePtr& pCacheFile = cached.pCacheFile;
+        std::vector<char> content(pCacheFile->GetData(), pCacheFile->GetData() + pCacheFile->GetSize());
+        const size_t indexOffset = (const char*)pMesh->MappedIndices.data() - pCacheFile->GetData();
+        const uint32_t brokenIndex = (uint32_t)(pMesh->MappedVertices.size() / 6);
+        memcpy(&content[indexOffset], &brokenIndex, sizeof(brokenIndex));
+        const std::string brokenFilename = directory.GetPath() + "broken.cache";
+        FILE* fp = fopen(brokenFilename.c_str(), "wb");
+        CHECK(fp && fwrite(content.data(), 1, content.size(), fp) == content.size(), brokenFilename);
+        if (fp)
+        {
+            fclose(fp);
+        }
+        SceneMeshes brokenScene;
+        CHECK(!LoadSceneCache(brokenFilename, scene.ComputeCacheKey(_Ctx.AssetsPath), brokenScene), "index out of the mesh");
+        CHECK(LoadSceneCache(cacheFilename, scene.ComputeCacheKey(_Ctx.AssetsPath), brokenScene), "intact cache");
+    }
+
+    cachedScene.ReleaseMeshData();
+    CHECK(cachedScene.GetData().pCacheFile == nullptr, "released mapping");
+}
+
+
+// Culling runs on the CPU only, checked against the frustum of a camera at the origin looking down -Z
+static void TestCulling(const TestContext&)
+{
+    OGMatrix mProjection, mView, mViewProj;
+    MatrixPerspectiveFovRH(mProjection, 0.67f, 1.0f, 1.0f, 50000.0f, false);
+    MatrixLookAtRH(mView, OGVec3(0.0f, 0.0f, 0.0f), OGVec3(0.0f, 0.0f, -1.0f), OGVec3(0.0f, 1.0f, 0.0f));
+    MatrixMultiply(mViewProj, mView, mProjection);
+    IOGFrustum frustum;
+    frustum.Update(mViewProj);
+
+    OGMatrix mIdentity;
+    MatrixIdentity(mIdentity);
+
+    // the half width of the view is ~348 at the distance of 1000
+    const IOGAabb inside(OGVec3(-10.0f, -10.0f, -1010.0f), OGVec3(10.0f, 10.0f, -990.0f));
+    const IOGAabb outside(OGVec3(1000.0f, -10.0f, -1010.0f), OGVec3(1020.0f, 10.0f, -990.0f));
+    const IOGAabb straddling(OGVec3(300.0f, -10.0f, -1010.0f), OGVec3(400.0f, 10.0f, -990.0f));
+    const IOGAabb behind(OGVec3(-10.0f, -10.0f, 990.0f), OGVec3(10.0f, 10.0f, 1010.0f));
+    CHECK(IsAabbVisible(frustum, inside, mIdentity), "inside");
+    CHECK(!IsAabbVisible(frustum, outside, mIdentity), "outside");
+    CHECK(IsAabbVisible(frustum, straddling, mIdentity), "straddling");
+    CHECK(!IsAabbVisible(frustum, behind, mIdentity), "behind");
+
+    // the boxes are given in the object space of the world matrix
+    OGMatrix mWorld;
+    MatrixTranslation(mWorld, -1010.0f, 0.0f, 0.0f);
+    CHECK(IsAabbVisible(frustum, outside, mWorld), "translated outside");
+    CHECK(!IsAabbVisible(frustum, inside, mWorld), "translated inside");
+
+    // a tile placed beyond the far plane, it is only reached by it's elevations
+    OGMatrix mTileWorld;
+    MatrixTranslation(mTileWorld, 0.0f, 0.0f, -50100.0f);
+    const IOGAabb flatTile(OGVec3(-100.0f, -100.0f, 0.0f), OGVec3(100.0f, 100.0f, 0.0f));
+    const IOGAabb elevatedTile(OGVec3(-100.0f, -100.0f, 0.0f), OGVec3(100.0f, 100.0f, 200.0f));
+    CHECK(!IsAabbVisible(frustum, flatTile, mTileWorld), "flat tile");
+    CHECK(IsAabbVisible(frustum, elevatedTile, mTileWorld), "elevation range");
+
+    // meshes are culled one by one inside of a visible tile
+    const IOGAabb tileBounds(OGVec3(-10.0f, -10.0f, -1010.0f), OGVec3(1020.0f, 10.0f, -990.0f));
+    const std::vector<IOGAabb> meshBounds = { inside, outside, straddling };
+    std::vector<uint32_t> visibleMeshes;
+    CullingStats stats;
+    CullTile(frustum, mIdentity, tileBounds, meshBounds, visibleMeshes, stats);
+    CHECK(visibleMeshes == std::vector<uint32_t>({ 0, 2 }), "visible meshes");
+    CHECK(stats.TilesDrawn == 1 && stats.TilesCulled == 0 && stats.MeshesDrawn == 2 && stats.MeshesCulled == 1, "visible tile stats");
+
+    // a culled tile skips all of it's meshes
+    MatrixTranslation(mWorld, 0.0f, 0.0f, 2000.0f);
+    CullTile(frustum, mWorld, tileBounds, meshBounds, visibleMeshes, stats);
+    CHECK(visibleMeshes.empty(), "culled tile meshes");
+    CHECK(stats.TilesDrawn == 1 && stats.TilesCulled == 1 && stats.MeshesDrawn == 2 && stats.MeshesCulled == 4, "culled tile stats");
+}
+
+
+struct TestCase
+{
+    const char* Name;
+    void (*Run)(const TestContext& _Ctx);
+};
+
+static const TestCase g_Tests[] =
+{
+    { "ElevationDecoding", TestElevationDecoding },
+    { "TruncatedDem", TestTruncatedDem },
+    { "NormalGrid", TestNormalGrid },
+    { "ElevationSampling", TestElevationSampling },
+    { "GeoSampling", TestGeoSampling },
+    { "RawFiles", TestRawFiles },
+    { "TileSeams", TestTileSeams },
+    { "Downsampling", TestDownsampling },
+    { "MinMaxTree", TestMinMaxTree },
+    { "ElevationCache", TestElevationCache },
+    { "Stitching", TestStitching },
+    { "Subdivision", TestSubdivision },
+    { "MeshNormals", TestMeshNormals },
+    { "SceneCache", TestSceneCache },
+    { "Culling", TestCulling },
+};
+
+
+int main(int argc, char* argv[])
+{
+    std::string assetsPath;
+    std::string filter;
+    bool showHelp = false;
+
+    auto cli = clara::Help(showHelp)
+        | clara::Opt(assetsPath, "path")["-a"]["--assets"]("assets directory (default: <exe dir>/assets/)")
+        | clara::Opt(filter, "name")["-f"]["--filter"]("run only the tests containing this string");
+
+    auto result = cli.parse(clara::Args(argc, argv));
+    if (!result)
+    {
+        std::cerr << "Error in command line: " << result.errorMessage() << '\n';
+        return 1;
+    }
+
+    if (showHelp)
+    {
+        std::cout << cli << '\n';
+        return 0;
+    }
+
+    if (assetsPath.empty())
+    {
+        assetsPath = GetResourcePath() + std::string("/assets/");
+    }
+    else if (assetsPath.back() != '/' && assetsPath.back() != '\\')
+    {
+        assetsPath += '/';
+    }
+
+    TestContext ctx;
+    if (!LoadTiles(assetsPath, ctx))
+    {
+        std::cerr << "Failed to load the tiles from " << assetsPath << '\n';
+        return 1;
+    }
+
+    int numFailedTests = 0;
+    for (const auto& test : g_Tests)
+    {
+        if (!filter.empty() && std::string(test.Name).find(filter) == std::string::npos)
+        {
+            continue;
+        }
+        printf("%s\n", test.Name);
+        const int numFailures = g_NumFailures;
+        test.Run(ctx);
+        const bool bPassed = g_NumFailures == numFailures;
+        printf("%s %s\n", bPassed ? "  passed" : "  FAILED", test.Name);
+        numFailedTests += bPassed ? 0 : 1;
+        fflush(stdout);
+    }
+
+    printf("%d failed test(s)\n", numFailedTests);
+    return numFailedTests == 0 ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+#include "MappedFile.h"
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+
+// an empty file can't be mapped, it's still a valid (empty) view
+static const char g_EmptyData[1] = { 0 };
+
+
+MappedFile::MappedFile()
+{
+}
+
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+
+MappedFilePtr MappedFile::Load(const std::string& _Filename)
+{
+    auto pFile = std::make_shared<MappedFile>();
+    if (!pFile->Open(_Filename))
+    {
+        return nullptr;
+    }
+    return pFile;
+}
+
+
+bool MappedFile::Open(const std::string& _Filename)
+{
+    Close();
+    return Map(_Filename) || Read(_Filename);
+}
+
+
+void MappedFile::Close()
+{
+    if (m_pMapping)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_pMapping);
+#else
+        munmap(m_pMapping, m_Size);
+#endif
+        m_pMapping = nullptr;
+    }
+    m_Buffer.clear();
+    m_Buffer.shrink_to_fit();
+    m_pData = nullptr;
+    m_Size = 0;
+}
+
+
+#ifdef _WIN32
+bool MappedFile::Map(const std::string& _Filename)
+{
+    HANDLE hFile = CreateFileA(_Filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(hFile);
+        return false;
+    }
+
+    HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(hFile);
+    if (!hMapping)
+    {
+        return false;
+    }
+
+    // the view keeps the mapping alive
+    void* pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(hMapping);
+    if (!pView)
+    {
+        return false;
+    }
+
+    m_pMapping = pView;
+    m_pData = (const char*)pView;
+    m_Size = (size_t)size.QuadPart;
+    return true;
+}
+#else
+bool MappedFile::Map(const std::string& _Filename)
+{
+    int fd = open(_Filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    void* pView = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pView == MAP_FAILED)
+    {
+        return false;
+    }
+
+    m_pMapping = pView;
+    m_pData = (const char*)pView;
+    m_Size = (size_t)st.st_size;
+    return true;
+}
+#endif
+
+
+bool MappedFile::Read(const std::string& _Filename)
+{
+    FILE* fp = fopen(_Filename.c_str(), "rb");
+    if (!fp)
+    {
+        return false;
+    }
+
+    bool bOk = true;
+    char chunk[64 * 1024];
+    size_t numRead = 0;
+    while ((numRead = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    {
+        m_Buffer.insert(m_Buffer.end(), chunk, chunk + numRead);
+    }
+    if (ferror(fp))
+    {
+        bOk = false;
+        m_Buffer.clear();
+    }
+    fclose(fp);
+
+    if (!bOk)
+    {
+        return false;
+    }
+
+    m_pData = m_Buffer.empty() ? g_EmptyData : m_Buffer.data();
+    m_Size = m_Buffer.size();
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+class MappedFile;
+
+// Shared file view, whatever points into the file data holds one of these to keep it alive
+typedef std::shared_ptr<const MappedFile> MappedFilePtr;
+
+// Read-only view of a whole file. The file is memory mapped when the platform allows it,
+// otherwise it's read into an owned buffer, the users can't tell the difference.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Opened file or nullptr if it can't be read
+    static MappedFilePtr Load(const std::string& _Filename);
+
+    bool Open(const std::string& _Filename);
+    void Close();
+
+    const char* GetData() const { return m_pData; }
+    size_t GetSize() const { return m_Size; }
+    bool IsOpen() const { return m_pData != nullptr; }
+    bool IsMapped() const { return m_pMapping != nullptr; }
+
+private:
+    bool Map(const std::string& _Filename);
+    bool Read(const std::string& _Filename);
+
+private:
+    const char* m_pData = nullptr;
+    size_t m_Size = 0;
+    // mapped view, nullptr when the file was read into m_Buffer
+    void* m_pMapping = nullptr;
+    std::vector<char> m_Buffer;
+};
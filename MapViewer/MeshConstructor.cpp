@@ -1,29 +1,38 @@
 #include "MeshConstructor.h"
-#include "ElevationMap.h"
 #include "IOGVector.h"
+#include <math.h>
+#include <algorithm>
 
+template<typename TSampler>
 void ConstructMesh(
     int _ZoomLevel,
-    const std::vector<uint32_t>& _Indices, const std::vector<float>& _Vertices2D, const std::vector<float>& _ElevationMap,
+    const std::vector<uint32_t>& _Indices, const std::vector<float>& _Vertices2D, const TSampler& _Elevation,
     std::vector<float>& _OutVertices)
 {
     // calculate elevated position
-    float fMult = 1.0f;
-    switch (_ZoomLevel)
+    const float fMult = GetElevationScale(_ZoomLevel);
+    size_t vertsSize2D = _Vertices2D.size();
+    size_t numVertices = vertsSize2D / 2;
+
+    // sample all of the elevations in one batch, the normal arrays below are reused for it
+    std::vector<float> normalsX(numVertices);
+    std::vector<float> normalsY(numVertices);
+    std::vector<float> normalsZ(numVertices);
+    for (size_t v = 0; v < numVertices; ++v)
     {
-    case 12: fMult = 1.0f; break;
-    case 13: fMult = 2.0f; break;
-    case 14: fMult = 4.0f; break;
+        normalsX[v] = _Vertices2D[v * 2 + 0];
+        normalsY[v] = _Vertices2D[v * 2 + 1];
     }
-     size_t vertsSize2D = _Vertices2D.size();
-     _OutVertices.reserve(vertsSize2D + vertsSize2D / 2);
+    _Elevation.Sample(Span<const float>(normalsX.data(), numVertices), Span<const float>(normalsY.data(), numVertices),
+        Span<float>(normalsZ.data(), numVertices));
+
+    _OutVertices.reserve(vertsSize2D * 3);
     for (size_t i = 0; i < vertsSize2D; i += 2)
     {
         // position
         _OutVertices.push_back(_Vertices2D[i + 0]);
         _OutVertices.push_back(_Vertices2D[i + 1]);
-        float z = GetElevation(_ElevationMap, (float)(_Vertices2D[i + 0]), (float)(_Vertices2D[i + 1]));
-        _OutVertices.push_back(z * fMult);
+        _OutVertices.push_back(normalsZ[i / 2] * fMult);
 
         // normal
         _OutVertices.push_back(0.0f);
@@ -31,41 +40,114 @@ void ConstructMesh(
         _OutVertices.push_back(1.0f);
     }
 
-    // calculate vertex normals
-    for (size_t i = 0; i < _OutVertices.size(); i += 6)
+    // calculate vertex normals:
+    // go over all triangles once and accumulate their face normals in the vertices they use.
+    // Cross product length is twice the triangle square, so the sum is weighted by the area as is.
+    std::fill(normalsX.begin(), normalsX.end(), 0.0f);
+    std::fill(normalsY.begin(), normalsY.end(), 0.0f);
+    std::fill(normalsZ.begin(), normalsZ.end(), 0.0f);
+    for (size_t tri = 0; tri + 3 <= _Indices.size(); tri += 3)
     {
-        OGVec3 vPos = OGVec3(_OutVertices[i], _OutVertices[i + 1], _OutVertices[i + 2]);
+        uint32_t a = _Indices[tri + 0];
+        uint32_t b = _Indices[tri + 1];
+        uint32_t c = _Indices[tri + 2];
+        OGVec3 vA = OGVec3(_OutVertices[a * 6 + 0], _OutVertices[a * 6 + 1], _OutVertices[a * 6 + 2]);
+        OGVec3 vB = OGVec3(_OutVertices[b * 6 + 0], _OutVertices[b * 6 + 1], _OutVertices[b * 6 + 2]);
+        OGVec3 vC = OGVec3(_OutVertices[c * 6 + 0], _OutVertices[c * 6 + 1], _OutVertices[c * 6 + 2]);
 
-        // search for triangles that share this vector
-        std::vector<int> trianglesShare;
-        for (size_t ii = 0; ii < _Indices.size(); ++ii)
-        {
-            if (_Indices[ii] == i / 6)
-                trianglesShare.push_back((ii / 3) * 3);
-        }
-        if (trianglesShare.empty())
-            continue;
+        OGVec3 vN = (vB - vA).cross(vC - vA);
+        if (vN.z < 0.0f)
+            vN *= -1.0f;
+
+        normalsX[a] += vN.x; normalsY[a] += vN.y; normalsZ[a] += vN.z;
+        normalsX[b] += vN.x; normalsY[b] += vN.y; normalsZ[b] += vN.z;
+        normalsX[c] += vN.x; normalsY[c] += vN.y; normalsZ[c] += vN.z;
+    }
+
+    // normalize in place (straight loop over the SoA arrays, so the compiler can vectorize it)
+    for (size_t v = 0; v < numVertices; ++v)
+    {
+        float len = sqrtf(normalsX[v] * normalsX[v] + normalsY[v] * normalsY[v] + normalsZ[v] * normalsZ[v]);
+        // vertices without (non-degenerate) triangles keep the default up normal
+        float invLen = (len > 0.0f) ? (1.0f / len) : 0.0f;
+        normalsX[v] *= invLen;
+        normalsY[v] *= invLen;
+        normalsZ[v] = (len > 0.0f) ? (normalsZ[v] * invLen) : 1.0f;
+    }
 
-        // Get normals of all triangles, that share our vertex and produce the averege one.
-        // TODO: consider using weighted intepolation using triangle square as a weight
-        OGVec3 vNorm = OGVec3(0.0f);
-        for (auto tri : trianglesShare)
+    for (size_t v = 0; v < numVertices; ++v)
+    {
+        _OutVertices[v * 6 + 3] = normalsX[v];
+        _OutVertices[v * 6 + 4] = normalsY[v];
+        _OutVertices[v * 6 + 5] = normalsZ[v];
+    }
+}
+
+
+template<typename TSampler>
+void ConstructMesh(
+    int _ZoomLevel,
+    const std::vector<float>& _Vertices2D, const TSampler& _Elevation, const NormalGridSampler& _Normals,
+    std::vector<float>& _OutVertices)
+{
+    const float fMult = GetElevationScale(_ZoomLevel);
+    const size_t numVertices = _Vertices2D.size() / 2;
+
+    // SoA positions for the batched lookups, the elevations and normals are sampled in place
+    std::vector<float> posX(numVertices);
+    std::vector<float> posY(numVertices);
+    std::vector<float> elevations(numVertices);
+    std::vector<float> normalsX(numVertices);
+    std::vector<float> normalsY(numVertices);
+    std::vector<float> normalsZ(numVertices);
+    for (size_t v = 0; v < numVertices; ++v)
+    {
+        posX[v] = _Vertices2D[v * 2 + 0];
+        posY[v] = _Vertices2D[v * 2 + 1];
+    }
+    const Span<const float> x(posX.data(), numVertices);
+    const Span<const float> y(posY.data(), numVertices);
+    _Elevation.Sample(x, y, Span<float>(elevations.data(), numVertices));
+    _Normals.Sample(x, y, Span<float>(normalsX.data(), numVertices), Span<float>(normalsY.data(), numVertices),
+        Span<float>(normalsZ.data(), numVertices));
+
+    _OutVertices.resize(numVertices * 6);
+    for (size_t v = 0; v < numVertices; ++v)
+    {
+        float* pVertex = &_OutVertices[v * 6];
+        pVertex[0] = posX[v];
+        pVertex[1] = posY[v];
+        pVertex[2] = elevations[v] * fMult;
+        pVertex[3] = normalsX[v];
+        pVertex[4] = normalsY[v];
+        pVertex[5] = normalsZ[v];
+    }
+}
+
+
+template void ConstructMesh(int, const std::vector<uint32_t>&, const std::vector<float>&, const ElevationSampler&, std::vector<float>&);
+template void ConstructMesh(int, const std::vector<uint32_t>&, const std::vector<float>&, const QuantizedElevationSampler&, std::vector<float>&);
+template void ConstructMesh(int, const std::vector<float>&, const ElevationSampler&, const NormalGridSampler&, std::vector<float>&);
+template void ConstructMesh(int, const std::vector<float>&, const QuantizedElevationSampler&, const NormalGridSampler&, std::vector<float>&);
+
+
+IOGAabb ComputeMeshBounds(const std::vector<float>& _Vertices)
+{
+    if (_Vertices.size() < 6)
+    {
+        return IOGAabb(OGVec3(0.0f, 0.0f, 0.0f), OGVec3(0.0f, 0.0f, 0.0f));
+    }
+
+    OGVec3 vMin = OGVec3(_Vertices[0], _Vertices[1], _Vertices[2]);
+    OGVec3 vMax = vMin;
+    for (size_t i = 6; i < _Vertices.size(); i += 6)
+    {
+        for (int a = 0; a < 3; ++a)
         {
-            OGVec3 vA = OGVec3(_OutVertices[(_Indices[tri + 0] * 6) + 0], _OutVertices[(_Indices[tri + 0] * 6) + 1], _OutVertices[(_Indices[tri + 0] * 6) + 2]);
-            OGVec3 vB = OGVec3(_OutVertices[(_Indices[tri + 1] * 6) + 0], _OutVertices[(_Indices[tri + 1] * 6) + 1], _OutVertices[(_Indices[tri + 1] * 6) + 2]);
-            OGVec3 vC = OGVec3(_OutVertices[(_Indices[tri + 2] * 6) + 0], _OutVertices[(_Indices[tri + 2] * 6) + 1], _OutVertices[(_Indices[tri + 2] * 6) + 2]);
-            OGVec3 vAB = (vB - vA).normalize();
-            OGVec3 vAC = (vC - vA).normalize();
-
-            OGVec3 vN = (vAB.cross(vAC)).normalize();
-            if (vN.z < 0.0f)
-                vN *= -1.0f;
-            vNorm += vN;
+            float v = _Vertices[i + a];
+            if (v < vMin.ptr()[a]) vMin.ptr()[a] = v;
+            if (v > vMax.ptr()[a]) vMax.ptr()[a] = v;
         }
-        vNorm.normalize();
-
-        _OutVertices[i + 3] = vNorm.x;
-        _OutVertices[i + 4] = vNorm.y;
-        _OutVertices[i + 5] = vNorm.z;
     }
+    return IOGAabb(vMin, vMax);
 }
@@ -1,7 +1,24 @@
 #pragma once
 #include <vector>
+#include <cstdint>
+#include "IOGAabb.h"
+#include "ElevationSampler.h"
+#include "NormalGrid.h"
 
+// Built for ElevationSampler and QuantizedElevationSampler
+template<typename TSampler>
 void ConstructMesh(
 	int _ZoomLevel,
-	const std::vector<uint32_t>& _Indices, const std::vector<float>& _Vertices2D, const std::vector<float>& _ElevationMap,
+	const std::vector<uint32_t>& _Indices, const std::vector<float>& _Vertices2D, const TSampler& _Elevation,
     std::vector<float>& _OutVertices);
+
+// Same positions, but the normals are looked up in the normal grid of the terrain instead of being
+// accumulated from the triangles, so they don't depend on the triangulation
+template<typename TSampler>
+void ConstructMesh(
+    int _ZoomLevel,
+    const std::vector<float>& _Vertices2D, const TSampler& _Elevation, const NormalGridSampler& _Normals,
+    std::vector<float>& _OutVertices);
+
+// Bounding box of the constructed mesh (x, y and the min/max elevation), an empty mesh gets a zero box
+IOGAabb ComputeMeshBounds(const std::vector<float>& _Vertices);
@@ -1,35 +1,9 @@
 #include "MeshSubdivision.h"
+#include "ReferenceKernels.h"
 #include <IOGMath.h>
+#include <cstdint>
 #include <map>
-
-
-inline bool FindEdges(
-    const std::vector<unsigned int>& _Indices,
-    size_t _curTriangle, unsigned int _A, unsigned int _B,
-    unsigned int& _outAdjacentTriangle, size_t& _outAdjacentFaceId)
-{
-    size_t numIndices = _Indices.size();
-    for (size_t i = (_curTriangle + 3); i <= numIndices - 3; i += 3)
-    {
-        for (size_t n = 0; n < 3; ++n)
-        {
-            size_t testAi = i + n;
-            size_t testBi = (n == 2) ? i : (i + n + 1);
-            unsigned int testA = _Indices[testAi];
-            unsigned int testB = _Indices[testBi];
-            if ((_A == testA && _B == testB) || (_B == testA && _A == testB))
-            {
-                // we found the adjacent triangle!
-                // we also return which face (0-1, 1-2, 2-0) hits by returning it's index within the triangle
-                _outAdjacentTriangle = i;
-                _outAdjacentFaceId = n;
-                // there can be only one adjacent in 2D :)
-                return true;
-            }
-        }
-    }
-    return false;
-}
+#include <assert.h>
 
 
 enum TriSubdivision
@@ -52,102 +26,329 @@ inline TriSubdivision FromEdgeId(unsigned int _EdgeId)
     return SUBD_NONE;
 }
 
-struct SubdivInfo
+const unsigned int NO_TWIN = 0xFFFFFFFF;
+
+
+// Half-edge adjacency:
+// half-edge id is the position of its first vertex in the index buffer (triangle * 3 + edge id),
+// so the half-edges of a triangle are implicit and only twins have to be stored.
+// Twins[halfEdge] is the id of the half-edge running along the same edge in the adjacent triangle, or NO_TWIN.
+struct HalfEdgeMesh
 {
-    unsigned int SubdivType = SUBD_NONE;
-    // 0: A->B 1: B->C 2: C->A
-    unsigned int SubdivPtIds[3] = { 0xFFFFFFFF,  0xFFFFFFFF , 0xFFFFFFFF };
+    std::vector<unsigned int> Twins;
 };
 
 
-// Subdivision info:
-// key is the original triangle id
-// value is an info of an added odd verices for this triangle
-using Subdivision = std::map<unsigned int, SubdivInfo>;
-
-// Tri-Edge Adjacency: 
-// key = edge id in triangle, 
-// value is a pair of adjacent triangle id and index (0, 1, 2) of it's adjacent edge
-using Adjacency = std::map<unsigned int, std::pair<unsigned int, unsigned int> >;
+inline uint64_t EdgeKey(unsigned int _A, unsigned int _B)
+{
+    return (_A < _B) ? (((uint64_t)_A << 32) | _B) : (((uint64_t)_B << 32) | _A);
+}
 
 
-// Adjacency storage:
-// key = triangle id
-// value = it's adjacency info (id's of adjacent tri-s and edges)
-using AdjacencyMap = std::map<unsigned int, Adjacency>;
+inline size_t EdgeHash(uint64_t _Key, size_t _Mask)
+{
+    // 64-bit finalizer from MurmurHash3, keeps sequential vertex ids from clustering
+    _Key ^= _Key >> 33;
+    _Key *= 0xff51afd7ed558ccdULL;
+    _Key ^= _Key >> 33;
+    return (size_t)_Key & _Mask;
+}
 
 
-void FindAdjacentTriangles(const std::vector<unsigned int>& _Indices, AdjacencyMap& _outAdjacencyInfo)
+// Builds twin links in one pass over the index buffer using an open-addressing edge hash.
+// The first two triangles sharing an edge become twins, any further (non-manifold) ones stay unlinked.
+void BuildHalfEdgeMesh(const std::vector<unsigned int>& _Indices, HalfEdgeMesh& _outMesh)
 {
-    _outAdjacencyInfo.clear();
-
     size_t numIndices = _Indices.size();
-    for (size_t i = 0; i <= numIndices - 3; i += 3)
+    _outMesh.Twins.assign(numIndices, NO_TWIN);
+
+    size_t tableSize = 16;
+    while (tableSize < numIndices * 2)
+    {
+        tableSize <<= 1;
+    }
+    size_t mask = tableSize - 1;
+
+    struct Slot
+    {
+        uint64_t Key;
+        unsigned int HalfEdge;
+    };
+    std::vector<Slot> table(tableSize, { 0, NO_TWIN });
+
+    for (size_t h = 0; h < numIndices; ++h)
     {
-        for (size_t n = 0; n < 3; ++n)
+        size_t tri = h - h % 3;
+        unsigned int a = _Indices[h];
+        unsigned int b = _Indices[(h % 3 == 2) ? tri : (h + 1)];
+        uint64_t key = EdgeKey(a, b);
+
+        size_t slot = EdgeHash(key, mask);
+        while (table[slot].HalfEdge != NO_TWIN && table[slot].Key != key)
         {
-            size_t ai = i + n;
-            size_t bi = (n == 2) ? i : (i + n + 1);
-            unsigned int a = _Indices[ai];
-            unsigned int b = _Indices[bi];
-            unsigned int adjacentTri = -1;
-            size_t adjacentFace = -1;
-            if (FindEdges(_Indices, i, a, b, adjacentTri, adjacentFace))
-            {
-                auto& curTA = _outAdjacencyInfo[i];
-                curTA[n] = { adjacentTri, adjacentFace };
-            }
+            slot = (slot + 1) & mask;
+        }
+
+        Slot& s = table[slot];
+        if (s.HalfEdge == NO_TWIN)
+        {
+            // first time we see this edge, wait for the adjacent triangle
+            s.Key = key;
+            s.HalfEdge = (unsigned int)h;
+        }
+        else if (_outMesh.Twins[s.HalfEdge] == NO_TWIN && s.HalfEdge < tri)
+        {
+            // we found the adjacent triangle!
+            _outMesh.Twins[s.HalfEdge] = (unsigned int)h;
+            _outMesh.Twins[h] = s.HalfEdge;
         }
     }
 }
 
 
-inline void GetHalfVec(const OGVec2& _vA, const OGVec2& _vB, float _fDist, OGVec2& _Out)
+// Split chain of an edge:
+// the edge Start -> End is cut into NumSegments (a power of two) equal pieces, which is exactly what
+// repeated halving until every piece is shorter than the min distance gives. The NumSegments - 1 inner
+// points are allocated up front and go in a row starting from FirstPoint.
+struct Chain
 {
-    OGVec2 vDir = (_vB - _vA).normalize();
-    _Out = _vA + vDir * _fDist;
-}
+    unsigned int Start;
+    unsigned int End;
+    unsigned int FirstPoint;
+    unsigned int NumSegments;
+};
 
 
-inline void SubdivideEdge(
-    unsigned int _TriangleId, unsigned int _EdgeId,
-    const OGVec2& _v1, const OGVec2& _v2, float _MinDist,
-    const AdjacencyMap& _adjacencyInfo, Subdivision& _subdivInfo, std::vector<OGVec2>& _oddVertices)
+// Part of a chain between two of it's points, From > To means the chain is walked backwards
+struct Side
 {
-    // start subdividing edge only if it wasn't subdivided yet by an adjacent triangle
-    auto s = _subdivInfo.find(_TriangleId);
-    if (s == _subdivInfo.end() || (s->second.SubdivType & FromEdgeId(_EdgeId)) == 0)
+    unsigned int ChainId;
+    unsigned int From;
+    unsigned int To;
+};
+
+
+// Triangle A B C given by it's sides A->B, B->C, C->A
+struct SubdivTriangle
+{
+    Side Sides[3];
+};
+
+
+class SubdivisionContext
+{
+public:
+    SubdivisionContext(float _MinDist, std::vector<float>& _Vertices, std::vector<unsigned int>& _OutIndices)
+        : m_MinDist(_MinDist)
+        , m_Vertices(_Vertices)
+        , m_OutIndices(_OutIndices)
+    {
+    }
+
+    // Creates split chain for the edge _A -> _B and returns it's id
+    unsigned int AddChain(unsigned int _A, unsigned int _B)
+    {
+        OGVec2 vA = GetVertex(_A);
+        OGVec2 vB = GetVertex(_B);
+        float dist = Dist2D(vA, vB);
+        unsigned int numSegments = 1;
+        while (dist >= m_MinDist)
+        {
+            dist *= 0.5f;
+            numSegments *= 2;
+        }
+
+        Chain c;
+        c.Start = _A;
+        c.End = _B;
+        c.FirstPoint = (unsigned int)(m_Vertices.size() / 2);
+        c.NumSegments = numSegments;
+        for (unsigned int i = 1; i < numSegments; ++i)
+        {
+            OGVec2 vPt = vA + (vB - vA) * ((float)i / (float)numSegments);
+            m_Vertices.push_back(vPt.x);
+            m_Vertices.push_back(vPt.y);
+        }
+        m_Chains.push_back(c);
+        return (unsigned int)m_Chains.size() - 1;
+    }
+
+    Side GetChainSide(unsigned int _ChainId, bool _Reversed) const
+    {
+        unsigned int numSegments = m_Chains[_ChainId].NumSegments;
+        return _Reversed ? Side{ _ChainId, numSegments, 0 } : Side{ _ChainId, 0, numSegments };
+    }
+
+    bool IsSplit(unsigned int _ChainId) const { return m_Chains[_ChainId].NumSegments > 1; }
+
+    // Refines triangle until all of it's edges are shorter than the min distance
+    void Subdivide(const SubdivTriangle& _Triangle);
+
+private:
+    OGVec2 GetVertex(unsigned int _Id) const
+    {
+        return OGVec2(m_Vertices[_Id * 2], m_Vertices[_Id * 2 + 1]);
+    }
+
+    unsigned int GetPoint(unsigned int _ChainId, unsigned int _PtId) const
     {
-        // okay, this edge was not touched. Is it long enough for subdivision?
-        float dist = Dist2D(_v1, _v2);
-        if (dist >= _MinDist)
+        const Chain& c = m_Chains[_ChainId];
+        if (_PtId == 0)
+            return c.Start;
+        if (_PtId == c.NumSegments)
+            return c.End;
+        return c.FirstPoint + _PtId - 1;
+    }
+
+    unsigned int GetFirst(const Side& _Side) const { return GetPoint(_Side.ChainId, _Side.From); }
+    unsigned int GetMiddle(const Side& _Side) const { return GetPoint(_Side.ChainId, (_Side.From + _Side.To) / 2); }
+    bool NeedsSplit(const Side& _Side) const { return (_Side.From > _Side.To ? _Side.From - _Side.To : _Side.To - _Side.From) > 1; }
+    Side FirstHalf(const Side& _Side) const { return Side{ _Side.ChainId, _Side.From, (_Side.From + _Side.To) / 2 }; }
+    Side SecondHalf(const Side& _Side) const { return Side{ _Side.ChainId, (_Side.From + _Side.To) / 2, _Side.To }; }
+
+    // Adds new inner edge _A -> _B, returns it's forward and backward sides
+    void AddInnerEdge(unsigned int _A, unsigned int _B, Side& _OutForward, Side& _OutBackward)
+    {
+        unsigned int chainId = AddChain(_A, _B);
+        _OutForward = GetChainSide(chainId, false);
+        _OutBackward = GetChainSide(chainId, true);
+    }
+
+private:
+    float m_MinDist;
+    std::vector<float>& m_Vertices;
+    std::vector<unsigned int>& m_OutIndices;
+    std::vector<Chain> m_Chains;
+    std::vector<SubdivTriangle> m_Stack;
+};
+
+
+void SubdivisionContext::Subdivide(const SubdivTriangle& _Triangle)
+{
+    // Depth-first traversal: each triangle is split using the same patterns as a single midpoint subdivision
+    // step, and the children are pushed back until no side needs splitting. Since every edge is split according
+    // to it's own chain, neighbour triangles always get the same points on a shared edge.
+    m_Stack.clear();
+    m_Stack.push_back(_Triangle);
+    while (!m_Stack.empty())
+    {
+        SubdivTriangle tri = m_Stack.back();
+        m_Stack.pop_back();
+
+        const Side& sAB = tri.Sides[0];
+        const Side& sBC = tri.Sides[1];
+        const Side& sCA = tri.Sides[2];
+        unsigned int a = GetFirst(sAB);
+        unsigned int b = GetFirst(sBC);
+        unsigned int c = GetFirst(sCA);
+
+        unsigned int subdivType = SUBD_NONE;
+        for (unsigned int edge = 0; edge < 3; ++edge)
         {
-            OGVec2 vOddPt;
-            GetHalfVec(_v1, _v2, dist / 2.0f, vOddPt);
-            _oddVertices.push_back(vOddPt);
-            unsigned int oddVertId = (unsigned int)_oddVertices.size() - 1;
-            auto& si = _subdivInfo[_TriangleId];
-            si.SubdivType |= FromEdgeId(_EdgeId);
-            si.SubdivPtIds[_EdgeId] = oddVertId;
-
-            // notify adjacent triangles that they'll have to subdivide
-            AdjacencyMap::const_iterator adjTris = _adjacencyInfo.find(_TriangleId);
-            if (adjTris != _adjacencyInfo.end())
+            if (NeedsSplit(tri.Sides[edge]))
             {
-                // we found info about our triangle in adjacency info
-                // no check if this face is adjacent
-                Adjacency::const_iterator adjF = adjTris->second.find(_EdgeId);
-                if (adjF != adjTris->second.end())
-                {
-                    // yep, this face is adjacent, now let's find with whom we share this edge
-                    auto& asi = _subdivInfo[adjF->second.first];
-                    // notify adjacent triangle, that it will get a new odd vector on a shared edge
-                    // by updating subdivision info
-                    asi.SubdivType |= FromEdgeId(adjF->second.second);
-                    asi.SubdivPtIds[adjF->second.second] = oddVertId;
-                }
+                subdivType |= FromEdgeId(edge);
             }
         }
+
+        Side x, xr, y, yr, z, zr;
+        switch (subdivType)
+        {
+        case SUBD_NONE:
+            // triangle is fine, keep it as is
+            m_OutIndices.insert(m_OutIndices.end(), { a, b, c });
+            break;
+
+        case SUBD_AB:
+        {
+            // B C A', C A A'
+            unsigned int mab = GetMiddle(sAB);
+            AddInnerEdge(c, mab, x, xr);
+            m_Stack.push_back({ { sBC, x, SecondHalf(sAB) } });
+            m_Stack.push_back({ { sCA, FirstHalf(sAB), xr } });
+            break;
+        }
+
+        case SUBD_BC:
+        {
+            // B' A B, A B' C
+            unsigned int mbc = GetMiddle(sBC);
+            AddInnerEdge(mbc, a, x, xr);
+            m_Stack.push_back({ { x, sAB, FirstHalf(sBC) } });
+            m_Stack.push_back({ { xr, SecondHalf(sBC), sCA } });
+            break;
+        }
+
+        case SUBD_CA:
+        {
+            // C' A B, C' B C
+            unsigned int mca = GetMiddle(sCA);
+            AddInnerEdge(b, mca, x, xr);
+            m_Stack.push_back({ { SecondHalf(sCA), sAB, x } });
+            m_Stack.push_back({ { xr, sBC, FirstHalf(sCA) } });
+            break;
+        }
+
+        case SUBD_AB | SUBD_BC:
+        {
+            // A A' B', A' B B', C A B'
+            unsigned int mab = GetMiddle(sAB);
+            unsigned int mbc = GetMiddle(sBC);
+            AddInnerEdge(mab, mbc, x, xr);
+            AddInnerEdge(mbc, a, y, yr);
+            m_Stack.push_back({ { FirstHalf(sAB), x, y } });
+            m_Stack.push_back({ { SecondHalf(sAB), FirstHalf(sBC), xr } });
+            m_Stack.push_back({ { sCA, yr, SecondHalf(sBC) } });
+            break;
+        }
+
+        case SUBD_AB | SUBD_CA:
+        {
+            // C A' B, C C' A', C' A A'
+            unsigned int mab = GetMiddle(sAB);
+            unsigned int mca = GetMiddle(sCA);
+            AddInnerEdge(c, mab, x, xr);
+            AddInnerEdge(mca, mab, y, yr);
+            m_Stack.push_back({ { x, SecondHalf(sAB), sBC } });
+            m_Stack.push_back({ { FirstHalf(sCA), y, xr } });
+            m_Stack.push_back({ { SecondHalf(sCA), FirstHalf(sAB), yr } });
+            break;
+        }
+
+        case SUBD_BC | SUBD_CA:
+        {
+            // A B B', C' A B', C C' B'
+            unsigned int mbc = GetMiddle(sBC);
+            unsigned int mca = GetMiddle(sCA);
+            AddInnerEdge(mbc, a, x, xr);
+            AddInnerEdge(mbc, mca, y, yr);
+            m_Stack.push_back({ { sAB, FirstHalf(sBC), x } });
+            m_Stack.push_back({ { SecondHalf(sCA), xr, y } });
+            m_Stack.push_back({ { FirstHalf(sCA), yr, SecondHalf(sBC) } });
+            break;
+        }
+
+        case SUBD_AB | SUBD_BC | SUBD_CA:
+        {
+            // C' B' C, C' A A', A' B B', C' A' B'
+            unsigned int mab = GetMiddle(sAB);
+            unsigned int mbc = GetMiddle(sBC);
+            unsigned int mca = GetMiddle(sCA);
+            AddInnerEdge(mca, mbc, x, xr);
+            AddInnerEdge(mab, mca, y, yr);
+            AddInnerEdge(mbc, mab, z, zr);
+            m_Stack.push_back({ { x, SecondHalf(sBC), FirstHalf(sCA) } });
+            m_Stack.push_back({ { SecondHalf(sCA), FirstHalf(sAB), y } });
+            m_Stack.push_back({ { SecondHalf(sAB), FirstHalf(sBC), z } });
+            m_Stack.push_back({ { yr, zr, xr } });
+            break;
+        }
+
+        default:
+            // Other types are impossible!
+            assert(0);
+            break;
+        }
     }
 }
 
@@ -156,178 +357,223 @@ bool SubdivideMesh(
     const std::vector<unsigned int>& _Indices, const std::vector<float>& _Vertices, float _MinDist,
     std::vector<unsigned int>& _OutIndices, std::vector<float>& _OutVertices)
 {
-    AdjacencyMap adjacencyInfo;
-    FindAdjacentTriangles(_Indices, adjacencyInfo);
-    std::vector<OGVec2> oddVertices;
-    Subdivision subdivInfo;
-
     size_t numIndices = _Indices.size();
-    for (size_t i = 0; i <= numIndices - 3; i += 3)
-    {
-        unsigned int a = _Indices[i + 0];
-        unsigned int b = _Indices[i + 1];
-        unsigned int c = _Indices[i + 2];
 
-        OGVec2 vA(_Vertices[a * 2], _Vertices[a * 2 + 1]);
-        OGVec2 vB(_Vertices[b * 2], _Vertices[b * 2 + 1]);
-        OGVec2 vC(_Vertices[c * 2], _Vertices[c * 2 + 1]);
+    HalfEdgeMesh halfEdges;
+    BuildHalfEdgeMesh(_Indices, halfEdges);
 
-        SubdivideEdge(i, 0, vA, vB, _MinDist, adjacencyInfo, subdivInfo, oddVertices);
-        SubdivideEdge(i, 1, vB, vC, _MinDist, adjacencyInfo, subdivInfo, oddVertices);
-        SubdivideEdge(i, 2, vC, vA, _MinDist, adjacencyInfo, subdivInfo, oddVertices);
+    // New vertices are written to the end of the existing vertex buffer.
+    // First, work out the split chain of every edge of the source mesh, twins share the same chain.
+    _OutVertices.assign(_Vertices.begin(), _Vertices.end());
+    SubdivisionContext ctx(_MinDist, _OutVertices, _OutIndices);
+    std::vector<unsigned int> edgeChains(numIndices);
+    bool hasSplits = false;
+    for (size_t h = 0; h < numIndices; ++h)
+    {
+        unsigned int twin = halfEdges.Twins[h];
+        if (twin != NO_TWIN && twin < h)
+        {
+            edgeChains[h] = edgeChains[twin];
+            continue;
+        }
+        unsigned int a = _Indices[h];
+        unsigned int b = _Indices[(h % 3 == 2) ? (h - 2) : (h + 1)];
+        edgeChains[h] = ctx.AddChain(a, b);
+        hasSplits |= ctx.IsSplit(edgeChains[h]);
     }
 
-    if (!oddVertices.empty())
+    if (!hasSplits)
     {
-        _OutIndices.reserve(_Indices.size() + oddVertices.size() * 3);
-        _OutVertices.reserve(_Vertices.size() + oddVertices.size());
+        // all of the edges are short enough already
+        _OutVertices.clear();
+        return false;
+    }
 
-        // Write the new vertices to the end of the existing vertex buffer
-        // Result is extremely NOT vertex cache-friendly, but simple and works
-        _OutVertices.assign(_Vertices.begin(), _Vertices.end());
-        for (auto ov : oddVertices)
+    // Then refine every triangle in one go, the inner edges get their chains when they appear
+    _OutIndices.reserve(numIndices * 2);
+    for (size_t i = 0; i + 3 <= numIndices; i += 3)
+    {
+        SubdivTriangle tri;
+        for (unsigned int edge = 0; edge < 3; ++edge)
         {
-            _OutVertices.push_back(ov.x);
-            _OutVertices.push_back(ov.y);
+            unsigned int h = (unsigned int)i + edge;
+            unsigned int twin = halfEdges.Twins[h];
+            tri.Sides[edge] = ctx.GetChainSide(edgeChains[h], twin != NO_TWIN && twin < h);
         }
+        ctx.Subdivide(tri);
+    }
+    return true;
+}
+
+
+// The subdivision before the half-edge adjacency and the split chains, kept as the baseline of maptests and mapbench:
+// one midpoint step per call, the adjacency is found by scanning all of the later triangles for every edge
+// and kept in nested maps, just like the per-triangle subdivision info.
+
+// key = edge id in triangle, value = adjacent triangle id and index (0, 1, 2) of it's adjacent edge
+using EdgeMapAdjacency = std::map<unsigned int, std::pair<unsigned int, unsigned int> >;
+
+// key = triangle id (first index of the triangle)
+using EdgeMapAdjacencyMap = std::map<unsigned int, EdgeMapAdjacency>;
+
+struct EdgeMapSubdivInfo
+{
+    unsigned int SubdivType = SUBD_NONE;
+    unsigned int SubdivPtIds[3] = { 0, 0, 0 };
+};
 
-        // since new (odd) vertices will be placed after the old (even) ones,
-        // it's quite easy to index them
-        unsigned int firstOddVertexIndex = _Vertices.size() / 2;
 
-        // go ver each triangle and generate new triangles if required
-        for (size_t i = 0; i <= numIndices - 3; i += 3)
+static bool FindAdjacentEdge(const std::vector<unsigned int>& _Indices, size_t _CurTriangle, unsigned int _A, unsigned int _B,
+    unsigned int& _OutAdjacentTriangle, unsigned int& _OutAdjacentEdgeId)
+{
+    size_t numIndices = _Indices.size();
+    for (size_t i = _CurTriangle + 3; i + 3 <= numIndices; i += 3)
+    {
+        for (unsigned int n = 0; n < 3; ++n)
         {
-            auto subdiv = subdivInfo.find(i);
-            if (subdiv != subdivInfo.end())
+            unsigned int testA = _Indices[i + n];
+            unsigned int testB = _Indices[(n == 2) ? i : (i + n + 1)];
+            if ((_A == testA && _B == testB) || (_B == testA && _A == testB))
             {
-                switch (subdiv->second.SubdivType)
-                {
-                case SUBD_AB:
-                    // B C A'
-                    _OutIndices.push_back(_Indices[i + 1]);
-                    _OutIndices.push_back(_Indices[i + 2]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[0]);
-
-                    // C A A'
-                    _OutIndices.push_back(_Indices[i + 2]);
-                    _OutIndices.push_back(_Indices[i + 0]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[0]);
-                    break;
-
-                case SUBD_BC:
-                    // B' A B
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[1]);
-                    _OutIndices.push_back(_Indices[i + 0]);
-                    _OutIndices.push_back(_Indices[i + 1]);
-
-                    // A B' C
-                    _OutIndices.push_back(_Indices[i + 0]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[1]);
-                    _OutIndices.push_back(_Indices[i + 2]);
-                    break;
-
-                case SUBD_CA:
-                    // C' A B
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[2]);
-                    _OutIndices.push_back(_Indices[i + 0]);
-                    _OutIndices.push_back(_Indices[i + 1]);
-
-                    // C' B C
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[2]);
-                    _OutIndices.push_back(_Indices[i + 1]);
-                    _OutIndices.push_back(_Indices[i + 2]);
-                    break;
-
-                case SUBD_AB | SUBD_BC:
-                    // A A' B'
-                    _OutIndices.push_back(_Indices[i + 0]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[0]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[1]);
-
-                    // A' B B'
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[0]);
-                    _OutIndices.push_back(_Indices[i + 1]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[1]);
-
-                    // C A B'
-                    _OutIndices.push_back(_Indices[i + 2]);
-                    _OutIndices.push_back(_Indices[i + 0]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[1]);
-                    break;
-
-                case SUBD_AB | SUBD_CA:
-                    // C A B'
-                    _OutIndices.push_back(_Indices[i + 2]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[0]);
-                    _OutIndices.push_back(_Indices[i + 1]);
-
-                    // C C' A'
-                    _OutIndices.push_back(_Indices[i + 2]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[2]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[0]);
-
-                    // C' A A'
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[2]);
-                    _OutIndices.push_back(_Indices[i + 0]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[0]);
-                    break;
-
-                case SUBD_BC | SUBD_CA:
-                    // A B B'
-                    _OutIndices.push_back(_Indices[i + 0]);
-                    _OutIndices.push_back(_Indices[i + 1]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[1]);
-
-                    // C' A B'
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[2]);
-                    _OutIndices.push_back(_Indices[i + 0]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[1]);
-
-                    // C C' B'
-                    _OutIndices.push_back(_Indices[i + 2]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[2]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[1]);
-                    break;
-
-                case SUBD_AB | SUBD_BC | SUBD_CA:
-                    // C' B' C
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[2]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[1]);
-                    _OutIndices.push_back(_Indices[i + 2]);
-
-                    // C' A A'
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[2]);
-                    _OutIndices.push_back(_Indices[i + 0]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[0]);
-
-                    // A' B B'
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[0]);
-                    _OutIndices.push_back(_Indices[i + 1]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[1]);
-
-                    // C' A' B'
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[2]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[0]);
-                    _OutIndices.push_back(firstOddVertexIndex + subdiv->second.SubdivPtIds[1]);
-                    break;
-
-                default:
-                    // Other types are impossible!
-                    assert(0);
-                    break;
-                }
-
+                _OutAdjacentTriangle = (unsigned int)i;
+                _OutAdjacentEdgeId = n;
+                return true;
             }
-            else
+        }
+    }
+    return false;
+}
+
+
+static void SubdivideEdgeMapEdge(unsigned int _TriangleId, unsigned int _EdgeId, const OGVec2& _v1, const OGVec2& _v2, float _MinDist,
+    const EdgeMapAdjacencyMap& _Adjacency, std::map<unsigned int, EdgeMapSubdivInfo>& _SubdivInfo, std::vector<OGVec2>& _OddVertices)
+{
+    // start subdividing edge only if it wasn't subdivided yet by an adjacent triangle
+    auto s = _SubdivInfo.find(_TriangleId);
+    if (s != _SubdivInfo.end() && (s->second.SubdivType & FromEdgeId(_EdgeId)) != 0)
+        return;
+
+    float dist = Dist2D(_v1, _v2);
+    if (dist < _MinDist)
+        return;
+
+    OGVec2 vDir = (_v2 - _v1).normalize();
+    _OddVertices.push_back(_v1 + vDir * (dist / 2.0f));
+    unsigned int oddVertId = (unsigned int)_OddVertices.size() - 1;
+    auto& si = _SubdivInfo[_TriangleId];
+    si.SubdivType |= FromEdgeId(_EdgeId);
+    si.SubdivPtIds[_EdgeId] = oddVertId;
+
+    // notify adjacent triangle that it will get a new odd vector on a shared edge
+    auto adjTris = _Adjacency.find(_TriangleId);
+    if (adjTris != _Adjacency.end())
+    {
+        auto adjEdge = adjTris->second.find(_EdgeId);
+        if (adjEdge != adjTris->second.end())
+        {
+            auto& asi = _SubdivInfo[adjEdge->second.first];
+            asi.SubdivType |= FromEdgeId(adjEdge->second.second);
+            asi.SubdivPtIds[adjEdge->second.second] = oddVertId;
+        }
+    }
+}
+
+
+static bool SubdivideEdgeMapStep(const std::vector<unsigned int>& _Indices, const std::vector<float>& _Vertices, float _MinDist,
+    std::vector<unsigned int>& _OutIndices, std::vector<float>& _OutVertices)
+{
+    size_t numIndices = _Indices.size();
+
+    EdgeMapAdjacencyMap adjacency;
+    for (size_t i = 0; i + 3 <= numIndices; i += 3)
+    {
+        for (unsigned int n = 0; n < 3; ++n)
+        {
+            unsigned int adjacentTri = 0;
+            unsigned int adjacentEdge = 0;
+            if (FindAdjacentEdge(_Indices, i, _Indices[i + n], _Indices[(n == 2) ? i : (i + n + 1)], adjacentTri, adjacentEdge))
             {
-                // triangle was not touched, keep it as is
-                _OutIndices.push_back(_Indices[i + 0]);
-                _OutIndices.push_back(_Indices[i + 1]);
-                _OutIndices.push_back(_Indices[i + 2]);
+                adjacency[(unsigned int)i][n] = { adjacentTri, adjacentEdge };
             }
         }
-        return true;
     }
-    return false;
+
+    std::vector<OGVec2> oddVertices;
+    std::map<unsigned int, EdgeMapSubdivInfo> subdivInfo;
+    for (size_t i = 0; i + 3 <= numIndices; i += 3)
+    {
+        OGVec2 vA(_Vertices[_Indices[i + 0] * 2], _Vertices[_Indices[i + 0] * 2 + 1]);
+        OGVec2 vB(_Vertices[_Indices[i + 1] * 2], _Vertices[_Indices[i + 1] * 2 + 1]);
+        OGVec2 vC(_Vertices[_Indices[i + 2] * 2], _Vertices[_Indices[i + 2] * 2 + 1]);
+        SubdivideEdgeMapEdge((unsigned int)i, 0, vA, vB, _MinDist, adjacency, subdivInfo, oddVertices);
+        SubdivideEdgeMapEdge((unsigned int)i, 1, vB, vC, _MinDist, adjacency, subdivInfo, oddVertices);
+        SubdivideEdgeMapEdge((unsigned int)i, 2, vC, vA, _MinDist, adjacency, subdivInfo, oddVertices);
+    }
+
+    if (oddVertices.empty())
+        return false;
+
+    // the odd vertices go after the even ones
+    _OutVertices.assign(_Vertices.begin(), _Vertices.end());
+    for (const auto& ov : oddVertices)
+    {
+        _OutVertices.push_back(ov.x);
+        _OutVertices.push_back(ov.y);
+    }
+    unsigned int firstOdd = (unsigned int)(_Vertices.size() / 2);
+
+    for (size_t i = 0; i + 3 <= numIndices; i += 3)
+    {
+        unsigned int a = _Indices[i + 0];
+        unsigned int b = _Indices[i + 1];
+        unsigned int c = _Indices[i + 2];
+        auto subdiv = subdivInfo.find((unsigned int)i);
+        if (subdiv == subdivInfo.end())
+        {
+            _OutIndices.insert(_OutIndices.end(), { a, b, c });
+            continue;
+        }
+
+        unsigned int mab = firstOdd + subdiv->second.SubdivPtIds[0];
+        unsigned int mbc = firstOdd + subdiv->second.SubdivPtIds[1];
+        unsigned int mca = firstOdd + subdiv->second.SubdivPtIds[2];
+        switch (subdiv->second.SubdivType)
+        {
+        case SUBD_AB: _OutIndices.insert(_OutIndices.end(), { b, c, mab, c, a, mab }); break;
+        case SUBD_BC: _OutIndices.insert(_OutIndices.end(), { mbc, a, b, a, mbc, c }); break;
+        case SUBD_CA: _OutIndices.insert(_OutIndices.end(), { mca, a, b, mca, b, c }); break;
+        case SUBD_AB | SUBD_BC: _OutIndices.insert(_OutIndices.end(), { a, mab, mbc, mab, b, mbc, c, a, mbc }); break;
+        case SUBD_AB | SUBD_CA: _OutIndices.insert(_OutIndices.end(), { c, mab, b, c, mca, mab, mca, a, mab }); break;
+        case SUBD_BC | SUBD_CA: _OutIndices.insert(_OutIndices.end(), { a, b, mbc, mca, a, mbc, c, mca, mbc }); break;
+        case SUBD_AB | SUBD_BC | SUBD_CA: _OutIndices.insert(_OutIndices.end(), { mca, mbc, c, mca, a, mab, mab, b, mbc, mca, mab, mbc }); break;
+        default:
+            // Other types are impossible!
+            assert(0);
+            break;
+        }
+    }
+    return true;
+}
+
+
+bool detail::SubdivideMeshEdgeMap(const std::vector<unsigned int>& _Indices, const std::vector<float>& _Vertices, float _MinDist,
+    std::vector<unsigned int>& _OutIndices, std::vector<float>& _OutVertices)
+{
+    // ping-pong the buffers until no edge is split any more
+    std::vector<unsigned int> indices;
+    std::vector<float> vertices;
+    _OutIndices.clear();
+    _OutVertices.clear();
+    if (!SubdivideEdgeMapStep(_Indices, _Vertices, _MinDist, _OutIndices, _OutVertices))
+        return false;
+
+    for (;;)
+    {
+        indices.clear();
+        vertices.clear();
+        if (!SubdivideEdgeMapStep(_OutIndices, _OutVertices, _MinDist, indices, vertices))
+            return true;
+        _OutIndices.swap(indices);
+        _OutVertices.swap(vertices);
+    }
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include <vector>
 
+// Refines the mesh in one pass, so none of the resulting edges is longer than _MinDist.
+// Returns false (and leaves the output empty) if the mesh doesn't need any refinement.
 bool SubdivideMesh(const std::vector<unsigned int>& _Indices, const std::vector<float>& _Vertices, float _MinDist,
 	std::vector<unsigned int>& _OutIndices, std::vector<float>& _OutVertices);
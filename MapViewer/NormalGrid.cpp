@@ -0,0 +1,184 @@
+#include "NormalGrid.h"
+#include "ReferenceKernels.h"
+#include "SimdConfig.h"
+#include <math.h>
+#include <algorithm>
+#include <assert.h>
+
+
+static inline float SignNotZero(float _V)
+{
+    return _V < 0.0f ? -1.0f : 1.0f;
+}
+
+
+static inline void EncodeOct(float _X, float _Y, float _Z, int8_t* _pOut)
+{
+    const float invL1 = 1.0f / (fabsf(_X) + fabsf(_Y) + fabsf(_Z));
+    float ox = _X * invL1;
+    float oy = _Y * invL1;
+    if (_Z < 0.0f)
+    {
+        const float foldX = (1.0f - fabsf(oy)) * SignNotZero(ox);
+        const float foldY = (1.0f - fabsf(ox)) * SignNotZero(oy);
+        ox = foldX;
+        oy = foldY;
+    }
+    // rounds to the nearest even, the same as _mm_cvtps_epi32
+    _pOut[0] = (int8_t)lrintf(ox * 127.0f);
+    _pOut[1] = (int8_t)lrintf(oy * 127.0f);
+}
+
+
+// the point of the octahedron, not normalized
+static inline void DecodeOct(const int8_t* _pIn, float& _OutX, float& _OutY, float& _OutZ)
+{
+    float x = _pIn[0] * (1.0f / 127.0f);
+    float y = _pIn[1] * (1.0f / 127.0f);
+    _OutZ = 1.0f - fabsf(x) - fabsf(y);
+    if (_OutZ < 0.0f)
+    {
+        const float unfoldX = (1.0f - fabsf(y)) * SignNotZero(x);
+        const float unfoldY = (1.0f - fabsf(x)) * SignNotZero(y);
+        x = unfoldX;
+        y = unfoldY;
+    }
+    _OutX = x;
+    _OutY = y;
+}
+
+
+// _pRow0.._pRow2 are the rows above, at and below the output row, at the first inner sample ([-1] is the border).
+// The normal is (-dz/dx, -dz/dy, 1) with the gradient of the Sobel operator.
+static void ComputeNormalRowScalar(const float* _pRow0, const float* _pRow1, const float* _pRow2, size_t _Count,
+    float _SlopeScale, int8_t* _pOut)
+{
+    for (size_t i = 0; i < _Count; ++i)
+    {
+        const float gx = (_pRow0[i + 1] - _pRow0[i - 1]) + 2.0f * (_pRow1[i + 1] - _pRow1[i - 1]) + (_pRow2[i + 1] - _pRow2[i - 1]);
+        const float gy = (_pRow2[i - 1] - _pRow0[i - 1]) + 2.0f * (_pRow2[i] - _pRow0[i]) + (_pRow2[i + 1] - _pRow0[i + 1]);
+        EncodeOct(-(gx * _SlopeScale), -(gy * _SlopeScale), 1.0f, _pOut + i * 2);
+    }
+}
+
+
+#if MAPVIEWER_SSE2
+// 4 normals at a time, the same operations in the same order as the scalar code
+static void ComputeNormalRowSSE2(const float* _pRow0, const float* _pRow1, const float* _pRow2, size_t _Count,
+    float _SlopeScale, int8_t* _pOut)
+{
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 snormScale = _mm_set1_ps(127.0f);
+    const __m128 slopeScale = _mm_set1_ps(_SlopeScale);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    size_t i = 0;
+    for (; i + 4 <= _Count; i += 4)
+    {
+        const __m128 r0l = _mm_loadu_ps(_pRow0 + i - 1), r0c = _mm_loadu_ps(_pRow0 + i), r0r = _mm_loadu_ps(_pRow0 + i + 1);
+        const __m128 r1l = _mm_loadu_ps(_pRow1 + i - 1), r1r = _mm_loadu_ps(_pRow1 + i + 1);
+        const __m128 r2l = _mm_loadu_ps(_pRow2 + i - 1), r2c = _mm_loadu_ps(_pRow2 + i), r2r = _mm_loadu_ps(_pRow2 + i + 1);
+        const __m128 gx = _mm_add_ps(_mm_add_ps(_mm_sub_ps(r0r, r0l), _mm_mul_ps(two, _mm_sub_ps(r1r, r1l))), _mm_sub_ps(r2r, r2l));
+        const __m128 gy = _mm_add_ps(_mm_add_ps(_mm_sub_ps(r2l, r0l), _mm_mul_ps(two, _mm_sub_ps(r2c, r0c))), _mm_sub_ps(r2r, r0r));
+        const __m128 nx = _mm_xor_ps(_mm_mul_ps(gx, slopeScale), signMask);
+        const __m128 ny = _mm_xor_ps(_mm_mul_ps(gy, slopeScale), signMask);
+
+        // z = 1 is never below the equator, there's nothing to fold
+        const __m128 l1 = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(signMask, nx), _mm_andnot_ps(signMask, ny)), one);
+        const __m128 invL1 = _mm_div_ps(one, l1);
+        const __m128i ox = _mm_cvtps_epi32(_mm_mul_ps(_mm_mul_ps(nx, invL1), snormScale));
+        const __m128i oy = _mm_cvtps_epi32(_mm_mul_ps(_mm_mul_ps(ny, invL1), snormScale));
+
+        // x0..x3 y0..y3 as bytes, interleaved into x0 y0 x1 y1 ...
+        const __m128i bytes = _mm_packs_epi16(_mm_packs_epi32(ox, oy), _mm_setzero_si128());
+        _mm_storel_epi64((__m128i*)(_pOut + i * 2), _mm_unpacklo_epi8(bytes, _mm_srli_si128(bytes, 4)));
+    }
+    ComputeNormalRowScalar(_pRow0 + i, _pRow1 + i, _pRow2 + i, _Count - i, _SlopeScale, _pOut + i * 2);
+}
+#endif
+
+
+// ComputeNormalGrid, _bScalar forces the scalar kernel
+static void ComputeNormalRows(const float* _pElevations, size_t _Stride, unsigned int _Extent, float _Spacing, float _VerticalScale,
+    std::vector<int8_t>& _OutNormals, bool _bScalar)
+{
+    // the Sobel weights sum up to 4 on each side of the sample, 2 samples apart
+    const float slopeScale = _VerticalScale / (8.0f * _Spacing);
+    _OutNormals.resize((size_t)_Extent * _Extent * 2);
+    for (size_t y = 0; y < _Extent; ++y)
+    {
+        const float* pRow1 = _pElevations + y * _Stride;
+        int8_t* pOut = _OutNormals.data() + y * _Extent * 2;
+#if MAPVIEWER_SSE2
+        if (!_bScalar)
+        {
+            ComputeNormalRowSSE2(pRow1 - _Stride, pRow1, pRow1 + _Stride, _Extent, slopeScale, pOut);
+            continue;
+        }
+#endif
+        ComputeNormalRowScalar(pRow1 - _Stride, pRow1, pRow1 + _Stride, _Extent, slopeScale, pOut);
+    }
+}
+
+
+void ComputeNormalGrid(const float* _pElevations, size_t _Stride, unsigned int _Extent, float _Spacing, float _VerticalScale,
+    std::vector<int8_t>& _OutNormals)
+{
+    ComputeNormalRows(_pElevations, _Stride, _Extent, _Spacing, _VerticalScale, _OutNormals, false);
+}
+
+
+void detail::ComputeNormalGridScalar(const float* _pElevations, size_t _Stride, unsigned int _Extent, float _Spacing, float _VerticalScale,
+    std::vector<int8_t>& _OutNormals)
+{
+    ComputeNormalRows(_pElevations, _Stride, _Extent, _Spacing, _VerticalScale, _OutNormals, true);
+}
+
+
+NormalGridSampler::NormalGridSampler(const int8_t* _pNormals, unsigned int _Extent, float _Scale, float _OffsetX, float _OffsetY)
+    : m_pNormals(_pNormals)
+    , m_Extent(_Extent)
+    , m_Scale(_Scale)
+    , m_OffsetX(_OffsetX)
+    , m_OffsetY(_OffsetY)
+    , m_MaxCoord((float)(_Extent - 1))
+    , m_MaxCell((int)_Extent - 2)
+{
+    assert(_Extent >= 2);
+}
+
+
+void NormalGridSampler::Sample(Span<const float> _X, Span<const float> _Y, Span<float> _OutX, Span<float> _OutY, Span<float> _OutZ) const
+{
+    assert(_X.size() == _Y.size() && _X.size() == _OutX.size() && _X.size() == _OutY.size() && _X.size() == _OutZ.size());
+    for (size_t i = 0; i < _X.size(); ++i)
+    {
+        const float fx = std::min(std::max(0.0f, _X[i] * m_Scale + m_OffsetX), m_MaxCoord);
+        const float fy = std::min(std::max(0.0f, _Y[i] * m_Scale + m_OffsetY), m_MaxCoord);
+        const int ix = std::min((int)fx, m_MaxCell);
+        const int iy = std::min((int)fy, m_MaxCell);
+        const float tx = fx - (float)ix;
+        const float ty = fy - (float)iy;
+
+        const int8_t* p = m_pNormals + ((size_t)iy * m_Extent + ix) * 2;
+        float c[4][3];
+        DecodeOct(p, c[0][0], c[0][1], c[0][2]);
+        DecodeOct(p + 2, c[1][0], c[1][1], c[1][2]);
+        DecodeOct(p + m_Extent * 2, c[2][0], c[2][1], c[2][2]);
+        DecodeOct(p + m_Extent * 2 + 2, c[3][0], c[3][1], c[3][2]);
+        float n[3];
+        for (int a = 0; a < 3; ++a)
+        {
+            const float n0 = c[0][a] + (c[1][a] - c[0][a]) * tx;
+            const float n1 = c[2][a] + (c[3][a] - c[2][a]) * tx;
+            n[a] = n0 + (n1 - n0) * ty;
+        }
+
+        // opposite corners can cancel out, that keeps the up normal
+        const float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        const float invLen = (len > 0.0f) ? (1.0f / len) : 0.0f;
+        _OutX[i] = n[0] * invLen;
+        _OutY[i] = n[1] * invLen;
+        _OutZ[i] = (len > 0.0f) ? (n[2] * invLen) : 1.0f;
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Span.h"
+
+// Terrain normals on the samples of an elevation map, oct-encoded: a normal is projected onto the octahedron
+// |x| + |y| + |z| = 1 and stored as the snorm8 x and y (2 bytes per sample, the half of the lower hemisphere
+// is folded over the upper one, which the terrain never needs).
+
+// Normals of the _Extent x _Extent samples of an elevation map from the Sobel gradient. _pElevations is the first of
+// them, rows are _Stride floats apart and the samples around them (rows and columns -1 and _Extent) are read too.
+// _Spacing is the distance between the samples and _VerticalScale scales the elevations, both into the space of the
+// meshes.
+void ComputeNormalGrid(const float* _pElevations, size_t _Stride, unsigned int _Extent, float _Spacing, float _VerticalScale,
+    std::vector<int8_t>& _OutNormals);
+
+// Bilinear lookups of a normal grid, a position maps to (_OffsetX + x * _Scale, _OffsetY + y * _Scale) in samples
+// the same way as in BasicElevationSampler. The sampler doesn't own the grid, it has to outlive the sampler.
+class NormalGridSampler
+{
+public:
+    NormalGridSampler(const int8_t* _pNormals, unsigned int _Extent, float _Scale, float _OffsetX, float _OffsetY);
+
+    // Unit normals at the positions, all of the spans are of the same size
+    void Sample(Span<const float> _X, Span<const float> _Y, Span<float> _OutX, Span<float> _OutY, Span<float> _OutZ) const;
+
+private:
+    const int8_t* m_pNormals;
+    unsigned int m_Extent;
+    float m_Scale;
+    float m_OffsetX;
+    float m_OffsetY;
+    float m_MaxCoord;
+    int m_MaxCell;
+};
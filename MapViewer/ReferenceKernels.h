@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "ElevationMap.h"
+#include "ElevationSampler.h"
+#include "ElevationMinMax.h"
+#include "NormalGrid.h"
+#include "Scene.h"
+
+// The scalar code paths of the SIMD kernels, the references the SIMD code is bit-exact with,
+// and the previous versions of the reworked algorithms.
+// Not part of the API, only for maptests and the baselines of mapbench.
+namespace detail
+{
+    // LoadTerrariumElevationMap with the scalar pixel decoding
+    bool LoadTerrariumElevationMapScalar(const char* _pData, size_t _Size, unsigned int& _OutExtent, std::vector<float>& _OutElevationMap,
+        unsigned int _Border = 0);
+
+    // DownsampleElevationMaps with the scalar code
+    void DownsampleElevationMapsScalar(const QuantizedElevationMapView _Children[4], unsigned int _Extent, std::vector<float>& _OutElevationMap,
+        unsigned int _Border = 0);
+
+    // Batched BasicElevationSampler::Sample with the scalar code, one Sample(x, y) after the other
+    template<typename T>
+    void SampleElevationsScalar(const BasicElevationSampler<T>& _Sampler, Span<const float> _X, Span<const float> _Y, Span<float> _OutZ);
+
+    // ComputeNormalGrid with the scalar kernel
+    void ComputeNormalGridScalar(const float* _pElevations, size_t _Stride, unsigned int _Extent, float _Spacing, float _VerticalScale,
+        std::vector<int8_t>& _OutNormals);
+
+    // SubdivideMesh with the original edge map adjacency (O(n^2) edge search, nested std::maps),
+    // repeating single midpoint steps until stable. Same triangles as SubdivideMesh, in another order.
+    bool SubdivideMeshEdgeMap(const std::vector<unsigned int>& _Indices, const std::vector<float>& _Vertices, float _MinDist,
+        std::vector<unsigned int>& _OutIndices, std::vector<float>& _OutVertices);
+
+    // Scene::StitchMeshes comparing every edge vertex of A with every one of B (O(a * b)), in the order of the vertices
+    void StitchMeshesAllPairs(std::vector<SceneMeshes::TileMeshes::MeshData>& _MeshesA,
+        std::vector<SceneMeshes::TileMeshes::MeshData>& _MeshesB, StitchSide _Side);
+
+    // BuildMinMaxTreeScalar (ElevationMinMaxTree::Build with the scalar reductions) is declared in ElevationMinMax.h,
+    // it's a friend of the tree
+}
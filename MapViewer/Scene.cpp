@@ -2,17 +2,69 @@
 
 #include "VTZeroRead.h"
 #include "Tesselator.h"
-#include "ElevationMap.h"
+#include "ElevationSampler.h"
+#include "ElevationCache.h"
 #include "MeshSubdivision.h"
 #include "MeshConstructor.h"
 #include "Utils.h"
+#include "TaskScheduler.h"
+#include "SceneCache.h"
+#include "MappedFile.h"
+#include "ReferenceKernels.h"
 
 #include "IOGMath.h"
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+
+
+static std::string GetDemFilename(const std::string& _AssetsPath, int _ZoomLevel, const ZoomLevelConfig::TileConfig& _Cfg)
+{
+    std::stringstream DemFileStr;
+    DemFileStr << _AssetsPath << "dem/dem_" << _ZoomLevel << "_" <<
+        _Cfg.TileCoordX << "_" << _Cfg.TileCoordY << ".png";
+    return DemFileStr.str();
+}
+
+
+static std::string GetDemRawFilename(const std::string& _Directory, int _ZoomLevel, const ZoomLevelConfig::TileConfig& _Cfg)
+{
+    std::stringstream DemFileStr;
+    DemFileStr << _Directory << "dem_" << _ZoomLevel << "_" <<
+        _Cfg.TileCoordX << "_" << _Cfg.TileCoordY << ".raw";
+    return DemFileStr.str();
+}
+
+
+static std::string GetMvtFilename(const std::string& _AssetsPath, int _ZoomLevel, const ZoomLevelConfig::TileConfig& _Cfg)
+{
+    std::stringstream MvtFileStr;
+    MvtFileStr << _AssetsPath << "mvt/mvt_" << _ZoomLevel << "_" <<
+        _Cfg.TileCoordX << "_" << _Cfg.TileCoordY << ".mvt";
+    return MvtFileStr.str();
+}
 
 
 Scene::Scene()
 {
     SetupConfigs();
+    m_pElevationCache.reset(new ElevationCache([this](int _Zoom, int _X, int _Y)
+    {
+        return GetDemFilename(m_AssetsPath, _Zoom, { _X, _Y });
+    }));
+    SetRawElevationFiles(true);
+    SetDerivedElevationLevels(m_bDeriveDemLevels);
+    for (const auto& t : allowedTypes)
+    {
+        m_MeshLayers.push_back(t.first);
+    }
+    for (int i = 0; i < STAGE_COUNT; ++i)
+    {
+        m_StageNanoseconds[i] = 0;
+        m_StageItems[i] = 0;
+    }
+    m_SkippedTileBytes = 0;
 }
 
 
@@ -44,258 +96,686 @@ void Scene::SetupConfigs()
 }
 
 
-bool Scene::Load(const std::string& _AssetsPath)
+bool Scene::Load(const std::string& _AssetsPath, unsigned int _NumThreads)
 {
+    double startTime = GetTime();
+    if (m_AssetsPath != _AssetsPath)
+    {
+        m_pElevationCache->Clear();
+    }
     m_AssetsPath = _AssetsPath;
-    for (auto zoomLevelCfg : g_ZoomLevelConfigs)
+    m_SceneMeshes = SceneMeshes();
+    const ElevationCacheStats demStatsBefore = m_pElevationCache->GetStats();
+    for (int i = 0; i < STAGE_COUNT; ++i)
+    {
+        m_StageNanoseconds[i] = 0;
+        m_StageItems[i] = 0;
+    }
+    m_SkippedTileBytes = 0;
+
+    // Set up all of the zoom levels and tiles first: tasks keep references to them,
+    // so nothing may be added to the scene while they are running.
+    for (const auto& zoomLevelCfg : g_ZoomLevelConfigs)
     {
         auto& CurZoomLevel = m_SceneMeshes.ZoomLevels[zoomLevelCfg.ZoomLevel];
         CurZoomLevel.TilesInRow = zoomLevelCfg.TilesInRow;
-        LoadZoomLevel(zoomLevelCfg);
+        CurZoomLevel.Tiles.resize(zoomLevelCfg.TileCoords.size());
+        for (size_t tileCfgId = 0; tileCfgId < zoomLevelCfg.TileCoords.size(); ++tileCfgId)
+        {
+            auto& CurTile = CurZoomLevel.Tiles.at(tileCfgId);
+            CurTile.ZoomLevel = zoomLevelCfg.ZoomLevel;
+            CurTile.TileX = tileCfgId / CurZoomLevel.TilesInRow;
+            CurTile.TileY = tileCfgId % CurZoomLevel.TilesInRow;
+            CurTile.Bounds.SetMinMax(OGVec3(0.0f, 0.0f, 0.0f), OGVec3(0.0f, 0.0f, 0.0f));
+        }
     }
 
-    StitchTiles();
+    TaskScheduler scheduler(_NumThreads);
+    for (const auto& zoomLevelCfg : g_ZoomLevelConfigs)
+    {
+        LoadZoomLevel(zoomLevelCfg, scheduler);
+    }
+    scheduler.Wait();
+
+    m_LoadStats = SceneLoadStats();
+    m_LoadStats.WallTime = GetTime() - startTime;
+    for (int i = 0; i < STAGE_COUNT; ++i)
+    {
+        m_LoadStats.StageTime[i] = (double)m_StageNanoseconds[i] * 1e-9;
+        m_LoadStats.StageItems[i] = m_StageItems[i];
+    }
+    m_LoadStats.SkippedTileBytes = m_SkippedTileBytes;
+    const ElevationCacheStats demStats = m_pElevationCache->GetStats();
+    m_LoadStats.DemDecodes = demStats.Decodes - demStatsBefore.Decodes;
+    m_LoadStats.DemRawFileLoads = demStats.RawFileLoads - demStatsBefore.RawFileLoads;
+    m_LoadStats.DemDerived = demStats.Derived - demStatsBefore.Derived;
+    m_LoadStats.DemCacheHits = demStats.Hits + demStats.InFlightWaits - demStatsBefore.Hits - demStatsBefore.InFlightWaits;
+    CountLoadedMeshes();
 
     return true;
 }
 
 
-void Scene::LoadZoomLevel(const ZoomLevelConfig& _Cfg)
+void Scene::SampleElevations(int _ZoomLevel, Span<const double> _Lon, Span<const double> _Lat, Span<float> _OutElevations)
+{
+    m_pElevationCache->SampleElevations(_ZoomLevel, m_MaxDemFallbackLevels, _Lon, _Lat, _OutElevations);
+}
+
+
+void Scene::SetElevationCacheBudget(size_t _Bytes)
+{
+    m_pElevationCache->SetBudget(_Bytes);
+}
+
+
+void Scene::SetRawElevationFiles(bool _bEnabled, const std::string& _Directory)
+{
+    if (!_bEnabled)
+    {
+        m_pElevationCache->SetRawFilename(nullptr);
+        return;
+    }
+    m_pElevationCache->SetRawFilename([this, _Directory](int _Zoom, int _X, int _Y)
+    {
+        return GetDemRawFilename(_Directory.empty() ? m_AssetsPath + "dem/" : _Directory, _Zoom, { _X, _Y });
+    });
+}
+
+
+void Scene::SetDerivedElevationLevels(bool _bEnabled)
+{
+    m_bDeriveDemLevels = _bEnabled;
+    int leafZoom = -1;
+    if (_bEnabled)
+    {
+        for (const auto& zl : g_ZoomLevelConfigs)
+        {
+            leafZoom = std::max(leafZoom, zl.ZoomLevel);
+        }
+    }
+    // the tiles already in the cache were built the other way
+    m_pElevationCache->Clear();
+    m_pElevationCache->SetLeafZoom(leafZoom);
+}
+
+
+void Scene::ReleaseMeshData()
+{
+    for (auto& zl : m_SceneMeshes.ZoomLevels)
+    {
+        for (auto& t : zl.second.Tiles)
+        {
+            for (auto pMeshes : { &t.TerrainMeshes, &t.WaterMeshes, &t.LanduseMeshes })
+            {
+                for (auto& m : *pMeshes)
+                {
+                    std::vector<uint32_t>().swap(m.Indices);
+                    std::vector<float>().swap(m.Vertices);
+                    m.MappedIndices = Span<const uint32_t>();
+                    m.MappedVertices = Span<const float>();
+                }
+            }
+        }
+    }
+    m_SceneMeshes.pCacheFile.reset();
+}
+
+
+void Scene::CountLoadedMeshes()
+{
+    for (const auto& zl : m_SceneMeshes.ZoomLevels)
+    {
+        m_LoadStats.NumTiles += zl.second.Tiles.size();
+        for (const auto& t : zl.second.Tiles)
+        {
+            for (auto pMeshes : { &t.TerrainMeshes, &t.WaterMeshes, &t.LanduseMeshes })
+            {
+                for (const auto& m : *pMeshes)
+                {
+                    ++m_LoadStats.NumMeshes;
+                    m_LoadStats.NumTriangles += m.GetIndices().size() / 3;
+                    m_LoadStats.NumVertices += m.GetVertices().size() / 6;
+                }
+            }
+        }
+    }
+}
+
+
+bool Scene::LoadCached(const std::string& _AssetsPath, const std::string& _CacheFilename, unsigned int _NumThreads)
+{
+    double startTime = GetTime();
+    uint64_t key = ComputeCacheKey(_AssetsPath);
+    if (LoadSceneCache(_CacheFilename, key, m_SceneMeshes))
+    {
+        m_AssetsPath = _AssetsPath;
+        m_LoadStats = SceneLoadStats();
+        m_LoadStats.FromCache = true;
+        m_LoadStats.WallTime = GetTime() - startTime;
+        CountLoadedMeshes();
+        return true;
+    }
+
+    if (!Load(_AssetsPath, _NumThreads))
+    {
+        return false;
+    }
+
+    // failing to write the cache only costs the next startup
+    SaveSceneCache(_CacheFilename, key, m_SceneMeshes);
+    return true;
+}
+
+
+uint64_t Scene::ComputeCacheKey(const std::string& _AssetsPath) const
+{
+    // bump when the way the meshes are built changes
+    const uint32_t PIPELINE_VERSION = 10;
+
+    CacheKeyHash hash;
+    hash.AddValue(PIPELINE_VERSION);
+    hash.AddValue(m_MaxEdgeLength);
+    hash.AddValue(m_MaxDemFallbackLevels);
+    hash.AddValue(m_bDeriveDemLevels);
+    hash.AddValue(m_bStitchTiles);
+    for (const auto& t : allowedTypes)
+    {
+        hash.Add(t.first);
+        hash.AddValue((int)t.second);
+    }
+
+    // the whole content of every source file, a missing file hashes as empty
+    for (const auto& zl : g_ZoomLevelConfigs)
+    {
+        hash.AddValue(zl.ZoomLevel);
+        hash.AddValue(zl.TilesInRow);
+        for (const auto& tc : zl.TileCoords)
+        {
+            hash.AddValue(tc.TileCoordX);
+            hash.AddValue(tc.TileCoordY);
+            for (const auto& filename : { GetDemFilename(_AssetsPath, zl.ZoomLevel, tc), GetMvtFilename(_AssetsPath, zl.ZoomLevel, tc) })
+            {
+                MappedFile file;
+                file.Open(filename);
+                hash.AddValue((uint64_t)file.GetSize());
+                hash.Add(file.GetData(), file.GetSize());
+            }
+        }
+    }
+    return hash.Get();
+}
+
+
+void Scene::AddStageTime(LoadStage _Stage, double _StartTime, uint64_t _NumItems)
+{
+    m_StageNanoseconds[_Stage] += (uint64_t)((GetTime() - _StartTime) * 1e9);
+    m_StageItems[_Stage] += _NumItems;
+}
+
+
+void Scene::LoadZoomLevel(const ZoomLevelConfig& _Cfg, TaskScheduler& _Scheduler)
 {
     auto& CurZoomLevel = m_SceneMeshes.ZoomLevels[_Cfg.ZoomLevel];
-    CurZoomLevel.TilesInRow = _Cfg.TilesInRow;
+
+    // with stitching, the tiles of the zoom level are stitched together once all of them are loaded,
+    // otherwise nothing waits for the whole level and every tile is finished on its own
+    const bool bStitch = m_bStitchTiles;
+    TaskScheduler::Task* pStitchTask = nullptr;
+    if (bStitch)
+    {
+        const ZoomLevelConfig* pCfg = &_Cfg;
+        pStitchTask = _Scheduler.CreateTask([this, pCfg, &CurZoomLevel]()
+        {
+            StitchTiles(*pCfg, CurZoomLevel);
+            for (auto& t : CurZoomLevel.Tiles)
+            {
+                ComputeTileBounds(t);
+            }
+        });
+    }
 
     for (size_t tileCfgId = 0; tileCfgId < _Cfg.TileCoords.size(); ++tileCfgId)
     {
-        CurZoomLevel.Tiles.push_back(SceneMeshes::TileMeshes());
         auto& CurTile = CurZoomLevel.Tiles.at(tileCfgId);
-        CurTile.ZoomLevel = _Cfg.ZoomLevel;
-        CurTile.TileX = tileCfgId / CurZoomLevel.TilesInRow;
-        CurTile.TileY = tileCfgId % CurZoomLevel.TilesInRow;
-        LoadTile(CurTile, _Cfg.TileCoords[tileCfgId]);
+        const auto& TileCfg = _Cfg.TileCoords[tileCfgId];
+        TaskScheduler::Task* pTileTask = _Scheduler.CreateTask([this, &CurTile, &TileCfg, &_Scheduler]()
+        {
+            LoadTile(CurTile, TileCfg, _Scheduler);
+        });
+
+        // polygon meshes are merged once the tile and all of it's polygon tasks are finished
+        TaskScheduler::Task* pMergeTask = _Scheduler.CreateTask([this, &CurTile, bStitch]()
+        {
+            MergeTileMeshes(CurTile);
+            if (!bStitch)
+            {
+                ComputeTileBounds(CurTile);
+            }
+        });
+        _Scheduler.AddDependency(pMergeTask, pTileTask);
+        if (pStitchTask)
+        {
+            _Scheduler.AddDependency(pStitchTask, pMergeTask);
+        }
+        _Scheduler.Submit(pTileTask);
+        _Scheduler.Submit(pMergeTask);
+    }
+    if (pStitchTask)
+    {
+        _Scheduler.Submit(pStitchTask);
     }
 }
 
 
-void Scene::LoadTile(SceneMeshes::TileMeshes& _CurTile, const ZoomLevelConfig::TileConfig& _Cfg)
+void Scene::LoadTile(SceneMeshes::TileMeshes& _CurTile, const ZoomLevelConfig::TileConfig& _Cfg, TaskScheduler& _Scheduler)
 {
-    std::stringstream DemFileStr;
-    DemFileStr << "dem/dem_" << _CurTile.ZoomLevel << "_" <<
-        _Cfg.TileCoordX << "_" << _Cfg.TileCoordY << ".png";
-    std::vector<float> elevationMap;
-    unsigned int extents = 0;
-    if (!LoadTerrariumElevationMap(m_AssetsPath + DemFileStr.str(), extents, elevationMap))
+    int demLevelsUp = 0;
+    double stageStart = GetTime();
+    ElevationTilePtr pElevationMap = m_pElevationCache->GetOrAncestor(_CurTile.ZoomLevel, _Cfg.TileCoordX, _Cfg.TileCoordY,
+        m_MaxDemFallbackLevels, demLevelsUp);
+    if (!pElevationMap)
     {
         // TODO: better error handling here and further
         return;
     }
-
-    std::stringstream MvtFileStr;
-    MvtFileStr << "mvt/mvt_" << _CurTile.ZoomLevel << "_" <<
-        _Cfg.TileCoordX << "_" << _Cfg.TileCoordY << ".mvt";
-    Tile t;
-    if (!ReadTile(m_AssetsPath + MvtFileStr.str(), t))
+    AddStageTime(STAGE_ELEVATION_MAP, stageStart, 1);
+
+    // the terrain under the tile is the box of a tile without meshes, the meshes replace it if there are any
+    float minElevation = 0.0f;
+    float maxElevation = 0.0f;
+    pElevationMap->GetElevationRange(demLevelsUp, _Cfg.TileCoordX, _Cfg.TileCoordY, minElevation, maxElevation);
+    const float elevationScale = GetElevationScale(_CurTile.ZoomLevel);
+    _CurTile.Bounds.SetMinMax(OGVec3(0.0f, 0.0f, minElevation * elevationScale),
+        OGVec3(VECTOR_TILE_EXTENT, VECTOR_TILE_EXTENT, maxElevation * elevationScale));
+
+    auto pTile = std::make_shared<Tile>();
+    stageStart = GetTime();
+    size_t skippedBytes = 0;
+    if (!ReadTile(GetMvtFilename(m_AssetsPath, _CurTile.ZoomLevel, _Cfg), m_MeshLayers, *pTile, &skippedBytes))
     {
         return;
     }
+    m_SkippedTileBytes += skippedBytes;
+    AddStageTime(STAGE_READ_TILE, stageStart, 1);
 
-    for (auto l : t.m_Layers)
+    // Add an empty mesh for every polygon first, so the meshes keep their order
+    // and don't move in memory while the polygon tasks are filling them.
+    struct PolygonMesh
+    {
+        const Polygon* pPolygon;
+        std::vector<SceneMeshes::TileMeshes::MeshData>* pMeshes;
+        size_t MeshId;
+    };
+    std::vector<PolygonMesh> polygonMeshes;
+    for (const auto& l : pTile->m_Layers)
     {
         auto type = allowedTypes.find(l.m_Name);
         if (type != allowedTypes.end())
         {
-            for (auto f : l.m_Features)
+            std::vector<SceneMeshes::TileMeshes::MeshData>* pMeshes = nullptr;
+            switch (type->second)
+            {
+            case TERRAIN: pMeshes = &_CurTile.TerrainMeshes; break;
+            case WATER: pMeshes = &_CurTile.WaterMeshes; break;
+            case LANDUSE: pMeshes = &_CurTile.LanduseMeshes; break;
+            }
+            if (!pMeshes)
+            {
+                continue;
+            }
+
+            for (const auto& f : l.m_Features)
             {
-                if (!f.m_Rings.empty())
+                for (const auto& p : f.m_Polygons)
                 {
-                    for (auto r : f.m_Rings)
-                    {
-                        std::vector<float> verts2D;
-                        std::vector<uint32_t> indices;
-                        TesselateRing(r, indices, verts2D);
-
-                        std::vector<float> verts2DFine;
-                        std::vector<uint32_t> indicesFine;
-
-                        std::vector<uint32_t>* pIndicesIn = &indices;
-                        std::vector<float>* pVerticesIn = &verts2D;
-                        std::vector<uint32_t>* pIndicesOut = &indicesFine;
-                        std::vector<float>* pVerticesOut = &verts2DFine;
-                        bool needSubdivision = true;
-                        while (needSubdivision)
-                        {
-                            needSubdivision = SubdivideMesh(*pIndicesIn, *pVerticesIn, 500.0f, *pIndicesOut, *pVerticesOut);
-                            if (needSubdivision)
-                            {
-                                std::swap(pIndicesIn, pIndicesOut);
-                                std::swap(pVerticesIn, pVerticesOut);
-                                pIndicesOut->clear();
-                                pVerticesOut->clear();
-                            }
-                            else
-                            {
-                                SceneMeshes::TileMeshes::MeshData* pMesh = nullptr;
-                                switch (type->second)
-                                {
-                                case TERRAIN:
-                                    {
-                                        _CurTile.TerrainMeshes.push_back(SceneMeshes::TileMeshes::MeshData());
-                                        pMesh = &(_CurTile.TerrainMeshes.at(_CurTile.TerrainMeshes.size() - 1));
-                                    }
-                                    break;
-                                case WATER:
-                                    {
-                                        _CurTile.WaterMeshes.push_back(SceneMeshes::TileMeshes::MeshData());
-                                        pMesh = &(_CurTile.WaterMeshes.at(_CurTile.WaterMeshes.size() - 1));
-                                    }
-                                    break;
-                                case LANDUSE:
-                                    {
-                                        _CurTile.LanduseMeshes.push_back(SceneMeshes::TileMeshes::MeshData());
-                                        pMesh = &(_CurTile.LanduseMeshes.at(_CurTile.LanduseMeshes.size() - 1));
-                                    }
-                                    break;
-                                }
-                                if (pMesh)
-                                {
-                                    ConstructMesh(_CurTile.ZoomLevel, *pIndicesIn, *pVerticesIn, elevationMap, pMesh->Vertices);
-                                    pMesh->Indices.assign(pIndicesIn->begin(), pIndicesIn->end());
-                                }
-                                break;
-                            }
-                        }
-                    }
+                    polygonMeshes.push_back({ &p, pMeshes, pMeshes->size() });
+                    pMeshes->push_back(SceneMeshes::TileMeshes::MeshData());
                 }
             }
         }
     }
+
+    // the samplers only point into the map, the tasks keep the map alive
+    QuantizedElevationSampler elevation = pElevationMap->GetSampler(demLevelsUp, _Cfg.TileCoordX, _Cfg.TileCoordY);
+    NormalGridSampler normals = pElevationMap->GetNormalSampler(demLevelsUp, _Cfg.TileCoordX, _Cfg.TileCoordY);
+
+    // every polygon is a child task, so the tile is finished only when all of it's polygons are
+    int zoomLevel = _CurTile.ZoomLevel;
+    TaskScheduler::Task* pTileTask = TaskScheduler::GetCurrentTask();
+    for (const auto& pm : polygonMeshes)
+    {
+        TaskScheduler::Task* pPolygonTask = _Scheduler.CreateTask([this, zoomLevel, pm, pTile, pElevationMap, elevation, normals]()
+        {
+            BuildPolygonMesh(zoomLevel, *pm.pPolygon, elevation, normals, pm.pMeshes->at(pm.MeshId));
+        }, pTileTask);
+        _Scheduler.Submit(pPolygonTask);
+    }
 }
 
 
-struct StitchInfo
+void Scene::BuildPolygonMesh(int _ZoomLevel, const Polygon& _Polygon, const QuantizedElevationSampler& _Elevation, const NormalGridSampler& _Normals, SceneMeshes::TileMeshes::MeshData& _OutMesh)
 {
-    int MeshA = -1;
-    int MeshB = -1;
-    StitchSide Side;
-};
+    std::vector<float> verts2D;
+    std::vector<uint32_t> indices;
+    double stageStart = GetTime();
+    TesselatePolygon(_Polygon, indices, verts2D);
+    AddStageTime(STAGE_TESSELATE, stageStart, indices.size() / 3);
+
+    std::vector<float> verts2DFine;
+    std::vector<uint32_t> indicesFine;
+
+    // refine the mesh, so no edge is longer than m_MaxEdgeLength
+    std::vector<uint32_t>* pIndices = &indices;
+    std::vector<float>* pVertices = &verts2D;
+    stageStart = GetTime();
+    if (SubdivideMesh(indices, verts2D, m_MaxEdgeLength, indicesFine, verts2DFine))
+    {
+        pIndices = &indicesFine;
+        pVertices = &verts2DFine;
+    }
+    AddStageTime(STAGE_SUBDIVIDE, stageStart, pIndices->size() / 3);
+
+    stageStart = GetTime();
+    ConstructMesh(_ZoomLevel, *pVertices, _Elevation, _Normals, _OutMesh.Vertices);
+    _OutMesh.Bounds = ComputeMeshBounds(_OutMesh.Vertices);
+    AddStageTime(STAGE_CONSTRUCT_MESH, stageStart, pIndices->size() / 3);
+    _OutMesh.Indices.swap(*pIndices);
+}
+
 
-void Scene::StitchTiles()
+void Scene::MergeTileMeshes(SceneMeshes::TileMeshes& _Tile)
 {
-    // TODO: calculate it dynamically or move it to a tile config
-    std::map<int, std::vector<StitchInfo>> stitchSetup = {
-        {13, {{0, 2, STITCH_VER}, {0, 1, STITCH_HOR}, {1, 3, STITCH_VER}, {2, 3, STITCH_HOR}}},
-        {14, {{0, 4, STITCH_VER}, {4, 8, STITCH_VER},   {8, 12, STITCH_VER}, 
-              {1, 5, STITCH_VER}, {5, 9, STITCH_VER},   {9, 13, STITCH_VER},
-              {2, 6, STITCH_VER}, {6, 10, STITCH_VER},  {10, 14, STITCH_VER},
-              {3, 7, STITCH_VER}, {7, 11, STITCH_VER},  {11, 15, STITCH_VER},
-              {0, 1, STITCH_HOR}, {4, 5, STITCH_HOR}, {8, 9, STITCH_HOR},   {12, 13, STITCH_HOR},
-              {1, 2, STITCH_HOR}, {5, 6, STITCH_HOR}, {9, 10, STITCH_HOR},  {13, 14, STITCH_HOR},
-              {2, 3, STITCH_HOR}, {6, 7, STITCH_HOR}, {10, 11, STITCH_HOR}, {14, 15, STITCH_HOR}
-        }},
-    };
+    double stageStart = GetTime();
+    MergeMeshes(_Tile.TerrainMeshes);
+    MergeMeshes(_Tile.WaterMeshes);
+    MergeMeshes(_Tile.LanduseMeshes);
+    AddStageTime(STAGE_MERGE, stageStart, 1);
+}
 
-    for (auto& zl : m_SceneMeshes.ZoomLevels)
+
+void Scene::MergeMeshes(std::vector<SceneMeshes::TileMeshes::MeshData>& _Meshes)
+{
+    if (_Meshes.size() < 2)
+    {
+        return;
+    }
+
+    size_t numIndices = 0;
+    size_t numVertices = 0;
+    for (const auto& m : _Meshes)
     {
-        // nothing to stitch in a one-tile zoom level
-        if (zl.first == 12)
+        numIndices += m.Indices.size();
+        numVertices += m.Vertices.size();
+    }
+
+    SceneMeshes::TileMeshes::MeshData merged;
+    merged.Indices.reserve(numIndices);
+    merged.Vertices.reserve(numVertices);
+    bool bEmpty = true;
+    for (const auto& m : _Meshes)
+    {
+        if (m.Vertices.empty())
         {
             continue;
         }
 
-        auto stitchInfo = stitchSetup.find(zl.first);
-        if (stitchInfo != stitchSetup.end())
+        uint32_t baseVertex = (uint32_t)(merged.Vertices.size() / 6);
+        for (auto i : m.Indices)
+        {
+            merged.Indices.push_back(i + baseVertex);
+        }
+        merged.Vertices.insert(merged.Vertices.end(), m.Vertices.begin(), m.Vertices.end());
+
+        if (bEmpty)
+        {
+            merged.Bounds = m.Bounds;
+            bEmpty = false;
+        }
+        else
         {
-            for (auto si : stitchInfo->second)
+            merged.Bounds.EmbraceAABB(m.Bounds);
+        }
+    }
+
+    _Meshes.resize(1);
+    _Meshes[0] = std::move(merged);
+}
+
+
+void Scene::ComputeTileBounds(SceneMeshes::TileMeshes& _Tile)
+{
+    bool bEmpty = true;
+    for (auto pMeshes : { &_Tile.TerrainMeshes, &_Tile.WaterMeshes, &_Tile.LanduseMeshes })
+    {
+        for (const auto& m : *pMeshes)
+        {
+            if (m.Vertices.empty())
+            {
+                continue;
+            }
+            if (bEmpty)
+            {
+                _Tile.Bounds = m.Bounds;
+                bEmpty = false;
+            }
+            else
             {
-                StitchMeshes(zl.second.Tiles[si.MeshA].TerrainMeshes[0], zl.second.Tiles[si.MeshB].TerrainMeshes[0], si.Side);
+                _Tile.Bounds.EmbraceAABB(m.Bounds);
             }
         }
     }
+    // a tile without meshes keeps the terrain box set by LoadTile (or the zero box)
 }
 
 
-void Scene::StitchMeshes(SceneMeshes::TileMeshes::MeshData& _MeshA, SceneMeshes::TileMeshes::MeshData& _MeshB, StitchSide _Side)
+void Scene::StitchTiles(const ZoomLevelConfig& _Cfg, SceneMeshes::ZoomLevel& _Level)
 {
-    // since we're comparing an opposite edges (eg. right from the first tile and left from the second tile), let's 
-    // introduce a shift (horizontal or vertical) to pretend that tiles overlap, so we can measure distance conveniently
-    float TestShiftX = 0.f;
-    float TestShiftY = 0.f;
+    double stageStart = GetTime();
 
-    // Identify potential vertices to stitch from both tiles
-    std::vector<uint32_t> StitchSideA;
-    std::vector<uint32_t> StitchSideB;
-    if (_Side == STITCH_VER)
+    // the neighbours are found by their tile coordinates, so any grid of tiles is stitched
+    auto tileKey = [](int _X, int _Y)
     {
-        TestShiftX = 8192.0f;
+        return ((uint64_t)(uint32_t)_X << 32) | (uint32_t)_Y;
+    };
+    std::unordered_map<uint64_t, size_t> tileIds;
+    tileIds.reserve(_Cfg.TileCoords.size());
+    for (size_t i = 0; i < _Cfg.TileCoords.size(); ++i)
+    {
+        tileIds[tileKey(_Cfg.TileCoords[i].TileCoordX, _Cfg.TileCoords[i].TileCoordY)] = i;
+    }
 
-        for (size_t i = 0; i < _MeshA.Vertices.size(); i += 6)
+    for (size_t i = 0; i < _Cfg.TileCoords.size(); ++i)
+    {
+        const auto& tc = _Cfg.TileCoords[i];
+        auto& tileA = _Level.Tiles[i];
+        // the right neighbour shares the vertical edge, the one below the horizontal one
+        for (StitchSide side : { STITCH_VER, STITCH_HOR })
         {
-            float x = _MeshA.Vertices[i];
-            if (x >= 8191.0f && x <= 8193.0f)
+            auto it = (side == STITCH_VER) ? tileIds.find(tileKey(tc.TileCoordX + 1, tc.TileCoordY)) :
+                tileIds.find(tileKey(tc.TileCoordX, tc.TileCoordY + 1));
+            if (it == tileIds.end())
             {
-                StitchSideA.push_back(i / 6);
+                continue;
             }
+            auto& tileB = _Level.Tiles[it->second];
+            StitchMeshes(tileA.TerrainMeshes, tileB.TerrainMeshes, side);
+            StitchMeshes(tileA.WaterMeshes, tileB.WaterMeshes, side);
+            StitchMeshes(tileA.LanduseMeshes, tileB.LanduseMeshes, side);
         }
-        for (size_t i = 0; i < _MeshB.Vertices.size(); i += 6)
+    }
+    AddStageTime(STAGE_STITCH, stageStart, _Level.Tiles.size());
+}
+
+
+void Scene::StitchMeshes(std::vector<SceneMeshes::TileMeshes::MeshData>& _MeshesA, std::vector<SceneMeshes::TileMeshes::MeshData>& _MeshesB,
+    StitchSide _Side)
+{
+    // the vertices of the shared edge are at 8192 in A and at 0 in B on this axis, the other one runs along the edge
+    const size_t edgeAxis = (_Side == STITCH_VER) ? 0 : 1;
+    const size_t alongAxis = 1 - edgeAxis;
+    // pair vertices should be closer than this
+    const float maxDistance = 2.0f;
+
+    struct EdgeVertex
+    {
+        uint32_t Mesh;
+        uint32_t Vertex;
+        int Cell;
+    };
+
+    // candidates of B bucketed by their position along the edge in cells of maxDistance,
+    // so a vertex of A only looks into the buckets of 3 cells
+    std::vector<EdgeVertex> candidatesB;
+    for (size_t m = 0; m < _MeshesB.size(); ++m)
+    {
+        const auto& vertices = _MeshesB[m].Vertices;
+        for (size_t i = 0; i < vertices.size(); i += 6)
         {
-            float x = _MeshB.Vertices[i];
-            if (x >= 0.0f && x <= 1.0f)
+            if (vertices[i + edgeAxis] >= 0.0f && vertices[i + edgeAxis] <= 1.0f)
             {
-                StitchSideB.push_back(i / 6);
+                candidatesB.push_back({ (uint32_t)m, (uint32_t)(i / 6), (int)floorf(vertices[i + alongAxis] / maxDistance) });
             }
         }
     }
-    else
+    if (candidatesB.empty())
     {
-        TestShiftY = 8192.0f;
+        return;
+    }
 
-        for (size_t i = 0; i < _MeshA.Vertices.size(); i += 6)
+    // the cells are consecutive integers, so their low bits spread them evenly over the buckets.
+    // A counting sort fills the buckets and keeps the candidates of a bucket in order.
+    size_t numBuckets = 1;
+    while (numBuckets < candidatesB.size())
+    {
+        numBuckets *= 2;
+    }
+    const uint32_t bucketMask = (uint32_t)numBuckets - 1;
+    std::vector<uint32_t> bucketStart(numBuckets + 1, 0);
+    for (const auto& c : candidatesB)
+    {
+        ++bucketStart[((uint32_t)c.Cell & bucketMask) + 1];
+    }
+    for (size_t b = 0; b < numBuckets; ++b)
+    {
+        bucketStart[b + 1] += bucketStart[b];
+    }
+    std::vector<EdgeVertex> buckets(candidatesB.size());
+    std::vector<uint32_t> bucketFill(bucketStart.begin(), bucketStart.end() - 1);
+    for (const auto& c : candidatesB)
+    {
+        buckets[bucketFill[(uint32_t)c.Cell & bucketMask]++] = c;
+    }
+
+    // since we're comparing opposite edges, B is shifted by a tile to pretend that the tiles overlap
+    const float shiftX = (_Side == STITCH_VER) ? VECTOR_TILE_EXTENT : 0.0f;
+    const float shiftY = (_Side == STITCH_HOR) ? VECTOR_TILE_EXTENT : 0.0f;
+    for (auto& meshA : _MeshesA)
+    {
+        for (size_t a = 0; a < meshA.Vertices.size(); a += 6)
+        {
+            float* pA = &meshA.Vertices[a];
+            if (pA[edgeAxis] < 8191.0f || pA[edgeAxis] > 8193.0f)
+            {
+                continue;
+            }
+            const OGVec2 vA = OGVec2(pA[0], pA[1]);
+            const int cellA = (int)floorf(pA[alongAxis] / maxDistance);
+            for (int cell = cellA - 1; cell <= cellA + 1; ++cell)
+            {
+                const uint32_t bucket = (uint32_t)cell & bucketMask;
+                for (uint32_t e = bucketStart[bucket]; e < bucketStart[bucket + 1]; ++e)
+                {
+                    const EdgeVertex& candidate = buckets[e];
+                    if (candidate.Cell != cell)
+                    {
+                        continue;
+                    }
+                    auto& meshB = _MeshesB[candidate.Mesh];
+                    float* pB = &meshB.Vertices[(size_t)candidate.Vertex * 6];
+                    const OGVec2 vB = OGVec2(pB[0] + shiftX, pB[1] + shiftY);
+                    if (Dist2D(vA, vB) >= maxDistance)
+                    {
+                        continue;
+                    }
+
+                    // the resulting normal will be an average of both normals
+                    const OGVec3 vNorm = (OGVec3(pA[3], pA[4], pA[5]) + OGVec3(pB[3], pB[4], pB[5])).normalize();
+                    pA[3] = pB[3] = vNorm.x;
+                    pA[4] = pB[4] = vNorm.y;
+                    pA[5] = pB[5] = vNorm.z;
+
+                    // second tile mesh vertex is replaced by the first mesh vertex
+                    pB[0] = pA[0] - shiftX;
+                    pB[1] = pA[1] - shiftY;
+                    pB[2] = pA[2];
+                    const OGVec3 vMoved = OGVec3(pB[0], pB[1], pB[2]);
+                    meshB.Bounds.EmbraceAABB(IOGAabb(vMoved, vMoved));
+                }
+            }
+        }
+    }
+}
+
+
+void detail::StitchMeshesAllPairs(std::vector<SceneMeshes::TileMeshes::MeshData>& _MeshesA,
+    std::vector<SceneMeshes::TileMeshes::MeshData>& _MeshesB, StitchSide _Side)
+{
+    // the comparison of every edge vertex of A with every one of B
+    const size_t edgeAxis = (_Side == STITCH_VER) ? 0 : 1;
+    const float shiftX = (_Side == STITCH_VER) ? VECTOR_TILE_EXTENT : 0.0f;
+    const float shiftY = (_Side == STITCH_HOR) ? VECTOR_TILE_EXTENT : 0.0f;
+
+    // Identify potential vertices to stitch from both tiles, as (mesh, vertex) pairs
+    std::vector<std::pair<size_t, size_t> > stitchSideA;
+    std::vector<std::pair<size_t, size_t> > stitchSideB;
+    for (size_t m = 0; m < _MeshesA.size(); ++m)
+    {
+        const auto& vertices = _MeshesA[m].Vertices;
+        for (size_t i = 0; i < vertices.size(); i += 6)
         {
-            float y = _MeshA.Vertices[i + 1];
-            if (y >= 8191.0f && y <= 8193.0f)
+            if (vertices[i + edgeAxis] >= 8191.0f && vertices[i + edgeAxis] <= 8193.0f)
             {
-                StitchSideA.push_back(i / 6);
+                stitchSideA.push_back({ m, i });
             }
         }
-        for (size_t i = 0; i < _MeshB.Vertices.size(); i += 6)
+    }
+    for (size_t m = 0; m < _MeshesB.size(); ++m)
+    {
+        const auto& vertices = _MeshesB[m].Vertices;
+        for (size_t i = 0; i < vertices.size(); i += 6)
         {
-            float y = _MeshB.Vertices[i + 1];
-            if (y >= 0.0f && y <= 1.0f)
+            if (vertices[i + edgeAxis] >= 0.0f && vertices[i + edgeAxis] <= 1.0f)
             {
-                StitchSideB.push_back(i / 6);
+                stitchSideB.push_back({ m, i });
             }
         }
     }
 
     // visit all candidates from both tiles and find pairs to stitch
-    for (auto a : StitchSideA)
+    for (const auto& a : stitchSideA)
     {
-        OGVec2 vA = OGVec2(_MeshA.Vertices[a * 6 + 0], _MeshA.Vertices[a * 6 + 1]);
-        for (auto b : StitchSideB)
+        float* pA = &_MeshesA[a.first].Vertices[a.second];
+        const OGVec2 vA = OGVec2(pA[0], pA[1]);
+        for (const auto& b : stitchSideB)
         {
-            OGVec2 vB = OGVec2(_MeshB.Vertices[b * 6 + 0] + TestShiftX, _MeshB.Vertices[b * 6 + 1] + TestShiftY);
-
-            // pair vertices should be close enough
-            if (Dist2D(vA, vB) < 2.0f)
+            auto& meshB = _MeshesB[b.first];
+            float* pB = &meshB.Vertices[b.second];
+            const OGVec2 vB = OGVec2(pB[0] + shiftX, pB[1] + shiftY);
+            if (Dist2D(vA, vB) >= 2.0f)
             {
-                // the resulting normal will be an average of both normals
-                OGVec3 vNormA = OGVec3(_MeshA.Vertices[a * 6 + 3], _MeshA.Vertices[a * 6 + 4], _MeshA.Vertices[a * 6 + 5]);
-                OGVec3 vNormB = OGVec3(_MeshB.Vertices[b * 6 + 3], _MeshB.Vertices[b * 6 + 4], _MeshB.Vertices[b * 6 + 5]);
-                OGVec3 vNorm = (vNormA + vNormB).normalize();
-
-                _MeshA.Vertices[a * 6 + 3] = vNorm.x;
-                _MeshA.Vertices[a * 6 + 4] = vNorm.y; 
-                _MeshA.Vertices[a * 6 + 5] = vNorm.z;
-
-                _MeshB.Vertices[b * 6 + 3] = vNorm.x;
-                _MeshB.Vertices[b * 6 + 4] = vNorm.y;
-                _MeshB.Vertices[b * 6 + 5] = vNorm.z;
-
-                // second tile mesh vertex is replaced by the first mesh vertex
-                _MeshB.Vertices[b * 6 + 0] = _MeshA.Vertices[a * 6 + 0] - TestShiftX;
-                _MeshB.Vertices[b * 6 + 1] = _MeshA.Vertices[a * 6 + 1] - TestShiftY;
-                _MeshB.Vertices[b * 6 + 2] = _MeshA.Vertices[a * 6 + 2];
+                continue;
             }
+
+            const OGVec3 vNorm = (OGVec3(pA[3], pA[4], pA[5]) + OGVec3(pB[3], pB[4], pB[5])).normalize();
+            pA[3] = pB[3] = vNorm.x;
+            pA[4] = pB[4] = vNorm.y;
+            pA[5] = pB[5] = vNorm.z;
+
+            pB[0] = pA[0] - shiftX;
+            pB[1] = pA[1] - shiftY;
+            pB[2] = pA[2];
+            const OGVec3 vMoved = OGVec3(pB[0], pB[1], pB[2]);
+            meshB.Bounds.EmbraceAABB(IOGAabb(vMoved, vMoved));
         }
     }
 }
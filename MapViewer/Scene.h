@@ -2,6 +2,18 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "IOGAabb.h"
+#include "Span.h"
+#include "MappedFile.h"
+#include "ElevationSampler.h"
+#include "NormalGrid.h"
+
+class TaskScheduler;
+struct Polygon;
+class ElevationCache;
 
 enum MeshTypes
 {
@@ -16,6 +28,44 @@ enum StitchSide
     STITCH_VER
 };
 
+enum LoadStage
+{
+    STAGE_ELEVATION_MAP,
+    STAGE_READ_TILE,
+    STAGE_TESSELATE,
+    STAGE_SUBDIVIDE,
+    STAGE_CONSTRUCT_MESH,
+    STAGE_MERGE,
+    STAGE_STITCH,
+    STAGE_COUNT
+};
+
+// Statistics of the last Scene::Load call
+struct SceneLoadStats
+{
+    // seconds from start to finish
+    double WallTime = 0.0;
+    // the meshes came from the baked scene cache, no stage was run
+    bool FromCache = false;
+    uint64_t NumTiles = 0;
+    uint64_t NumMeshes = 0;
+    uint64_t NumTriangles = 0;
+    uint64_t NumVertices = 0;
+    // bytes of the tile layers that weren't decoded as no mesh is built from them
+    uint64_t SkippedTileBytes = 0;
+    // DEM tiles decoded by this load, mapped from their raw files, downsampled from their children
+    // and the ones the elevation cache already had
+    uint64_t DemDecodes = 0;
+    uint64_t DemRawFileLoads = 0;
+    uint64_t DemDerived = 0;
+    uint64_t DemCacheHits = 0;
+
+    // Per stage: seconds summed over all threads and number of processed items
+    // (tiles for elevation map, tile reading, merging and stitching, resulting triangles for the mesh stages)
+    double StageTime[STAGE_COUNT] = {};
+    uint64_t StageItems[STAGE_COUNT] = {};
+};
+
 struct ZoomLevelConfig
 {
     int ZoomLevel = -1;
@@ -40,12 +90,25 @@ struct SceneMeshes
 
         struct MeshData
         {
+            // meshes built by Scene::Load
             std::vector<uint32_t> Indices;
             std::vector<float> Vertices;
+            // meshes of a scene cache point into its mapping instead (see SceneMeshes::pCacheFile), their vectors stay empty
+            Span<const uint32_t> MappedIndices;
+            Span<const float> MappedVertices;
+            // tile space box, z is the elevation range
+            IOGAabb Bounds;
+
+            // The mesh to draw, from the mapping or from the vectors. 6 floats per vertex: position and normal.
+            Span<const uint32_t> GetIndices() const { return MappedIndices.empty() ? Span<const uint32_t>(Indices.data(), Indices.size()) : MappedIndices; }
+            Span<const float> GetVertices() const { return MappedVertices.empty() ? Span<const float>(Vertices.data(), Vertices.size()) : MappedVertices; }
         };
         std::vector<MeshData> TerrainMeshes;
         std::vector<MeshData> WaterMeshes;
         std::vector<MeshData> LanduseMeshes;
+
+        // embraces all of the meshes of the tile, a tile without meshes gets the box of the terrain under it
+        IOGAabb Bounds;
     };
 
     struct ZoomLevel
@@ -55,6 +118,8 @@ struct SceneMeshes
     };
 
     std::map<int, ZoomLevel> ZoomLevels;
+    // the scene cache the meshes were loaded from, keeps their views into it valid
+    MappedFilePtr pCacheFile;
 };
 
 class Scene
@@ -63,20 +128,86 @@ public:
     Scene();
     ~Scene();
 
-    bool Load(const std::string& _AssetsPath);
+    // Loads all of the tiles in parallel, _NumThreads = 0 uses all of the hardware threads.
+    // The result doesn't depend on the number of threads. Replaces whatever was loaded before,
+    // the decoded DEMs are kept in the elevation cache between the loads.
+    bool Load(const std::string& _AssetsPath, unsigned int _NumThreads = 0);
+
+    // Same as Load, but takes the meshes from _CacheFilename if it was baked from the same sources and
+    // parameters. Otherwise loads the scene and (re)writes the cache.
+    bool LoadCached(const std::string& _AssetsPath, const std::string& _CacheFilename, unsigned int _NumThreads = 0);
+
+    // Hash of the source tiles, DEMs and of the mesh building parameters
+    uint64_t ComputeCacheKey(const std::string& _AssetsPath) const;
     const SceneMeshes& GetData() const { return m_SceneMeshes; }
 
+    // Frees the vertices and indices of all of the meshes (and unmaps the scene cache), the tiles and their bounds
+    // are kept. Meant to be called once the meshes are uploaded to the GPU.
+    void ReleaseMeshData();
+    const SceneLoadStats& GetLoadStats() const { return m_LoadStats; }
+
+    // Elevations (meters) of WGS84 points (degrees) from the DEMs of _ZoomLevel in the assets of the last load,
+    // the tiles without one fall back to their ancestors like the meshes do. NaN where there is no DEM at all.
+    // Meant for large batches of points, see ElevationCache::SampleElevations.
+    void SampleElevations(int _ZoomLevel, Span<const double> _Lon, Span<const double> _Lat, Span<float> _OutElevations);
+
+    // Memory the decoded DEM tiles may take, the least recently used ones are dropped over it
+    void SetElevationCacheBudget(size_t _Bytes);
+    // Keeps the decoded DEMs in raw files next to their PNGs (dem/*.raw), so the next startups map them instead of
+    // decoding the PNGs again. A non-empty _Directory (ending with a slash) holds the files instead. On by default.
+    void SetRawElevationFiles(bool _bEnabled, const std::string& _Directory = std::string());
+    // Downsamples the DEMs of the lower zoom levels from the ones of the highest level, so the levels agree on the
+    // elevations. The own DEM of a tile is used where its children are missing. On by default.
+    void SetDerivedElevationLevels(bool _bEnabled);
+    // Welds the terrain, water and landuse meshes of the neighbour tiles of a zoom level once all of them are loaded.
+    // The tiles sample the DEM border, so their edges already agree up to the quantization of the elevations. Off by default.
+    void SetTileStitching(bool _bEnabled) { m_bStitchTiles = _bEnabled; }
+    const std::vector<ZoomLevelConfig>& GetZoomLevelConfigs() const { return g_ZoomLevelConfigs; }
+    // Layers of the tiles the meshes are built from
+    const std::vector<std::string>& GetMeshLayers() const { return m_MeshLayers; }
+    // No edge of the built meshes is longer than this
+    float GetMaxEdgeLength() const { return m_MaxEdgeLength; }
+
+    // Appends all of the meshes into the first one with rebased indices, so a tile has a single mesh per type
+    static void MergeMeshes(std::vector<SceneMeshes::TileMeshes::MeshData>& _Meshes);
+
+    // Welds the meshes of a type of two neighbour tiles along their shared edge (the right one of A for STITCH_VER,
+    // the bottom one for STITCH_HOR): the vertices of B within 2 units of one of A take its position and both take
+    // the average of their normals. Edge vertices are bucketed along the edge, so it's linear in the vertices.
+    static void StitchMeshes(std::vector<SceneMeshes::TileMeshes::MeshData>& _MeshesA, std::vector<SceneMeshes::TileMeshes::MeshData>& _MeshesB,
+        StitchSide _Side);
+
 private:
     void SetupConfigs();
-    void LoadZoomLevel(const ZoomLevelConfig& _Cfg);
-    void LoadTile(SceneMeshes::TileMeshes& _CurTile, const ZoomLevelConfig::TileConfig& _Cfg);
-    void StitchTiles();
-    void StitchMeshes(SceneMeshes::TileMeshes::MeshData& _MeshA, SceneMeshes::TileMeshes::MeshData& _MeshB, StitchSide _Side);
+    void CountLoadedMeshes();
+    void LoadZoomLevel(const ZoomLevelConfig& _Cfg, TaskScheduler& _Scheduler);
+    void LoadTile(SceneMeshes::TileMeshes& _CurTile, const ZoomLevelConfig::TileConfig& _Cfg, TaskScheduler& _Scheduler);
+    void MergeTileMeshes(SceneMeshes::TileMeshes& _Tile);
+    void BuildPolygonMesh(int _ZoomLevel, const Polygon& _Polygon, const QuantizedElevationSampler& _Elevation, const NormalGridSampler& _Normals, SceneMeshes::TileMeshes::MeshData& _OutMesh);
+    void StitchTiles(const ZoomLevelConfig& _Cfg, SceneMeshes::ZoomLevel& _Level);
+    void ComputeTileBounds(SceneMeshes::TileMeshes& _Tile);
+    void AddStageTime(LoadStage _Stage, double _StartTime, uint64_t _NumItems);
 
 private:
     std::vector<ZoomLevelConfig> g_ZoomLevelConfigs;
     std::map<std::string, MeshTypes> allowedTypes = { {"water", WATER}, {"earth", TERRAIN}/*, {"buildings", LANDUSE}*/ };
+    // names of allowedTypes, the only layers decoded from the tiles
+    std::vector<std::string> m_MeshLayers;
     std::string m_AssetsPath;
+    // no edge of the built meshes is longer than this
+    float m_MaxEdgeLength = 500.0f;
+    // a tile without a DEM samples the one of its nearest ancestor up to this many levels up
+    int m_MaxDemFallbackLevels = 2;
+    // see SetDerivedElevationLevels
+    bool m_bDeriveDemLevels = true;
+    bool m_bStitchTiles = false;
+    std::unique_ptr<ElevationCache> m_pElevationCache;
 
     SceneMeshes m_SceneMeshes;
+
+    // stage counters are updated from the loading tasks
+    std::atomic<uint64_t> m_StageNanoseconds[STAGE_COUNT];
+    std::atomic<uint64_t> m_StageItems[STAGE_COUNT];
+    std::atomic<uint64_t> m_SkippedTileBytes;
+    SceneLoadStats m_LoadStats;
 };
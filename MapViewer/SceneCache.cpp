@@ -0,0 +1,333 @@
+#include "SceneCache.h"
+#include "MappedFile.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+// File layout:
+//   CacheHeader
+//   CacheZoomLevel[NumZoomLevels]
+//   CacheTile[NumTiles]      tiles of all zoom levels, in zoom level order
+//   CacheMesh[NumMeshes]     meshes of all tiles, per tile: terrain, water, landuse
+//   vertex and index blobs, each one starts at a 16 byte aligned offset
+
+static const char g_CacheMagic[8] = { 'M', 'V', 'S', 'C', 'E', 'N', 'E', '\0' };
+static const uint32_t g_ByteOrderMark = 0x01020304;
+static const uint64_t g_BlobAlignment = 16;
+
+struct CacheHeader
+{
+    char Magic[8];
+    uint32_t Version;
+    uint32_t ByteOrder;
+    uint64_t Key;
+    uint64_t FileSize;
+    uint32_t NumZoomLevels;
+    uint32_t NumTiles;
+    uint32_t NumMeshes;
+    uint32_t Reserved;
+};
+
+struct CacheZoomLevel
+{
+    int32_t ZoomLevel;
+    int32_t TilesInRow;
+    uint32_t FirstTile;
+    uint32_t NumTiles;
+};
+
+struct CacheTile
+{
+    int32_t ZoomLevel;
+    int32_t TileX;
+    int32_t TileY;
+    uint32_t FirstMesh;
+    uint32_t NumMeshes[3];
+    float BoundsMin[3];
+    float BoundsMax[3];
+    // keeps the mesh table 8 byte aligned
+    uint32_t Reserved;
+};
+
+struct CacheMesh
+{
+    uint64_t VertexOffset;
+    uint64_t NumVertexFloats;
+    uint64_t IndexOffset;
+    uint64_t NumIndices;
+    float BoundsMin[3];
+    float BoundsMax[3];
+};
+
+
+void CacheKeyHash::Add(const void* _pData, size_t _Size)
+{
+    // 8 bytes per step, the sources are megabytes of data and are hashed on every startup
+    const unsigned char* p = (const unsigned char*)_pData;
+    size_t i = 0;
+    for (; i + 8 <= _Size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, p + i, 8);
+        m_Hash ^= word;
+        m_Hash *= 1099511628211ull;
+        m_Hash ^= m_Hash >> 32;
+    }
+    for (; i < _Size; ++i)
+    {
+        m_Hash ^= p[i];
+        m_Hash *= 1099511628211ull;
+    }
+}
+
+
+void CacheKeyHash::Add(const std::string& _Str)
+{
+    // length first, so consecutive strings can't alias
+    AddValue((uint64_t)_Str.size());
+    Add(_Str.data(), _Str.size());
+}
+
+
+static void StoreBounds(const IOGAabb& _Bounds, float* _pMin, float* _pMax)
+{
+    _pMin[0] = _Bounds.GetMin().x; _pMin[1] = _Bounds.GetMin().y; _pMin[2] = _Bounds.GetMin().z;
+    _pMax[0] = _Bounds.GetMax().x; _pMax[1] = _Bounds.GetMax().y; _pMax[2] = _Bounds.GetMax().z;
+}
+
+
+static IOGAabb RestoreBounds(const float* _pMin, const float* _pMax)
+{
+    return IOGAabb(OGVec3(_pMin[0], _pMin[1], _pMin[2]), OGVec3(_pMax[0], _pMax[1], _pMax[2]));
+}
+
+
+static uint64_t AlignOffset(uint64_t _Offset)
+{
+    return (_Offset + g_BlobAlignment - 1) & ~(g_BlobAlignment - 1);
+}
+
+
+bool SaveSceneCache(const std::string& _Filename, uint64_t _Key, const SceneMeshes& _Scene)
+{
+    std::vector<CacheZoomLevel> zoomLevels;
+    std::vector<CacheTile> tiles;
+    std::vector<CacheMesh> meshes;
+    std::vector<const SceneMeshes::TileMeshes::MeshData*> meshData;
+
+    for (const auto& zl : _Scene.ZoomLevels)
+    {
+        zoomLevels.push_back({ zl.first, zl.second.TilesInRow, (uint32_t)tiles.size(), (uint32_t)zl.second.Tiles.size() });
+        for (const auto& t : zl.second.Tiles)
+        {
+            CacheTile tile = {};
+            tile.ZoomLevel = t.ZoomLevel;
+            tile.TileX = t.TileX;
+            tile.TileY = t.TileY;
+            tile.FirstMesh = (uint32_t)meshes.size();
+            StoreBounds(t.Bounds, tile.BoundsMin, tile.BoundsMax);
+
+            const std::vector<SceneMeshes::TileMeshes::MeshData>* meshTypes[3] = { &t.TerrainMeshes, &t.WaterMeshes, &t.LanduseMeshes };
+            for (int type = 0; type < 3; ++type)
+            {
+                tile.NumMeshes[type] = (uint32_t)meshTypes[type]->size();
+                for (const auto& m : *meshTypes[type])
+                {
+                    CacheMesh mesh = {};
+                    mesh.NumVertexFloats = m.GetVertices().size();
+                    mesh.NumIndices = m.GetIndices().size();
+                    StoreBounds(m.Bounds, mesh.BoundsMin, mesh.BoundsMax);
+                    meshes.push_back(mesh);
+                    meshData.push_back(&m);
+                }
+            }
+            tiles.push_back(tile);
+        }
+    }
+
+    // blobs follow the tables
+    uint64_t offset = sizeof(CacheHeader) + zoomLevels.size() * sizeof(CacheZoomLevel) +
+        tiles.size() * sizeof(CacheTile) + meshes.size() * sizeof(CacheMesh);
+    for (auto& m : meshes)
+    {
+        m.VertexOffset = offset = AlignOffset(offset);
+        offset += m.NumVertexFloats * sizeof(float);
+        m.IndexOffset = offset = AlignOffset(offset);
+        offset += m.NumIndices * sizeof(uint32_t);
+    }
+
+    CacheHeader header = {};
+    memcpy(header.Magic, g_CacheMagic, sizeof(g_CacheMagic));
+    header.Version = SCENE_CACHE_VERSION;
+    header.ByteOrder = g_ByteOrderMark;
+    header.Key = _Key;
+    header.FileSize = offset;
+    header.NumZoomLevels = (uint32_t)zoomLevels.size();
+    header.NumTiles = (uint32_t)tiles.size();
+    header.NumMeshes = (uint32_t)meshes.size();
+
+    // written next to the target and renamed, so a reader never sees a partial file
+    std::string tmpFilename = _Filename + ".tmp";
+    FILE* fp = fopen(tmpFilename.c_str(), "wb");
+    if (!fp)
+    {
+        return false;
+    }
+
+    uint64_t written = 0;
+    auto write = [fp, &written](const void* _pData, size_t _Size)
+    {
+        if (_Size > 0)
+        {
+            written += fwrite(_pData, 1, _Size, fp);
+        }
+    };
+    auto pad = [fp, &written, &write](uint64_t _Offset)
+    {
+        static const char zeros[g_BlobAlignment] = {};
+        while (written < _Offset)
+        {
+            write(zeros, (size_t)std::min<uint64_t>(_Offset - written, g_BlobAlignment));
+        }
+    };
+
+    write(&header, sizeof(header));
+    write(zoomLevels.data(), zoomLevels.size() * sizeof(CacheZoomLevel));
+    write(tiles.data(), tiles.size() * sizeof(CacheTile));
+    write(meshes.data(), meshes.size() * sizeof(CacheMesh));
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        pad(meshes[i].VertexOffset);
+        const Span<const float> vertices = meshData[i]->GetVertices();
+        const Span<const uint32_t> indices = meshData[i]->GetIndices();
+        write(vertices.data(), vertices.size() * sizeof(float));
+        pad(meshes[i].IndexOffset);
+        write(indices.data(), indices.size() * sizeof(uint32_t));
+    }
+
+    bool bOk = (written == header.FileSize);
+    bOk = (fclose(fp) == 0) && bOk;
+    if (bOk)
+    {
+        remove(_Filename.c_str());
+        bOk = (rename(tmpFilename.c_str(), _Filename.c_str()) == 0);
+    }
+    if (!bOk)
+    {
+        remove(tmpFilename.c_str());
+    }
+    return bOk;
+}
+
+
+bool LoadSceneCache(const std::string& _Filename, uint64_t _Key, SceneMeshes& _OutScene)
+{
+    MappedFilePtr pFile = MappedFile::Load(_Filename);
+    if (!pFile || pFile->GetSize() < sizeof(CacheHeader))
+    {
+        return false;
+    }
+
+    const char* pData = pFile->GetData();
+    const uint64_t fileSize = pFile->GetSize();
+    const CacheHeader* pHeader = (const CacheHeader*)pData;
+    if (memcmp(pHeader->Magic, g_CacheMagic, sizeof(g_CacheMagic)) != 0 ||
+        pHeader->Version != SCENE_CACHE_VERSION ||
+        pHeader->ByteOrder != g_ByteOrderMark ||
+        pHeader->Key != _Key ||
+        pHeader->FileSize != fileSize)
+    {
+        return false;
+    }
+
+    uint64_t tablesSize = sizeof(CacheHeader) + (uint64_t)pHeader->NumZoomLevels * sizeof(CacheZoomLevel) +
+        (uint64_t)pHeader->NumTiles * sizeof(CacheTile) + (uint64_t)pHeader->NumMeshes * sizeof(CacheMesh);
+    if (tablesSize > fileSize)
+    {
+        return false;
+    }
+
+    const CacheZoomLevel* pZoomLevels = (const CacheZoomLevel*)(pData + sizeof(CacheHeader));
+    const CacheTile* pTiles = (const CacheTile*)(pZoomLevels + pHeader->NumZoomLevels);
+    const CacheMesh* pMeshes = (const CacheMesh*)(pTiles + pHeader->NumTiles);
+
+    // check every reference before touching the scene
+    for (uint32_t i = 0; i < pHeader->NumZoomLevels; ++i)
+    {
+        if ((uint64_t)pZoomLevels[i].FirstTile + pZoomLevels[i].NumTiles > pHeader->NumTiles)
+        {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < pHeader->NumTiles; ++i)
+    {
+        const CacheTile& t = pTiles[i];
+        if ((uint64_t)t.FirstMesh + t.NumMeshes[0] + t.NumMeshes[1] + t.NumMeshes[2] > pHeader->NumMeshes)
+        {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < pHeader->NumMeshes; ++i)
+    {
+        const CacheMesh& m = pMeshes[i];
+        if (m.VertexOffset % g_BlobAlignment != 0 || m.IndexOffset % g_BlobAlignment != 0 ||
+            m.VertexOffset > fileSize || m.NumVertexFloats > (fileSize - m.VertexOffset) / sizeof(float) ||
+            m.IndexOffset > fileSize || m.NumIndices > (fileSize - m.IndexOffset) / sizeof(uint32_t) ||
+            m.NumVertexFloats % 6 != 0 || m.NumIndices % 3 != 0)
+        {
+            return false;
+        }
+        // the meshes go to the GPU as they are, so a broken index must not point out of their vertices
+        const uint32_t* pIndices = (const uint32_t*)(pData + m.IndexOffset);
+        const uint64_t numVertices = m.NumVertexFloats / 6;
+        uint32_t maxIndex = 0;
+        for (uint64_t n = 0; n < m.NumIndices; ++n)
+        {
+            maxIndex = std::max(maxIndex, pIndices[n]);
+        }
+        if (m.NumIndices > 0 && maxIndex >= numVertices)
+        {
+            return false;
+        }
+    }
+
+    SceneMeshes scene;
+    for (uint32_t z = 0; z < pHeader->NumZoomLevels; ++z)
+    {
+        const CacheZoomLevel& zl = pZoomLevels[z];
+        auto& level = scene.ZoomLevels[zl.ZoomLevel];
+        level.TilesInRow = zl.TilesInRow;
+        level.Tiles.resize(zl.NumTiles);
+        for (uint32_t tileId = 0; tileId < zl.NumTiles; ++tileId)
+        {
+            const CacheTile& ct = pTiles[zl.FirstTile + tileId];
+            auto& tile = level.Tiles[tileId];
+            tile.ZoomLevel = ct.ZoomLevel;
+            tile.TileX = ct.TileX;
+            tile.TileY = ct.TileY;
+            tile.Bounds = RestoreBounds(ct.BoundsMin, ct.BoundsMax);
+
+            std::vector<SceneMeshes::TileMeshes::MeshData>* meshTypes[3] = { &tile.TerrainMeshes, &tile.WaterMeshes, &tile.LanduseMeshes };
+            uint32_t meshId = ct.FirstMesh;
+            for (int type = 0; type < 3; ++type)
+            {
+                meshTypes[type]->resize(ct.NumMeshes[type]);
+                for (auto& m : *meshTypes[type])
+                {
+                    const CacheMesh& cm = pMeshes[meshId++];
+                    const float* pVertices = (const float*)(pData + cm.VertexOffset);
+                    const uint32_t* pIndices = (const uint32_t*)(pData + cm.IndexOffset);
+                    // the meshes are drawn straight from the mapping, nothing is copied
+                    m.MappedVertices = Span<const float>(pVertices, cm.NumVertexFloats);
+                    m.MappedIndices = Span<const uint32_t>(pIndices, cm.NumIndices);
+                    m.Bounds = RestoreBounds(cm.BoundsMin, cm.BoundsMax);
+                }
+            }
+        }
+    }
+
+    scene.pCacheFile = pFile;
+    _OutScene = std::move(scene);
+    return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "Scene.h"
+
+// Binary cache of the final scene meshes. The file is memory mapped on load, all of the
+// vertex and index blobs are 16 byte aligned and addressed by offsets from the tile tables.
+// Bump the version whenever the layout changes.
+const uint32_t SCENE_CACHE_VERSION = 1;
+
+// 64 bit FNV-1a style hash (word at a time), used to build the cache keys
+class CacheKeyHash
+{
+public:
+    void Add(const void* _pData, size_t _Size);
+    void Add(const std::string& _Str);
+    template<typename T>
+    void AddValue(const T& _Value) { Add(&_Value, sizeof(T)); }
+
+    uint64_t Get() const { return m_Hash; }
+
+private:
+    uint64_t m_Hash = 14695981039346656037ull;
+};
+
+bool SaveSceneCache(const std::string& _Filename, uint64_t _Key, const SceneMeshes& _Scene);
+
+// Fails (leaving _OutScene untouched) if the file is missing, broken, of another version or was baked for another key.
+// Every index is checked against the vertices of its mesh, so a damaged file can't make the draws read out of them.
+// The meshes aren't copied: they point into the mapping of the file, which the scene keeps alive (SceneMeshes::pCacheFile).
+bool LoadSceneCache(const std::string& _Filename, uint64_t _Key, SceneMeshes& _OutScene);
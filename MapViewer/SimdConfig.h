@@ -0,0 +1,10 @@
+#pragma once
+
+// MAPVIEWER_SSE2 is 1 where the compiler targets SSE2, which is always the case on x64.
+// The kernels of the other targets fall back to their scalar code.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MAPVIEWER_SSE2 1
+#include <emmintrin.h>
+#else
+#define MAPVIEWER_SSE2 0
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// Non-owning view of a contiguous array, copying it copies two words
+template<typename T>
+class Span
+{
+public:
+    typedef typename std::remove_cv<T>::type value_type;
+
+    Span() = default;
+    Span(T* _pData, size_t _Size) : m_pData(_pData), m_Size(_Size) {}
+
+    T* data() const { return m_pData; }
+    size_t size() const { return m_Size; }
+    bool empty() const { return m_Size == 0; }
+
+    T* begin() const { return m_pData; }
+    T* end() const { return m_pData + m_Size; }
+
+    T& operator[](size_t _Id) const { return m_pData[_Id]; }
+
+private:
+    T* m_pData = nullptr;
+    size_t m_Size = 0;
+};
+
+typedef Span<const char> StringSpan;
+
+inline bool operator==(const StringSpan& _Str, const char* _Other)
+{
+    size_t len = strlen(_Other);
+    return _Str.size() == len && memcmp(_Str.data(), _Other, len) == 0;
+}
+
+inline bool operator==(const StringSpan& _Str, const std::string& _Other)
+{
+    return _Str.size() == _Other.size() && memcmp(_Str.data(), _Other.data(), _Other.size()) == 0;
+}
+
+inline std::string ToString(const StringSpan& _Str)
+{
+    return std::string(_Str.data(), _Str.size());
+}
@@ -0,0 +1,241 @@
+#include "TaskScheduler.h"
+#include <algorithm>
+
+
+struct TaskScheduler::Task
+{
+    std::function<void()> Func;
+    Task* Parent = nullptr;
+
+    // the task itself + it's unfinished children
+    std::atomic<int> OpenWork{ 1 };
+
+    // unfinished dependencies + 1 until the task is submitted
+    std::atomic<int> Dependencies{ 1 };
+    std::vector<Task*> Successors;
+};
+
+
+namespace
+{
+    // scheduler and queue of the calling thread (the thread calling Wait() uses queue 0)
+    thread_local const TaskScheduler* t_pScheduler = nullptr;
+    thread_local unsigned int t_QueueId = 0;
+    thread_local TaskScheduler::Task* t_pCurrentTask = nullptr;
+}
+
+
+TaskScheduler::TaskScheduler(unsigned int _NumThreads)
+    : m_NumQueued(0)
+    , m_NumUnfinished(0)
+{
+    if (_NumThreads == 0)
+    {
+        _NumThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned int i = 0; i < _NumThreads; ++i)
+    {
+        m_Queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+    for (unsigned int i = 1; i < _NumThreads; ++i)
+    {
+        m_Workers.push_back(std::thread(&TaskScheduler::WorkerLoop, this, i));
+    }
+}
+
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        m_Quit = true;
+    }
+    m_WakeCondition.notify_all();
+    for (auto& w : m_Workers)
+    {
+        w.join();
+    }
+}
+
+
+TaskScheduler::Task* TaskScheduler::CreateTask(std::function<void()> _Func, Task* _Parent)
+{
+    Task* pTask = new Task();
+    pTask->Func = std::move(_Func);
+    pTask->Parent = _Parent;
+    if (_Parent)
+    {
+        ++_Parent->OpenWork;
+    }
+    ++m_NumUnfinished;
+
+    std::lock_guard<std::mutex> lock(m_TasksMutex);
+    m_Tasks.push_back(std::unique_ptr<Task>(pTask));
+    return pTask;
+}
+
+
+void TaskScheduler::AddDependency(Task* _Task, Task* _DependsOn)
+{
+    ++_Task->Dependencies;
+    _DependsOn->Successors.push_back(_Task);
+}
+
+
+void TaskScheduler::Submit(Task* _Task)
+{
+    Release(_Task);
+}
+
+
+void TaskScheduler::Wait()
+{
+    t_pScheduler = this;
+    t_QueueId = 0;
+    while (m_NumUnfinished > 0)
+    {
+        Task* pTask = FindTask(0);
+        if (pTask)
+        {
+            Execute(pTask);
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock(m_WakeMutex);
+            m_WakeCondition.wait(lock, [this] { return m_NumQueued > 0 || m_NumUnfinished == 0; });
+        }
+    }
+    t_pScheduler = nullptr;
+
+    std::lock_guard<std::mutex> lock(m_TasksMutex);
+    m_Tasks.clear();
+}
+
+
+TaskScheduler::Task* TaskScheduler::GetCurrentTask()
+{
+    return t_pCurrentTask;
+}
+
+
+void TaskScheduler::WorkerLoop(unsigned int _QueueId)
+{
+    t_pScheduler = this;
+    t_QueueId = _QueueId;
+    for (;;)
+    {
+        Task* pTask = FindTask(_QueueId);
+        if (pTask)
+        {
+            Execute(pTask);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_WakeMutex);
+        m_WakeCondition.wait(lock, [this] { return m_Quit || m_NumQueued > 0; });
+        if (m_Quit)
+        {
+            break;
+        }
+    }
+}
+
+
+unsigned int TaskScheduler::GetQueueId() const
+{
+    // threads, which don't belong to the scheduler, share the queue with Wait()
+    return (t_pScheduler == this) ? t_QueueId : 0;
+}
+
+
+void TaskScheduler::Push(Task* _Task)
+{
+    WorkQueue& q = *m_Queues[GetQueueId()];
+    {
+        std::lock_guard<std::mutex> lock(q.Mutex);
+        q.Tasks.push_back(_Task);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        ++m_NumQueued;
+    }
+    m_WakeCondition.notify_one();
+}
+
+
+TaskScheduler::Task* TaskScheduler::FindTask(unsigned int _QueueId)
+{
+    // own queue first, newest task (LIFO keeps children of the current task hot in cache)
+    {
+        WorkQueue& q = *m_Queues[_QueueId];
+        std::lock_guard<std::mutex> lock(q.Mutex);
+        if (!q.Tasks.empty())
+        {
+            Task* pTask = q.Tasks.back();
+            q.Tasks.pop_back();
+            --m_NumQueued;
+            return pTask;
+        }
+    }
+
+    // then steal the oldest task from somebody else
+    size_t numQueues = m_Queues.size();
+    for (size_t i = 1; i < numQueues; ++i)
+    {
+        WorkQueue& q = *m_Queues[(_QueueId + i) % numQueues];
+        std::lock_guard<std::mutex> lock(q.Mutex);
+        if (!q.Tasks.empty())
+        {
+            Task* pTask = q.Tasks.front();
+            q.Tasks.pop_front();
+            --m_NumQueued;
+            return pTask;
+        }
+    }
+    return nullptr;
+}
+
+
+void TaskScheduler::Execute(Task* _Task)
+{
+    Task* pPrevTask = t_pCurrentTask;
+    t_pCurrentTask = _Task;
+    _Task->Func();
+    // release captured data right away, the task object itself lives until Wait() returns
+    _Task->Func = nullptr;
+    t_pCurrentTask = pPrevTask;
+
+    Finish(_Task);
+}
+
+
+void TaskScheduler::Finish(Task* _Task)
+{
+    while (_Task && --_Task->OpenWork == 0)
+    {
+        for (auto pSuccessor : _Task->Successors)
+        {
+            Release(pSuccessor);
+        }
+
+        // the task may be deleted by Wait() as soon as it's counted as finished
+        Task* pParent = _Task->Parent;
+        if (--m_NumUnfinished == 0)
+        {
+            // wake up Wait()
+            std::lock_guard<std::mutex> lock(m_WakeMutex);
+            m_WakeCondition.notify_all();
+        }
+        _Task = pParent;
+    }
+}
+
+
+void TaskScheduler::Release(Task* _Task)
+{
+    if (--_Task->Dependencies == 0)
+    {
+        Push(_Task);
+    }
+}
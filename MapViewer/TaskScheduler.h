@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing task scheduler.
+// Every thread owns a deque of tasks: it pushes and pops it's own tasks at the back
+// and, when it runs out of work, steals from the front of the other deques.
+// A task may spawn child tasks and counts as finished only when all of it's children are finished.
+// A task may also depend on other tasks, then it starts only when all of them are finished.
+class TaskScheduler
+{
+public:
+    struct Task;
+
+    // _NumThreads is the total number of threads including the one calling Wait(),
+    // 0 means one thread per hardware thread, 1 runs everything on the calling thread.
+    explicit TaskScheduler(unsigned int _NumThreads = 0);
+    ~TaskScheduler();
+
+    // Creates a task, it won't run until Submit() is called.
+    // If _Parent is set, the parent won't be finished until this task is.
+    Task* CreateTask(std::function<void()> _Func, Task* _Parent = nullptr);
+
+    // _Task will run only after _DependsOn is finished. Must be called before _DependsOn is submitted.
+    void AddDependency(Task* _Task, Task* _DependsOn);
+
+    // Hands the task to the scheduler, it runs as soon as all of it's dependencies are finished.
+    void Submit(Task* _Task);
+
+    // Runs tasks on the calling thread until all of the tasks are finished.
+    void Wait();
+
+    // Task executed by the calling thread, nullptr outside of tasks.
+    static Task* GetCurrentTask();
+
+    unsigned int GetNumThreads() const { return (unsigned int)m_Queues.size(); }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex Mutex;
+        std::deque<Task*> Tasks;
+    };
+
+    void WorkerLoop(unsigned int _QueueId);
+    void Push(Task* _Task);
+    Task* FindTask(unsigned int _QueueId);
+    void Execute(Task* _Task);
+    void Finish(Task* _Task);
+    void Release(Task* _Task);
+    unsigned int GetQueueId() const;
+
+private:
+    std::vector<std::unique_ptr<WorkQueue>> m_Queues;
+    std::vector<std::thread> m_Workers;
+
+    std::mutex m_TasksMutex;
+    std::vector<std::unique_ptr<Task>> m_Tasks;
+
+    std::mutex m_WakeMutex;
+    std::condition_variable m_WakeCondition;
+    std::atomic<int> m_NumQueued;
+    std::atomic<int> m_NumUnfinished;
+    bool m_Quit = false;
+};
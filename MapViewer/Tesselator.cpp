@@ -1,69 +1,63 @@
 #include "Tesselator.h"
 #include <vector>
 
+// earcut reads the tile points directly
+namespace mapbox {
+namespace util {
 
-bool TesselateRing(const Ring& _Ring, std::vector<uint32_t>& _OutIndices, std::vector<float>& _OutVertices)
-{
-	if (_Ring.m_OuterPoints.empty())
-		return false;
+template <> struct nth<0, vtzero::point> {
+	inline static int32_t get(const vtzero::point& t) { return t.x; };
+};
+template <> struct nth<1, vtzero::point> {
+	inline static int32_t get(const vtzero::point& t) { return t.y; };
+};
 
-	using Point = std::pair<int, int>;
-	std::vector<std::vector<Point>> polygon;
+}
+}
 
-	if (!_Ring.m_InnerPoints.empty())
-	{
-		polygon.resize(2);
-	}
-	else
-	{
-		polygon.resize(1);
-	}
 
-	auto& outer = polygon.at(0);
-	for (auto p : _Ring.m_OuterPoints)
-	{
-		Point newP = { p.x, p.y };
-		outer.push_back(newP);
-	}
-	if (polygon.size() == 2)
-	{
-		auto& inner = polygon.at(1);
-		for (auto p : _Ring.m_InnerPoints)
-		{
-			Point newP = { p.x, p.y };
-			inner.push_back(newP);
-		}
-	}
+namespace
+{
+	thread_local Tesselator t_Tesselator;
+}
 
-	_OutIndices = mapbox::earcut<uint32_t>(polygon);
-	if (_OutIndices.empty())
-	{
-		return false;
-	}
 
-	if (polygon.empty())
+bool Tesselator::Tesselate(const Polygon& _Polygon, std::vector<uint32_t>& _OutIndices, std::vector<float>& _OutVertices)
+{
+	if (_Polygon.m_OuterRing.empty())
 		return false;
 
-	size_t NumOuterPoints = _Ring.m_OuterPoints.size();
-	size_t NumInnerPoints = _Ring.m_InnerPoints.size();
-	size_t OutSize = NumOuterPoints * 2;
-	if (polygon.size() == 2)
+	m_Rings.clear();
+	m_Rings.push_back(_Polygon.m_OuterRing);
+	m_Rings.insert(m_Rings.end(), _Polygon.m_InnerRings.begin(), _Polygon.m_InnerRings.end());
+
+	m_Earcut(m_Rings);
+	if (m_Earcut.indices.empty())
 	{
-		OutSize += NumInnerPoints * 2;
+		return false;
 	}
-	_OutVertices.reserve(OutSize);
-	for (size_t oi = 0; oi < NumOuterPoints; ++oi)
+	_OutIndices.assign(m_Earcut.indices.begin(), m_Earcut.indices.end());
+
+	size_t NumPoints = 0;
+	for (const auto& ring : m_Rings)
 	{
-		_OutVertices.push_back((float)_Ring.m_OuterPoints[oi].x);
-		_OutVertices.push_back((float)_Ring.m_OuterPoints[oi].y);
+		NumPoints += ring.size();
 	}
-	if (polygon.size() == 2)
+	_OutVertices.resize(NumPoints * 2);
+	float* pOut = _OutVertices.data();
+	for (const auto& ring : m_Rings)
 	{
-		for (size_t oi = 0; oi < NumInnerPoints; ++oi)
+		for (const auto& p : ring)
 		{
-			_OutVertices.push_back((float)_Ring.m_InnerPoints[oi].x);
-			_OutVertices.push_back((float)_Ring.m_InnerPoints[oi].y);
+			*pOut++ = (float)p.x;
+			*pOut++ = (float)p.y;
 		}
 	}
 	return true;
 }
+
+
+bool TesselatePolygon(const Polygon& _Polygon, std::vector<uint32_t>& _OutIndices, std::vector<float>& _OutVertices)
+{
+	return t_Tesselator.Tesselate(_Polygon, _OutIndices, _OutVertices);
+}
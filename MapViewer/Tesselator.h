@@ -1,6 +1,21 @@
 #pragma once
-#include <mapbox\earcut.hpp>
+#include <mapbox/earcut.hpp>
 #include "VTZeroRead.h"
 #include <vector>
 
-bool TesselateRing(const Ring& _Ring, std::vector<uint32_t>& _OutIndices, std::vector<float>& _OutVertices);
+// Keeps the earcut node pool, the index buffer and the ring list between the calls, so
+// a lot of small polygons can be tesselated without allocating. One per thread.
+class Tesselator
+{
+public:
+	// Triangulates the polygon with all of its holes at once. The vertices are the points of
+	// the outer ring followed by the points of every hole, in order.
+	bool Tesselate(const Polygon& _Polygon, std::vector<uint32_t>& _OutIndices, std::vector<float>& _OutVertices);
+
+private:
+	mapbox::detail::Earcut<uint32_t> m_Earcut;
+	std::vector<PointSpan> m_Rings;
+};
+
+// Tesselates with the calling thread's Tesselator
+bool TesselatePolygon(const Polygon& _Polygon, std::vector<uint32_t>& _OutIndices, std::vector<float>& _OutVertices);
@@ -1,26 +1,25 @@
 #include "Utils.h"
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <unistd.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <dirent.h>
+#endif
 #include <string>
 #include <fstream>
+#include <stdexcept>
+#include <string.h>
+#include <chrono>
 
-std::string ReadFile(const std::string& _Filename)
+double GetTime()
 {
-    if (_Filename.empty())
-    {
-        return "";
-    }
-    std::ifstream stream{ _Filename, std::ios_base::in | std::ios_base::binary };
-    if (!stream)
-    {
-        throw std::runtime_error{ std::string{"Can not open file '"} +_Filename + "'" };
-    }
-    stream.exceptions(std::ifstream::failbit);
-    std::string buffer{ std::istreambuf_iterator<char>(stream.rdbuf()), std::istreambuf_iterator<char>() };
-    stream.close();
-    return buffer;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 
+#ifdef _WIN32
 std::string GetResourcePath()
 {
     char outPath[MAX_PATH] = { 0 };
@@ -42,3 +41,97 @@ std::string GetResourcePath()
     }
     return std::string(outPath);
 }
+#else
+std::string GetResourcePath()
+{
+    // directory of the executable
+    char outPath[PATH_MAX] = { 0 };
+    ssize_t len = readlink("/proc/self/exe", outPath, PATH_MAX - 1);
+    if (len <= 0)
+    {
+        return std::string(".");
+    }
+    outPath[len] = '\0';
+    char* pSlash = strrchr(outPath, '/');
+    if (pSlash)
+    {
+        *pSlash = '\0';
+    }
+    return std::string(outPath);
+}
+#endif
+
+
+#ifdef _WIN32
+TempDirectory::TempDirectory(const std::string& _Prefix)
+{
+    char tempPath[MAX_PATH + 1] = { 0 };
+    if (GetTempPathA(MAX_PATH + 1, tempPath) == 0)
+    {
+        return;
+    }
+    for (int i = 0; i < 100; ++i)
+    {
+        std::string path = std::string(tempPath) + _Prefix + std::to_string(GetCurrentProcessId()) + "_" + std::to_string(i);
+        if (CreateDirectoryA(path.c_str(), NULL))
+        {
+            m_Path = path + '\\';
+            return;
+        }
+    }
+}
+
+
+TempDirectory::~TempDirectory()
+{
+    if (m_Path.empty())
+    {
+        return;
+    }
+    WIN32_FIND_DATAA data;
+    HANDLE hFind = FindFirstFileA((m_Path + "*").c_str(), &data);
+    if (hFind != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            {
+                DeleteFileA((m_Path + data.cFileName).c_str());
+            }
+        } while (FindNextFileA(hFind, &data));
+        FindClose(hFind);
+    }
+    RemoveDirectoryA(m_Path.c_str());
+}
+#else
+TempDirectory::TempDirectory(const std::string& _Prefix)
+{
+    const char* pTempPath = getenv("TMPDIR");
+    std::string pattern = std::string(pTempPath && *pTempPath ? pTempPath : "/tmp") + "/" + _Prefix + "XXXXXX";
+    if (mkdtemp(&pattern[0]))
+    {
+        m_Path = pattern + '/';
+    }
+}
+
+
+TempDirectory::~TempDirectory()
+{
+    if (m_Path.empty())
+    {
+        return;
+    }
+    if (DIR* pDir = opendir(m_Path.c_str()))
+    {
+        while (dirent* pEntry = readdir(pDir))
+        {
+            if (strcmp(pEntry->d_name, ".") != 0 && strcmp(pEntry->d_name, "..") != 0)
+            {
+                unlink((m_Path + pEntry->d_name).c_str());
+            }
+        }
+        closedir(pDir);
+    }
+    rmdir(m_Path.c_str());
+}
+#endif
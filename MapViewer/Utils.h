@@ -3,5 +3,24 @@
 #include <fstream>
 #include <iostream>
 
-std::string ReadFile(const std::string& _Filename);
 std::string GetResourcePath();
+
+// Monotonic time in seconds (from an arbitrary point)
+double GetTime();
+
+// Directory created under the temp directory of the system, deleted along with its files on destruction
+class TempDirectory
+{
+public:
+    explicit TempDirectory(const std::string& _Prefix);
+    ~TempDirectory();
+
+    TempDirectory(const TempDirectory&) = delete;
+    TempDirectory& operator=(const TempDirectory&) = delete;
+
+    // Ends with a slash, empty if the directory couldn't be created
+    const std::string& GetPath() const { return m_Path; }
+
+private:
+    std::string m_Path;
+};
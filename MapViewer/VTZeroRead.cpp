@@ -4,188 +4,306 @@
 #include <limits>
 #include <stdexcept>
 #include "VTZeroRead.h"
-#include "Utils.h"
 
 
-vtzero::layer GetLayer(const vtzero::vector_tile& _Tile, const std::string& _LayerNameOrNum)
+// Writes the points straight into the tile points buffer, the geometry tables are reused between features
+class geom_handler
 {
-    vtzero::layer layer;
-    char* str_end = nullptr;
-    const long num = std::strtol(_LayerNameOrNum.c_str(), &str_end, 10);
+    vtzero::point* m_pTilePoints;
+    size_t m_Capacity;
+    size_t m_NumPoints = 0;
+    // first point of the geometry being decoded
+    size_t m_Begin = 0;
 
-    if (str_end == _LayerNameOrNum.data() + _LayerNameOrNum.size())
+public:
+    std::vector<Linestring> m_Linestrings;
+    std::vector<Points> m_Points;
+    // polygons of the feature being decoded, their holes are ranges of m_InnerRings
+    struct PendingPolygon
     {
-        if (num >= 0 && num < std::numeric_limits<long>::max())
-        {
-            layer = _Tile.get_layer(static_cast<std::size_t>(num));
-            if (!layer)
-            {
-                std::cerr << "No such layer: " << num << '\n';
-                std::exit(1);
-            }
-            return layer;
-        }
-    }
+        PointSpan OuterRing;
+        size_t FirstInnerRing;
+        size_t NumInnerRings;
+    };
+    std::vector<PendingPolygon> m_Polygons;
+    std::vector<PointSpan> m_InnerRings;
 
-    layer = _Tile.get_layer_by_name(_LayerNameOrNum);
-    if (!layer)
+public:
+    geom_handler(vtzero::point* _pTilePoints, size_t _Capacity)
+        : m_pTilePoints(_pTilePoints)
+        , m_Capacity(_Capacity)
     {
-        std::cerr << "No layer named '" << _LayerNameOrNum << "'.\n";
-        std::exit(1);
     }
-    return layer;
-}
 
+    void Reset()
+    {
+        m_Linestrings.clear();
+        m_Points.clear();
+        m_Polygons.clear();
+        m_InnerRings.clear();
+    }
 
-class geom_handler
-{
-    std::vector<vtzero::point> m_TmpPointsInRing;
+    size_t GetNumPoints() const { return m_NumPoints; }
 
-public:
-    std::vector<Linestring> m_Linestrings;
-    std::vector<Points> m_Points;
-    std::vector<Ring> m_Rings;
-
-public:
-    void points_begin(const uint32_t count) noexcept
+    void points_begin(const uint32_t count)
     {
+        Reserve(count);
         m_Points.push_back(Points());
-        m_Points.rbegin()->m_Points.reserve(count);
+        m_Begin = m_NumPoints;
     }
 
     void points_point(const vtzero::point point)
     {
-        assert(!m_Points.empty());
-        m_Points.rbegin()->m_Points.push_back(point);
+        AddPoint(point);
     }
 
-    void points_end() const noexcept
+    void points_end() noexcept
     {
+        m_Points.rbegin()->m_Points = CurrentSpan();
     }
 
     void linestring_begin(const uint32_t count)
     {
+        Reserve(count);
         m_Linestrings.push_back(Linestring());
-        m_Linestrings.rbegin()->m_Points.reserve(count);
+        m_Begin = m_NumPoints;
     }
 
     void linestring_point(const vtzero::point point)
     {
-        assert(!m_Linestrings.empty());
-        m_Linestrings.rbegin()->m_Points.push_back(point);
+        AddPoint(point);
     }
 
     void linestring_end()
     {
+        m_Linestrings.rbegin()->m_Points = CurrentSpan();
     }
 
     void ring_begin(const uint32_t count)
     {
-        m_TmpPointsInRing.reserve(count);
+        Reserve(count);
+        m_Begin = m_NumPoints;
     }
 
     void ring_point(const vtzero::point point)
     {
-        m_TmpPointsInRing.push_back(point);
+        AddPoint(point);
     }
 
     void ring_end(const vtzero::ring_type rt)
     {
-        if (m_Rings.empty())
-        {
-            m_Rings.push_back(Ring());
-        }
+        // every outer ring starts a new polygon, the inner rings following it are its holes
         switch (rt)
         {
         case vtzero::ring_type::outer:
-            m_Rings.rbegin()->m_OuterPoints = m_TmpPointsInRing;
-            m_TmpPointsInRing.clear();
+            m_Polygons.push_back({ CurrentSpan(), m_InnerRings.size(), 0 });
             break;
         case vtzero::ring_type::inner:
-            m_Rings.rbegin()->m_InnerPoints = m_TmpPointsInRing;
-            m_TmpPointsInRing.clear();
+            if (!m_Polygons.empty())
+            {
+                m_InnerRings.push_back(CurrentSpan());
+                ++m_Polygons.back().NumInnerRings;
+                break;
+            }
+            // a hole without an outer ring is invalid
+            m_NumPoints = m_Begin;
             break;
         default:
-            m_TmpPointsInRing.clear();
+            // drop the points of an invalid ring
+            m_NumPoints = m_Begin;
             break;
         }
     }
+
+private:
+    // vtzero announces the exact number of points of a geometry (with the closing point of a ring) before them,
+    // so the buffer is checked once per geometry instead of once per point
+    void Reserve(const uint32_t _NumPoints)
+    {
+        if (_NumPoints > m_Capacity - m_NumPoints)
+        {
+            throw std::runtime_error("tile points buffer overflow");
+        }
+    }
+
+    // the points of the geometry were reserved by its *_begin call
+    void AddPoint(const vtzero::point _Point)
+    {
+        m_pTilePoints[m_NumPoints++] = _Point;
+    }
+
+    PointSpan CurrentSpan() const
+    {
+        return PointSpan(m_pTilePoints + m_Begin, m_NumPoints - m_Begin);
+    }
 };
 
 
-static void ParseLayer(vtzero::layer& _Layer, Layer& _OutLayer)
+static StringSpan ToStringSpan(const vtzero::data_view& _Str)
+{
+    return StringSpan(_Str.data(), _Str.size());
+}
+
+
+static void ParseLayer(vtzero::layer& _Layer, geom_handler& _Handler, Arena& _Arena, Layer& _OutLayer)
 {
     _OutLayer.m_Name = std::string(_Layer.name());
     _OutLayer.m_Extent = _Layer.extent();
 
-    int feature_num = 0;
+    Span<Feature> features = _Arena.NewArray<Feature>(_Layer.num_features());
+    size_t feature_num = 0;
     while (auto feature = _Layer.next_feature())
     {
-        Feature f;
-        geom_handler gh;
-        vtzero::decode_geometry(feature.geometry(), gh);
-        f.m_Linestrings = gh.m_Linestrings;
-        f.m_Points = gh.m_Points;
-        f.m_Rings = gh.m_Rings;
+        if (feature_num == features.size())
+        {
+            break;
+        }
+
+        Feature& f = features[feature_num];
+        _Handler.Reset();
+        vtzero::decode_geometry(feature.geometry(), _Handler);
+        f.m_Linestrings = _Arena.Copy(_Handler.m_Linestrings.data(), _Handler.m_Linestrings.size());
+        f.m_Points = _Arena.Copy(_Handler.m_Points.data(), _Handler.m_Points.size());
+        Span<const PointSpan> innerRings = _Arena.Copy(_Handler.m_InnerRings.data(), _Handler.m_InnerRings.size());
+        Span<Polygon> polygons = _Arena.NewArray<Polygon>(_Handler.m_Polygons.size());
+        for (size_t i = 0; i < polygons.size(); ++i)
+        {
+            const auto& p = _Handler.m_Polygons[i];
+            polygons[i].m_OuterRing = p.OuterRing;
+            polygons[i].m_InnerRings = Span<const PointSpan>(innerRings.data() + p.FirstInnerRing, p.NumInnerRings);
+        }
+        f.m_Polygons = Span<const Polygon>(polygons.data(), polygons.size());
         while (auto property = feature.next_property())
         {
-            if (std::string(property.key()) == std::string("name"))
+            if (property.key() == vtzero::data_view("name"))
             {
-                f.m_Name = std::string(property.value().data());
+                auto value = property.value();
+                if (value.type() == vtzero::property_value_type::string_value)
+                {
+                    f.m_Name = ToStringSpan(value.string_value());
+                }
                 break;
             }
         }
         ++feature_num;
-        _OutLayer.m_Features.push_back(f);
     }
+    _OutLayer.m_Features = Span<const Feature>(features.data(), feature_num);
+}
+
+
+// Name of a layer message, found without constructing (and scanning) the whole layer
+static vtzero::data_view PeekLayerName(const vtzero::data_view _LayerData)
+{
+    protozero::pbf_message<vtzero::detail::pbf_layer> layerReader{ _LayerData };
+    while (layerReader.next())
+    {
+        if (layerReader.tag() == vtzero::detail::pbf_layer::name &&
+            layerReader.wire_type() == protozero::pbf_wire_type::length_delimited)
+        {
+            return layerReader.get_view();
+        }
+        layerReader.skip();
+    }
+    // 4.1 "A layer MUST contain a name field."
+    throw vtzero::format_exception{ "missing name in layer (spec 4.1)" };
 }
 
 
-void ReadLayers(vtzero::vector_tile& _Tile, Tile& _outTile)
+static bool IsWantedLayer(const vtzero::data_view _Name, const std::vector<std::string>& _WantedLayers)
+{
+    if (_WantedLayers.empty())
+    {
+        return true;
+    }
+    for (const auto& w : _WantedLayers)
+    {
+        if (_Name == vtzero::data_view(w))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static void ReadLayers(const vtzero::data_view _TileData, const std::vector<std::string>& _WantedLayers, Tile& _outTile, size_t& _OutSkippedBytes)
 {
     int layer_num = 0;
-    int feature_num = 0;
-    std::string layer_num_or_name;
-    try
+
+    if (!_outTile.m_pArena)
+    {
+        _outTile.m_pArena.reset(new Arena());
+    }
+    Arena& arena = *_outTile.m_pArena;
+
+    // pick the wanted layers first, the rest is never decoded
+    std::vector<vtzero::data_view> layersData;
+    size_t wantedBytes = 0;
+    protozero::pbf_message<vtzero::detail::pbf_tile> tileReader{ _TileData };
+    while (tileReader.next(vtzero::detail::pbf_tile::layers, protozero::pbf_wire_type::length_delimited))
     {
-        if (layer_num_or_name.empty())
+        const auto layerData = tileReader.get_view();
+        if (IsWantedLayer(PeekLayerName(layerData), _WantedLayers))
         {
-            while (auto layer = _Tile.next_layer())
-            {
-                Layer l;
-                ParseLayer(layer, l);
-                ++layer_num;
-                _outTile.m_Layers.push_back(l);
-            }
+            layersData.push_back(layerData);
+            wantedBytes += layerData.size();
         }
         else
         {
-            auto layer = GetLayer(_Tile, layer_num_or_name);
-            Layer l;
-            ParseLayer(layer, l);
-            _outTile.m_Layers.push_back(l);
+            _OutSkippedBytes += layerData.size();
+        }
+    }
+
+    // every encoded point takes at least two bytes, even the implicit closing points of
+    // the rings are covered by the command bytes, so this bounds the tile points buffer
+    Span<vtzero::point> points = arena.NewArray<vtzero::point>(wantedBytes / 2 + 1);
+    geom_handler gh(points.data(), points.size());
+    try
+    {
+        _outTile.m_Layers.reserve(_outTile.m_Layers.size() + layersData.size());
+        for (const auto& layerData : layersData)
+        {
+            vtzero::layer layer{ layerData };
+            _outTile.m_Layers.push_back(Layer());
+            ParseLayer(layer, gh, arena, _outTile.m_Layers.back());
+            ++layer_num;
         }
     }
     catch (const std::exception& e)
     {
-        std::cerr << "Error in layer " << layer_num << " (feature " << feature_num << "): " << e.what() << '\n';
+        std::cerr << "Error in layer " << layer_num << ": " << e.what() << '\n';
     }
+    _outTile.m_Points = PointSpan(points.data(), gh.GetNumPoints());
 }
 
 
 bool ReadTile(const std::string& _TileFilename, Tile& _outTile)
 {
-    int layer_num = 0;
-    int feature_num = 0;
+    return ReadTile(_TileFilename, std::vector<std::string>(), _outTile);
+}
+
+
+bool ReadTile(const std::string& _TileFilename, const std::vector<std::string>& _WantedLayers, Tile& _outTile, size_t* _pOutSkippedBytes)
+{
+    size_t skippedBytes = 0;
     try
     {
-        const auto data = ReadFile(_TileFilename);
-        vtzero::vector_tile vtzTile{ data };
-        ReadLayers(vtzTile, _outTile);
+        // vtzero decodes right from the mapped file, the tile keeps it alive for its strings
+        auto pFile = MappedFile::Load(_TileFilename);
+        if (!pFile)
+        {
+            return false;
+        }
+        _outTile.m_Sources.push_back(pFile);
+        ReadLayers(vtzero::data_view(pFile->GetData(), pFile->GetSize()), _WantedLayers, _outTile, skippedBytes);
     }
     catch (const std::exception&)
     {
         return false;
     }
+    if (_pOutSkippedBytes)
+    {
+        *_pOutSkippedBytes = skippedBytes;
+    }
     return true;
 }
@@ -1,38 +1,50 @@
 #pragma once
 #include <string>
 #include <map>
+#include <memory>
+#include <vector>
 #include <clara.hpp>
 #include <vtzero/vector_tile.hpp>
+#include "Arena.h"
+#include "MappedFile.h"
 
-struct Ring
+// Decoded tile geometry is flat: all of the points of a tile are stored in a single buffer
+// (Tile::m_Points) and everything else lives in the tile arena, except for the strings which point
+// straight into the mapped tile file. The structs below are just spans into that memory,
+// they stay valid as long as the Tile does and are cheap to copy.
+
+typedef Span<const vtzero::point> PointSpan;
+
+// Outer ring with all of its holes
+struct Polygon
 {
-	std::vector<vtzero::point> m_OuterPoints;
-	std::vector<vtzero::point> m_InnerPoints;
+	PointSpan m_OuterRing;
+	Span<const PointSpan> m_InnerRings;
 };
 
 struct Linestring
 {
-	std::vector<vtzero::point> m_Points;
+	PointSpan m_Points;
 };
 
 struct Points
 {
-	std::vector<vtzero::point> m_Points;
+	PointSpan m_Points;
 };
 
 struct Feature
 {
-	std::vector<Linestring> m_Linestrings;
-	std::vector<Points> m_Points;
-	std::vector<Ring> m_Rings;
+	Span<const Linestring> m_Linestrings;
+	Span<const Points> m_Points;
+	Span<const Polygon> m_Polygons;
 
-	std::string m_Name;
-	std::string m_Type;
+	StringSpan m_Name;
+	StringSpan m_Type;
 };
 
 struct Layer
 {
-	std::vector<Feature> m_Features;
+	Span<const Feature> m_Features;
 	std::string m_Name;
 	uint32_t m_Extent;
 };
@@ -40,6 +52,15 @@ struct Layer
 struct Tile
 {
 	std::vector<Layer> m_Layers;
+
+	PointSpan m_Points;
+	std::unique_ptr<Arena> m_pArena;
+	// files the tile was decoded from, the feature strings point into them
+	std::vector<MappedFilePtr> m_Sources;
 };
 
 bool ReadTile(const std::string& _TileFilename, Tile& _outTile);
+
+// Reads only the layers named in _WantedLayers (all of them if it's empty). The other layers are skipped
+// without being decoded, the number of their bytes goes to _pOutSkippedBytes.
+bool ReadTile(const std::string& _TileFilename, const std::vector<std::string>& _WantedLayers, Tile& _outTile, size_t* _pOutSkippedBytes = nullptr);
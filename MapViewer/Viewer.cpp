@@ -130,9 +130,12 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpszCmdLi
     if (!InitInstance(hInstance, nCmdShow))
         return FALSE;
 
-    g_Scene.Load(strPath);
+    // meshes are baked next to the executable on the first run
+    g_Scene.LoadCached(strPath, GetResourcePath() + std::string("/scene.cache"));
 
     LoadSceneData(g_Scene.GetData());
+    // the GPU has it's own copy now
+    g_Scene.ReleaseMeshData();
 
     SelectZoomLevel(12);
 
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <limits>
 #include <memory>
 #include <vector>
 
@@ -89,6 +90,8 @@ private:
     double minY, maxY;
     double inv_size = 0;
 
+    // The blocks are kept when the pool is reset, so an Earcut object used for
+    // many polygons stops allocating once it has seen the biggest one.
     template <typename T, typename Alloc = std::allocator<T>>
     class ObjectPool {
     public:
@@ -97,13 +100,18 @@ private:
             reset(blockSize_);
         }
         ~ObjectPool() {
-            clear();
+            for (const auto& allocation : allocations) {
+                alloc_traits::deallocate(alloc, allocation.first, allocation.second);
+            }
         }
         template <typename... Args>
         T* construct(Args&&... args) {
-            if (currentIndex >= blockSize) {
-                currentBlock = alloc_traits::allocate(alloc, blockSize);
-                allocations.emplace_back(currentBlock);
+            if (currentIndex >= currentSize) {
+                if (++currentBlockId == allocations.size()) {
+                    allocations.emplace_back(alloc_traits::allocate(alloc, blockSize), blockSize);
+                }
+                currentBlock = allocations[currentBlockId].first;
+                currentSize = allocations[currentBlockId].second;
                 currentIndex = 0;
             }
             T* object = &currentBlock[currentIndex++];
@@ -111,20 +119,21 @@ private:
             return object;
         }
         void reset(std::size_t newBlockSize) {
-            for (auto allocation : allocations) {
-                alloc_traits::deallocate(alloc, allocation, blockSize);
-            }
-            allocations.clear();
+            // the objects are trivially destructible, they're just forgotten
             blockSize = std::max<std::size_t>(1, newBlockSize);
             currentBlock = nullptr;
-            currentIndex = blockSize;
+            currentBlockId = std::size_t(-1);
+            currentIndex = 0;
+            currentSize = 0;
         }
         void clear() { reset(blockSize); }
     private:
         T* currentBlock = nullptr;
-        std::size_t currentIndex = 1;
+        std::size_t currentBlockId = std::size_t(-1);
+        std::size_t currentIndex = 0;
+        std::size_t currentSize = 0;
         std::size_t blockSize = 1;
-        std::vector<T*> allocations;
+        std::vector<std::pair<T*, std::size_t>> allocations;
         Alloc alloc;
         typedef typename std::allocator_traits<Alloc> alloc_traits;
     };
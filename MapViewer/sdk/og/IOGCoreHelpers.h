@@ -22,6 +22,7 @@
 #include <crtdbg.h>
 #endif
 #include <cstddef>
+#include <cstring>
 #include <algorithm>
 #include <iostream>
 #include <cstddef>
@@ -64,12 +65,17 @@
     #define OG_LOG_INFO(STR, ...)       NSLog(@STR, ##__VA_ARGS__)
 	#define OG_LOG_WARNING(STR, ...)    NSLog(@STR, ##__VA_ARGS__)
 	#define OG_LOG_ERROR(STR, ...)      NSLog(@STR, ##__VA_ARGS__)
-#else
+#elif defined(__ANDROID__)
     #include <jni.h>
     #include <android/log.h>
     #define OG_LOG_INFO(STR, ...)       __android_log_print(ANDROID_LOG_INFO, "liborangegrass", STR, ##__VA_ARGS__)
 	#define OG_LOG_WARNING(STR, ...)    __android_log_print(ANDROID_LOG_INFO, "liborangegrass", STR, ##__VA_ARGS__)
 	#define OG_LOG_ERROR(STR, ...)      __android_log_print(ANDROID_LOG_ERROR, "liborangegrass", STR, ##__VA_ARGS__)
+#else
+    #include <stdio.h>
+    #define OG_LOG_INFO(STR, ...)       {fprintf(stderr, "[INFO]: "); fprintf(stderr, STR, ## __VA_ARGS__); fprintf(stderr, "\n");}
+	#define OG_LOG_WARNING(STR, ...)    {fprintf(stderr, "[WARNING]: "); fprintf(stderr, STR, ## __VA_ARGS__); fprintf(stderr, "\n");}
+	#define OG_LOG_ERROR(STR, ...)      {fprintf(stderr, "[ERROR]: "); fprintf(stderr, STR, ## __VA_ARGS__); fprintf(stderr, "\n");}
 #endif
 #endif
 
@@ -39,23 +39,6 @@
 
 #define MAT(m,r,c) (m)[(c)*4+(r)]
 
-#define _11 0
-#define _12 1
-#define _13 2
-#define _14 3
-#define _21 4
-#define _22 5
-#define _23 6
-#define _24 7
-#define _31 8
-#define _32 9
-#define _33 10
-#define _34 11
-#define _41 12
-#define _42 13
-#define _43 14
-#define _44 15
-
 
 /*!***************************************************************************
 ** 4x4 floating point matrix
@@ -32,6 +32,16 @@ public:
 		const void* _pIndexData,
 		unsigned int _NumIndices) = 0;
 
+	// upload straight from the caller's buffers, no CPU side copy is kept
+	// (GetVertexData and GetIndexData return nullptr), the buffers may be freed right after the call.
+	virtual void Upload(
+		const void* _pVertexData,
+		unsigned int _NumVertices,
+		unsigned int _NumFaces,
+		unsigned int _Stride,
+		const void* _pIndexData,
+		unsigned int _NumIndices) = 0;
+
     // apply buffers.
     virtual void Apply () const = 0;
 
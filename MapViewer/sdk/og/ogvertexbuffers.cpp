@@ -85,21 +85,48 @@ void COGVertexBuffers::Fill(
 	m_pVertexData = malloc(VBOSize);
 	memcpy(m_pVertexData, _pVertexData, VBOSize);
 
-	glGenBuffers(1, &m_VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-	glBufferData(GL_ARRAY_BUFFER, VBOSize, m_pVertexData, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
 	if (_pIndexData)
 	{
 		//unsigned int IBOSize = _NumIndices * sizeof(GLshort);
 		unsigned int IBOSize = _NumIndices * sizeof(GLuint);
 		m_pIndexData = malloc(IBOSize);
 		memcpy(m_pIndexData, _pIndexData, IBOSize);
+	}
+
+	CreateBuffers(m_pVertexData, m_pIndexData);
+}
+
+
+void COGVertexBuffers::Upload(
+	const void* _pVertexData,
+	unsigned int _NumVertices,
+	unsigned int _NumFaces,
+	unsigned int _Stride,
+	const void* _pIndexData,
+	unsigned int _NumIndices)
+{
+	m_NumVertices = _NumVertices;
+	m_Stride = _Stride;
+	m_NumIndices = _NumIndices;
+	m_NumFaces = _NumFaces;
+
+	// GL copies the data on glBufferData, there is no need for a copy of our own
+	CreateBuffers(_pVertexData, _pIndexData);
+}
+
 
+void COGVertexBuffers::CreateBuffers(const void* _pVertexData, const void* _pIndexData)
+{
+	glGenBuffers(1, &m_VBO);
+	glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+	glBufferData(GL_ARRAY_BUFFER, m_NumVertices * m_Stride, _pVertexData, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (_pIndexData)
+	{
 		glGenBuffers(1, &m_IBO);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, IBOSize, m_pIndexData, GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_NumIndices * sizeof(GLuint), _pIndexData, GL_STATIC_DRAW);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	}
 }
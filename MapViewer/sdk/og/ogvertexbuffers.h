@@ -43,6 +43,14 @@ public:
 		const void* _pIndexData,
 		unsigned int _NumIndices);
 
+	virtual void Upload(
+		const void* _pVertexData,
+		unsigned int _NumVertices,
+		unsigned int _NumFaces,
+		unsigned int _Stride,
+		const void* _pIndexData,
+		unsigned int _NumIndices);
+
     // apply buffers.
     virtual void Apply () const;
 
@@ -50,7 +58,7 @@ public:
     virtual void Render () const;
 
     // is indexed
-    virtual bool IsIndexed() const { return (m_pIndexData != nullptr); }
+    virtual bool IsIndexed() const { return (m_IBO != 0); }
 
     // number of vertices
     virtual unsigned int GetNumVertices () const { return m_NumVertices; }
@@ -82,6 +90,11 @@ public:
     // is dynamic
     virtual bool IsDynamic() const { return false; }
 
+private:
+
+    // creates the GL buffers from the given data
+    void CreateBuffers(const void* _pVertexData, const void* _pIndexData);
+
 private:
 
     unsigned int m_VBO = 0;
@@ -90,7 +103,7 @@ private:
     unsigned int m_NumIndices = 0;
     unsigned int m_NumFaces = 0;
     unsigned int m_Stride = 0;
-	void* m_pVertexData = nullptr;;
+	void* m_pVertexData = nullptr;
     void* m_pIndexData = nullptr;
 };
 